@@ -0,0 +1,439 @@
+#include "albumart.h"
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <SDL3_image/SDL_image.h>
+
+#include "config.h"
+#include "metrics.h"
+#include "tagreader.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define ALBUMART_ATLAS_COLUMNS         4
+#define ALBUMART_ATLAS_SLOTS           (ALBUMART_ATLAS_COLUMNS*ALBUMART_ATLAS_COLUMNS)
+#define ALBUMART_MAX_UPLOADS_PER_FRAME 2
+
+enum Albumart_Slot_State {
+	ALBUMART_SLOT_EMPTY,
+	ALBUMART_SLOT_PENDING,
+	ALBUMART_SLOT_LOADED,
+	ALBUMART_SLOT_MISSING
+};
+
+struct Albumart_Slot {
+	uint64_t key;
+	uint64_t last_used;
+	enum Albumart_Slot_State state;
+};
+
+struct Albumart_Job {
+	struct Albumart_Job *next;
+	uint64_t key;
+	char filepath[];
+};
+
+struct Albumart_Done {
+	struct Albumart_Done *next;
+	uint64_t key;
+	SDL_Surface *surface; // NULL if there is no cover art
+};
+
+static struct {
+	// only touched by the render thread
+	SDL_Texture *atlas;
+	struct Albumart_Slot slots[ALBUMART_ATLAS_SLOTS];
+	uint64_t use_counter;
+
+	char cache_dir[PATH_MAX];
+	pthread_t worker;
+	pthread_mutex_t lock;
+	pthread_cond_t has_jobs;
+	struct Albumart_Job  *jobs;
+	struct Albumart_Done *done;
+	bool is_initialized;
+} g_albumart;
+
+static const char *g_folder_images[] = {
+	"folder.jpg", "cover.jpg", "front.jpg", "Folder.jpg", "Cover.jpg", "folder.png", "cover.png"
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	for (size_t i=0; i < size; ++i) {
+		hash ^= p[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static uint64_t albumart_key(const char *filepath)
+{
+	return fnv1a(0xCBF29CE484222325ull, filepath, strlen(filepath));
+}
+
+/** Leaves path empty if there is no thumbnail cache. */
+static void albumart_thumbnail_path(const char *source, const struct stat *st, char *path, size_t path_size)
+{
+	if (g_albumart.cache_dir[0] == '\0') {
+		path[0] = '\0';
+		return;
+	}
+
+	// a modified source gets a new name, stale thumbnails are never read again
+	uint64_t hash = albumart_key(source);
+	hash = fnv1a(hash, &st->st_mtime, sizeof(st->st_mtime));
+	hash = fnv1a(hash, &st->st_size , sizeof(st->st_size));
+
+	snprintf(path, path_size, "%s/%016llx.bmp", g_albumart.cache_dir, (unsigned long long) hash);
+}
+
+static SDL_Surface *albumart_load_thumbnail(const char *path)
+{
+	if (path[0] == '\0') return NULL;
+
+	SDL_Surface *surface = SDL_LoadBMP(path);
+	if (surface == NULL) return NULL;
+
+	if (surface->w != ALBUMART_SIZE || surface->h != ALBUMART_SIZE) {
+		log_warning("ignoring thumbnail %s with unexpected size %dx%d\n", path, surface->w, surface->h);
+		SDL_DestroySurface(surface);
+		return NULL;
+	}
+
+	if (surface->format != SDL_PIXELFORMAT_RGBA32) {
+		SDL_Surface *converted = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
+		SDL_DestroySurface(surface);
+		surface = converted;
+	}
+	return surface;
+}
+
+/**
+ * Scales the image into a centered ALBUMART_SIZE square and stores it in the
+ * thumbnail cache, if there is one. Takes ownership of image.
+ */
+static SDL_Surface *albumart_create_thumbnail(SDL_Surface *image, const char *thumbnail_path)
+{
+	const float scale = MIN((float)ALBUMART_SIZE/(float)image->w, (float)ALBUMART_SIZE/(float)image->h);
+	const int w = MAX(1, (int)((float)image->w*scale));
+	const int h = MAX(1, (int)((float)image->h*scale));
+
+	// bilinear filtering only looks at 2x2 pixels, so halve big images
+	// first instead of sampling a 3000px cover down to 128px in one step
+	while (image->w >= 4*w && image->h >= 4*h) {
+		SDL_Surface *halved = SDL_ScaleSurface(image, image->w/2, image->h/2, SDL_SCALEMODE_LINEAR);
+		if (halved == NULL) break;
+
+		SDL_DestroySurface(image);
+		image = halved;
+	}
+
+	SDL_Surface *thumbnail = SDL_CreateSurface(ALBUMART_SIZE, ALBUMART_SIZE, SDL_PIXELFORMAT_RGBA32);
+	if (thumbnail == NULL) {
+		log_error("failed to create thumbnail surface: %s\n", SDL_GetError());
+		SDL_DestroySurface(image);
+		return NULL;
+	}
+
+	const SDL_Rect dst_rect = {
+		.x = (ALBUMART_SIZE-w)/2,
+		.y = (ALBUMART_SIZE-h)/2,
+		.w = w,
+		.h = h
+	};
+	if (!SDL_BlitSurfaceScaled(image, NULL, thumbnail, &dst_rect, SDL_SCALEMODE_LINEAR)) {
+		log_error("failed to scale cover art: %s\n", SDL_GetError());
+	}
+	SDL_DestroySurface(image);
+
+	if (thumbnail_path[0] == '\0') return thumbnail;
+
+	// write to a temporary file first, a half written thumbnail would be
+	// picked up on the next start otherwise
+	char tmp_path[PATH_MAX+8];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", thumbnail_path);
+
+	if (!SDL_SaveBMP(thumbnail, tmp_path) || rename(tmp_path, thumbnail_path) != 0) {
+		log_warning("failed to store thumbnail %s: %s\n", thumbnail_path, SDL_GetError());
+		remove(tmp_path);
+	}
+
+	return thumbnail;
+}
+
+static SDL_Surface *albumart_load_embedded(const char *filepath)
+{
+	struct stat st;
+	if (stat(filepath, &st) != 0) return NULL;
+
+	char thumbnail_path[PATH_MAX];
+	albumart_thumbnail_path(filepath, &st, thumbnail_path, sizeof(thumbnail_path));
+
+	SDL_Surface *thumbnail = albumart_load_thumbnail(thumbnail_path);
+	if (thumbnail != NULL) {
+		metrics_add(METRICS_ALBUMART_CACHE_HITS, 1);
+		return thumbnail;
+	}
+	metrics_add(METRICS_ALBUMART_CACHE_MISSES, 1);
+
+	void  *data = NULL;
+	size_t size = 0;
+	Result r = tagreader_read_picture(filepath, &data, &size);
+	if (!r.success) return NULL;
+
+	SDL_Surface *image = IMG_Load_IO(SDL_IOFromConstMem(data, size), true);
+	free(data);
+
+	if (image == NULL) {
+		log_warning("failed to decode cover art of %s: %s\n", filepath, SDL_GetError());
+		return NULL;
+	}
+	return albumart_create_thumbnail(image, thumbnail_path);
+}
+
+static SDL_Surface *albumart_load_folder_image(const char *filepath)
+{
+	char dir[PATH_MAX];
+	snprintf(dir, sizeof(dir), "%s", filepath);
+
+	char *slash = strrchr(dir, '/');
+	if (slash == NULL) return NULL;
+	*slash = '\0';
+
+	for (size_t i=0; i < ARRAY_SIZE(g_folder_images); ++i) {
+		char image_path[PATH_MAX+32];
+		snprintf(image_path, sizeof(image_path), "%s/%s", dir, g_folder_images[i]);
+
+		struct stat st;
+		if (stat(image_path, &st) != 0) continue;
+
+		char thumbnail_path[PATH_MAX];
+		albumart_thumbnail_path(image_path, &st, thumbnail_path, sizeof(thumbnail_path));
+
+		SDL_Surface *thumbnail = albumart_load_thumbnail(thumbnail_path);
+		if (thumbnail != NULL) {
+			metrics_add(METRICS_ALBUMART_CACHE_HITS, 1);
+			return thumbnail;
+		}
+		metrics_add(METRICS_ALBUMART_CACHE_MISSES, 1);
+
+		SDL_Surface *image = IMG_Load(image_path);
+		if (image == NULL) {
+			log_warning("failed to decode %s: %s\n", image_path, SDL_GetError());
+			continue;
+		}
+		return albumart_create_thumbnail(image, thumbnail_path);
+	}
+	return NULL;
+}
+
+static void *albumart_worker(void *arg)
+{
+	UNUSED(arg);
+
+	while (true) {
+		pthread_mutex_lock(&g_albumart.lock);
+		while (g_albumart.jobs == NULL) {
+			pthread_cond_wait(&g_albumart.has_jobs, &g_albumart.lock);
+		}
+
+		// newest first, the track just selected matters more than the ones
+		// that were skipped over
+		struct Albumart_Job *job = g_albumart.jobs;
+		g_albumart.jobs = job->next;
+		pthread_mutex_unlock(&g_albumart.lock);
+
+		struct Albumart_Done *done = malloc(sizeof(*done));
+		if (done == NULL) {
+			free(job);
+			continue;
+		}
+
+		done->key     = job->key;
+		done->surface = albumart_load_embedded(job->filepath);
+
+		if (done->surface == NULL) {
+			done->surface = albumart_load_folder_image(job->filepath);
+		}
+
+		pthread_mutex_lock(&g_albumart.lock);
+		done->next      = g_albumart.done;
+		g_albumart.done = done;
+		pthread_mutex_unlock(&g_albumart.lock);
+
+		free(job);
+	}
+	return NULL;
+}
+
+static SDL_Rect albumart_slot_rect(size_t slot)
+{
+	const SDL_Rect rect = {
+		.x = (int)(slot % ALBUMART_ATLAS_COLUMNS) * ALBUMART_SIZE,
+		.y = (int)(slot / ALBUMART_ATLAS_COLUMNS) * ALBUMART_SIZE,
+		.w = ALBUMART_SIZE,
+		.h = ALBUMART_SIZE
+	};
+	return rect;
+}
+
+static struct Albumart_Slot *albumart_find_slot(uint64_t key)
+{
+	for (size_t i=0; i < ARRAY_SIZE(g_albumart.slots); ++i) {
+		struct Albumart_Slot *slot = &g_albumart.slots[i];
+		if (slot->state != ALBUMART_SLOT_EMPTY && slot->key == key) return slot;
+	}
+	return NULL;
+}
+
+static struct Albumart_Slot *albumart_evict_slot(void)
+{
+	struct Albumart_Slot *victim = NULL;
+
+	for (size_t i=0; i < ARRAY_SIZE(g_albumart.slots); ++i) {
+		struct Albumart_Slot *slot = &g_albumart.slots[i];
+
+		if (slot->state == ALBUMART_SLOT_EMPTY) return slot;
+
+		// pending slots have to stay until their result arrived
+		if (slot->state == ALBUMART_SLOT_PENDING) continue;
+
+		if (victim == NULL || slot->last_used < victim->last_used) {
+			victim = slot;
+		}
+	}
+	return victim;
+}
+
+void albumart_init(struct Screen *screen)
+{
+	if (g_albumart.is_initialized) return;
+
+	const int atlas_size = ALBUMART_ATLAS_COLUMNS*ALBUMART_SIZE;
+
+	g_albumart.atlas = SDL_CreateTexture(screen->renderer,
+		SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, atlas_size, atlas_size);
+
+	if (g_albumart.atlas == NULL) {
+		log_error("failed to create albumart atlas: %s\n", SDL_GetError());
+		return;
+	}
+	SDL_SetTextureBlendMode(g_albumart.atlas, SDL_BLENDMODE_BLEND);
+
+	Result r = config_get_cache_path("albumart", g_albumart.cache_dir, sizeof(g_albumart.cache_dir));
+	if (!r.success) {
+		log_warning("albumart thumbnails are not cached: %s\n", r.msg);
+		g_albumart.cache_dir[0] = '\0';
+	}
+
+	pthread_mutex_init(&g_albumart.lock, NULL);
+	pthread_cond_init(&g_albumart.has_jobs, NULL);
+
+	if (pthread_create(&g_albumart.worker, NULL, albumart_worker, NULL) != 0) {
+		log_error("failed to start albumart worker\n");
+		return;
+	}
+	pthread_detach(g_albumart.worker);
+
+	g_albumart.is_initialized = true;
+}
+
+uint64_t albumart_request(const char *filepath)
+{
+	const uint64_t key = albumart_key(filepath);
+	if (!g_albumart.is_initialized) return key;
+
+	struct Albumart_Slot *slot = albumart_find_slot(key);
+	if (slot != NULL) {
+		slot->last_used = ++g_albumart.use_counter;
+		return key;
+	}
+
+	slot = albumart_evict_slot();
+	if (slot == NULL) {
+		log_debug("all albumart slots are pending, skipping %s\n", filepath);
+		return key;
+	}
+
+	const size_t path_len = strlen(filepath);
+	struct Albumart_Job *job = malloc(sizeof(*job) + path_len + 1);
+	if (job == NULL) {
+		log_error("failed to allocate albumart job for %s\n", filepath);
+		return key;
+	}
+
+	job->key = key;
+	memcpy(job->filepath, filepath, path_len+1);
+
+	slot->key       = key;
+	slot->state     = ALBUMART_SLOT_PENDING;
+	slot->last_used = ++g_albumart.use_counter;
+
+	pthread_mutex_lock(&g_albumart.lock);
+	job->next       = g_albumart.jobs;
+	g_albumart.jobs = job;
+	pthread_cond_signal(&g_albumart.has_jobs);
+	pthread_mutex_unlock(&g_albumart.lock);
+
+	return key;
+}
+
+bool albumart_get(uint64_t key, SDL_Texture **texture, SDL_FRect *src)
+{
+	struct Albumart_Slot *slot = albumart_find_slot(key);
+	if (slot == NULL || slot->state != ALBUMART_SLOT_LOADED) return false;
+
+	slot->last_used = ++g_albumart.use_counter;
+
+	const SDL_Rect rect = albumart_slot_rect((size_t)(slot - g_albumart.slots));
+	src->x = (float)rect.x;
+	src->y = (float)rect.y;
+	src->w = (float)rect.w;
+	src->h = (float)rect.h;
+
+	*texture = g_albumart.atlas;
+	return true;
+}
+
+void albumart_update(void)
+{
+	if (!g_albumart.is_initialized) return;
+
+	for (size_t i=0; i < ALBUMART_MAX_UPLOADS_PER_FRAME; ++i) {
+		pthread_mutex_lock(&g_albumart.lock);
+		struct Albumart_Done *done = g_albumart.done;
+		if (done != NULL) g_albumart.done = done->next;
+		pthread_mutex_unlock(&g_albumart.lock);
+
+		if (done == NULL) break;
+
+		struct Albumart_Slot *slot = albumart_find_slot(done->key);
+
+		if (slot != NULL && slot->state == ALBUMART_SLOT_PENDING) {
+			slot->state = ALBUMART_SLOT_MISSING;
+
+			if (done->surface != NULL) {
+				const SDL_Rect rect = albumart_slot_rect((size_t)(slot - g_albumart.slots));
+
+				if (SDL_UpdateTexture(g_albumart.atlas, &rect, done->surface->pixels, done->surface->pitch)) {
+					slot->state = ALBUMART_SLOT_LOADED;
+				}
+				else {
+					log_error("failed to upload albumart: %s\n", SDL_GetError());
+				}
+			}
+		}
+
+		SDL_DestroySurface(done->surface);
+		free(done);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef ALBUMART_H
+#define ALBUMART_H
+
+#include <stdint.h>
+
+#include "screen.h"
+
+#define ALBUMART_SIZE 128
+
+/**
+ * Cover art thumbnails for audio files.
+ *
+ * The embedded APIC picture (or a folder.jpg/cover.jpg next to the file) is
+ * extracted, decoded and downscaled to ALBUMART_SIZE by a background worker.
+ * The result is stored as BMP in <cache_dir>/albumart, so the next time only
+ * the small thumbnail has to be loaded.
+ *
+ * Finished thumbnails are uploaded into a single atlas texture by
+ * albumart_update() on the render thread, the least recently used ones are
+ * replaced when the atlas is full.
+ */
+void albumart_init(struct Screen *screen);
+
+/**
+ * Returns the key for albumart_get(), decoding is started in the background
+ * if the thumbnail is not in the atlas yet.
+ */
+uint64_t albumart_request(const char *filepath);
+
+/**
+ * Returns false if the thumbnail is not (yet) available or the file has no
+ * cover art at all.
+ */
+bool albumart_get(uint64_t key, SDL_Texture **texture, SDL_FRect *src);
+
+/**
+ * Uploads finished thumbnails into the atlas, call once per frame.
+ */
+void albumart_update(void);
+
+#endif // ALBUMART_H
@@ -7,16 +7,21 @@
 #include "config.h"
 #include "filebrowser.h"
 #include "audio.h"
+#include "tagreader.h"
+#include "ui_search.h"
+#include "albumart.h"
 
 #include "libcutils/logger.h"
-
-#define MAX_BROWSER_ENTRY_LEN 40
+#include "libcutils/util_makros.h"
 
 static char g_basepath[1024];
+static uint32_t g_list_generation = 0;
 static int  g_index_selected_file = -1;
+static uint64_t g_albumart_key = 0;
 static struct Ui_Clickable_List  g_clickable_list = {0};
 static struct Ui_Media_Player    g_player         = {0};
 static struct Filebrowser        g_filebrowser    = {0};
+static struct Ui_Search          g_search         = {0};
 
 static void jukebox_play_file(struct Node *node, int index)
 {
@@ -32,7 +37,12 @@ static void jukebox_play_file(struct Node *node, int index)
 	}
 	g_player.is_playing    = true;
 	g_index_selected_file  = index;
-	ui_clickable_list_select(&g_clickable_list, g_index_selected_file);
+	g_albumart_key         = albumart_request(absolute_filepath);
+
+	// list positions do not match the node indices while filtered
+	if (!g_search.is_active) {
+		ui_clickable_list_select(&g_clickable_list, g_index_selected_file);
+	}
 
 	struct Audio_Metadata metadata = {0};
 	r = audio_get_metadata(&metadata);
@@ -48,14 +58,86 @@ static void jukebox_play_file(struct Node *node, int index)
 	}
 }
 
+static bool get_list_row(size_t index, struct Ui_List_Row *row, void *userdata)
+{
+	UNUSED(userdata);
+
+	if (index >= ui_search_count(&g_search, g_filebrowser.node_count)) return false;
+	index = ui_search_entry_index(&g_search, index);
+
+	const struct Node *node = &g_filebrowser.nodes[index];
+	const bool has_label    = (node->label[0] != '\0');
+
+	// the id changes with every directory and once more when the tags arrive
+	row->id = ((uint64_t)g_list_generation << 40) | ((uint64_t)has_label << 39) | index;
+	snprintf(row->text, sizeof(row->text), "%s", has_label ? node->label : node->name);
+	return true;
+}
+
+/** The file name and the tags are searched both. */
+static void get_search_text(const struct Node *node, char *text, size_t text_size)
+{
+	snprintf(text, text_size, "%s %s", node->name, node->label);
+}
+
+static void build_search_index(struct Search_Index *index)
+{
+	for (size_t i=0; i < g_filebrowser.node_count; ++i) {
+		const struct Node *node = &g_filebrowser.nodes[i];
+
+		char text[sizeof(node->name)+sizeof(node->label)+1];
+		get_search_text(node, text, sizeof(text));
+
+		Result r = search_index_add(index, text);
+		if (!r.success) {
+			log_error("failed to build search index: %s\n", r.msg);
+			return;
+		}
+	}
+}
+
 static void refresh_clickable_list(void)
 {
-	ui_clickable_list_clear(&g_clickable_list);
+	tagreader_pool_cancel();
+	++g_list_generation;
+
+	ui_search_close(&g_search);
+	ui_search_invalidate(&g_search);
 
 	for (size_t i=0; i < g_filebrowser.node_count; ++i) {
-		char entry[MAX_BROWSER_ENTRY_LEN];
-		strncpy(entry, g_filebrowser.nodes[i].name, sizeof(entry));
-		ui_clickable_list_append(&g_clickable_list, entry);
+		const struct Node *node = &g_filebrowser.nodes[i];
+		if (node->type != NODE_TYPE_FILE) continue;
+
+		char absolute_filepath[PATH_MAX];
+		snprintf(absolute_filepath, sizeof(absolute_filepath),
+			"%s/%s/%s", g_filebrowser.root_path, g_filebrowser.sub_path, node->name);
+		tagreader_pool_submit(absolute_filepath, i);
+	}
+
+	ui_clickable_list_set_source(&g_clickable_list, g_filebrowser.node_count, get_list_row, NULL);
+}
+
+static void apply_finished_tags(void)
+{
+	struct Tagreader_Result result;
+
+	while (tagreader_pool_poll(&result)) {
+		if (result.id >= g_filebrowser.node_count) continue;
+
+		struct Node *node = &g_filebrowser.nodes[result.id];
+		const struct Audio_Metadata *tags = &result.metadata;
+
+		if (tags->artist[0] != '\0' && tags->title[0] != '\0') {
+			snprintf(node->label, sizeof(node->label), "%s \xE2\x80\x93 %s", tags->artist, tags->title);
+		}
+		else {
+			snprintf(node->label, sizeof(node->label), "%s", (tags->title[0] != '\0') ? tags->title : tags->artist);
+		}
+
+		// picked up with the next keystroke, the current results stay valid
+		char text[sizeof(node->name)+sizeof(node->label)+1];
+		get_search_text(node, text, sizeof(text));
+		ui_search_update_entry(&g_search, result.id, text);
 	}
 }
 
@@ -77,7 +159,7 @@ static void play_previous_track(void)
 
 static void play_next_track(void)
 {
-	const int max_index = (int)g_clickable_list.internal.count-1;
+	const int max_index = (int)g_filebrowser.node_count-1;
 	if (g_index_selected_file >= max_index) return;
 
 	int tmp_index = g_index_selected_file+1;
@@ -134,6 +216,8 @@ static void on_media_player_clicked(enum Ui_Media_Button btn)
 
 static void on_filebrowser_clicked(int index)
 {
+	index = (int)ui_search_entry_index(&g_search, (size_t)index);
+
 	struct Node *node = &g_filebrowser.nodes[index];
 	log_debug("Filebrowser[%d] clicked: %s!\n", index, node->name);
 
@@ -151,12 +235,15 @@ void app_jukebox_init(struct Screen *screen, const char *filepath)
 	snprintf(g_basepath, sizeof(g_basepath), "%s/%s", g_config.resources_dir, filepath);
 	log_debug("Trying to load %s\n", g_basepath);
 
+	tagreader_pool_init();
+	albumart_init(screen);
 	filebrowser_init(&g_filebrowser, g_basepath);
 	//ui_clickable_list_clear(&g_clickable_list);
 
 	const int y_start = 200;
 	const int height  = 350;
 
+	ui_search_init(screen, &g_search, 880, y_start-50, 50, y_start, 450, build_search_index);
 	ui_clickable_list_init(screen, &g_clickable_list, 520, y_start, 460, height);
 	refresh_clickable_list();
 	g_clickable_list.on_click = on_filebrowser_clicked;
@@ -186,9 +273,26 @@ void app_jukebox_render(struct Screen *screen)
 		g_player.x, g_player.y-30,
 		g_config.screen_font_size_xs, g_filebrowser.sub_path);
 
+	apply_finished_tags();
+	albumart_update();
+
+	g_player.art_texture = NULL;
+	if (g_index_selected_file >= 0) {
+		albumart_get(g_albumart_key, &g_player.art_texture, &g_player.art_rect);
+	}
+
 	g_player.track_pos_sec = audio_get_current_pos_in_secs();
+
+	if (ui_search_render(screen, &g_search) == UI_EVENT_MODIFIED) {
+		ui_clickable_list_set_count(&g_clickable_list, ui_search_count(&g_search, g_filebrowser.node_count));
+	}
+
 	ui_clickable_list_render(screen, &g_clickable_list);
-	ui_media_player_render(screen, &g_player);
+
+	// the search keyboard takes the place of the player while open
+	if (!g_search.is_active) {
+		ui_media_player_render(screen, &g_player);
+	}
 }
 
 void app_jukebox_close(struct Screen *screen)
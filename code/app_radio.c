@@ -3,6 +3,10 @@
 #include "ui_elements.h"
 #include "config.h"
 #include "audio.h"
+#include "ui_search.h"
+#include "prefetch.h"
+#include "recorder.h"
+#include "station_prober.h"
 
 #include <linux/limits.h>
 #include <time.h>
@@ -12,6 +16,8 @@
 #include "libcutils/config_file.h"
 #include "libcutils/logger.h"
 
+#define TIMESHIFT_SEEK_SECS 15
+
 struct Radio_Station {
 	char name[40];
 	char url[2048];
@@ -26,9 +32,22 @@ struct Radio_Station_List {
 static struct Ui_Clickable_List  g_clickable_list = {0};
 static struct Radio_Station_List g_radio_stations = {0};
 static struct Ui_Media_Player    g_player         = {0};
+static struct Ui_Search          g_search         = {0};
+static struct Ui_Button          g_record_button  = {0};
+static bool                      g_is_record_shown = false;
+
+static void prefetch_neighbour_stations(int index)
+{
+	const int count = (int) g_radio_stations.count;
+
+	prefetch_set_neighbours(
+		(index > 0)       ? g_radio_stations.items[index-1].url : NULL,
+		(index+1 < count) ? g_radio_stations.items[index+1].url : NULL);
+}
 
 static void on_radio_station_clicked(int index)
 {
+	index = (int)ui_search_entry_index(&g_search, (size_t)index);
 	g_radio_stations.selected_item = index;
 
 	struct Radio_Station *radio = &g_radio_stations.items[index];
@@ -44,6 +63,8 @@ static void on_radio_station_clicked(int index)
 	g_player.is_playing = true;
 	g_player.track_pos_sec = 0;
 	strncpy(g_player.first_line , radio->name, sizeof(g_player.first_line));
+
+	prefetch_neighbour_stations(index);
 }
 
 static void on_mediaplayer_clicked(enum Ui_Media_Button btn)
@@ -57,7 +78,15 @@ static void on_mediaplayer_clicked(enum Ui_Media_Button btn)
 			else {
 				int index = g_radio_stations.selected_item;
 
-				if (index != -1) {
+				struct Audio_Buffer_Health health;
+				audio_get_buffer_health(&health);
+
+				// the time-shift kept recording, so continue where it was paused
+				if (index != -1 && health.is_timeshift && audio_get_play_status() == PLAY_STATUS_PAUSED) {
+					audio_resume();
+					g_player.is_playing = true;
+				}
+				else if (index != -1) {
 					struct Radio_Station *radio = &g_radio_stations.items[index];
 					Result res = audio_play_url(radio->url);
 
@@ -71,10 +100,94 @@ static void on_mediaplayer_clicked(enum Ui_Media_Button btn)
 			}
 			break;
 
+		case UI_MEDIA_BUTTON_REW:
+			audio_timeshift_seek(-TIMESHIFT_SEEK_SECS);
+			break;
+
+		case UI_MEDIA_BUTTON_FWD:
+			audio_timeshift_seek(TIMESHIFT_SEEK_SECS);
+			break;
+
 		default: break;
 	}
 }
 
+static void toggle_recording(void)
+{
+	if (recorder_is_active()) {
+		recorder_stop();
+		return;
+	}
+
+	struct Audio_Metadata metadata;
+	audio_get_metadata(&metadata);
+
+	const struct Radio_Station *radio = &g_radio_stations.items[g_radio_stations.selected_item];
+	Result r = recorder_start(radio->name, metadata.title);
+	if (!r.success) {
+		log_error("failed to start recording: %s\n", r.msg);
+	}
+}
+
+static bool get_list_row(size_t index, struct Ui_List_Row *row, void *userdata)
+{
+	const struct Radio_Station_List *list = userdata;
+
+	if (index >= ui_search_count(&g_search, list->count)) return false;
+	index = ui_search_entry_index(&g_search, index);
+
+	const char *name = list->items[index].name;
+	struct Station_Probe probe;
+
+	if (!station_prober_get(index, &probe)) {
+		row->id = index;
+		snprintf(row->text, sizeof(row->text), "%s", name);
+		return true;
+	}
+
+	// the probe result is part of the text, so it has to be part of the id
+	row->id = index | ((uint64_t)probe.state << 32) | ((uint64_t)(uint32_t)probe.bitrate_kbps << 40);
+
+	switch (probe.state) {
+		case STATION_PROBE_DEAD:
+			snprintf(row->text, sizeof(row->text), "%s  [offline]", name);
+			break;
+		case STATION_PROBE_SLOW:
+			snprintf(row->text, sizeof(row->text), "%s  [slow]", name);
+			break;
+		default:
+			if (probe.bitrate_kbps > 0) {
+				snprintf(row->text, sizeof(row->text), "%s  [%dk]", name, probe.bitrate_kbps);
+			}
+			else {
+				snprintf(row->text, sizeof(row->text), "%s", name);
+			}
+			break;
+	}
+	return true;
+}
+
+static void probe_radio_stations(void)
+{
+	const char *urls[ARRAY_SIZE(g_radio_stations.items)];
+
+	for (size_t i=0; i < g_radio_stations.count; ++i) {
+		urls[i] = g_radio_stations.items[i].url;
+	}
+	station_prober_start(urls, g_radio_stations.count);
+}
+
+static void build_search_index(struct Search_Index *index)
+{
+	for (size_t i=0; i < g_radio_stations.count; ++i) {
+		Result r = search_index_add(index, g_radio_stations.items[i].name);
+		if (!r.success) {
+			log_error("failed to build search index: %s\n", r.msg);
+			return;
+		}
+	}
+}
+
 static void radiostation_add(struct Radio_Station_List *list, const char *name, const char *url)
 {
 	if (list->count >= ARRAY_SIZE(list->items)-1) return;
@@ -106,19 +219,19 @@ void app_radio_init(struct Screen *screen, const char *filepath)
 		radiostation_add(&g_radio_stations, cfg.keys[i], cfg.values[i]);
 	}
 
-	ui_clickable_list_clear(&g_clickable_list);
+	probe_radio_stations();
 
 	const int y_start = 200;
 	const int height  = 350;
 
+	ui_search_init(screen, &g_search, 880, y_start-50, 50, y_start, 450, build_search_index);
 	ui_clickable_list_init(screen, &g_clickable_list, 520, y_start, 460, height);
-	for (size_t i=0; i < g_radio_stations.count; ++i) {
-		ui_clickable_list_append(&g_clickable_list, g_radio_stations.items[i].name);
-	}
+	ui_clickable_list_set_source(&g_clickable_list, g_radio_stations.count, get_list_row, &g_radio_stations);
 
 	g_clickable_list.on_click = on_radio_station_clicked;
 
 	ui_media_player_init(screen, &g_player, 50, y_start, 450, height, on_mediaplayer_clicked);
+	ui_button_init(screen, &g_record_button, "Record", 520, y_start-50);
 }
 
 void app_radio_render(struct Screen *screen)
@@ -136,14 +249,61 @@ void app_radio_render(struct Screen *screen)
 	//	}
 	//}
 
-	snprintf(
-		g_player.last_line,
-		sizeof(g_player.last_line),
-		"Buffered: %d kB",
-		audio_get_buffered_bytes()/1024);
+	struct Audio_Buffer_Health health;
+	audio_get_buffer_health(&health);
+
+	// the stream title arrives in band, it changes with every song
+	struct Audio_Metadata metadata;
+	audio_get_metadata(&metadata);
+	snprintf(g_player.second_line, sizeof(g_player.second_line), "%s", metadata.title);
+
+	if (g_radio_stations.selected_item == -1) {
+		g_player.last_line[0] = '\0';
+	}
+	else if (health.is_reconnecting && health.is_buffering) {
+		snprintf(g_player.last_line, sizeof(g_player.last_line),
+			"Reconnecting... (%d)", health.reconnects);
+	}
+	else if (health.is_buffering) {
+		snprintf(g_player.last_line, sizeof(g_player.last_line),
+			"Buffering %d%%  stalls %d",
+			MIN(99, health.buffered_ms*100/MAX(1, health.target_ms)),
+			health.underruns);
+	}
+	else if (health.is_timeshift && health.timeshift_delay_ms - health.buffered_ms >= 2000) {
+		const int behind_secs = health.timeshift_delay_ms / 1000;
+		snprintf(g_player.last_line, sizeof(g_player.last_line),
+			"-%d:%02d behind live  stalls %d",
+			behind_secs / 60, behind_secs % 60, health.underruns);
+	}
+	else {
+		snprintf(g_player.last_line, sizeof(g_player.last_line),
+			"Buf %.1f/%.1fs jit %dms stalls %d",
+			(double)health.buffered_ms/1000.0, (double)health.target_ms/1000.0,
+			health.jitter_ms, health.underruns);
+	}
+
+	if (ui_search_render(screen, &g_search) == UI_EVENT_MODIFIED) {
+		ui_clickable_list_set_count(&g_clickable_list, ui_search_count(&g_search, g_radio_stations.count));
+	}
 
 	ui_clickable_list_render(screen, &g_clickable_list);
-	ui_media_player_render(screen, &g_player);
+
+	// the recording also ends when the station changes
+	if (recorder_is_active() != g_is_record_shown) {
+		g_is_record_shown = recorder_is_active();
+		ui_button_init(screen, &g_record_button, g_is_record_shown ? "Stop recording" : "Record",
+			g_record_button.outline.x, g_record_button.outline.y);
+	}
+
+	if (g_radio_stations.selected_item != -1 && ui_button_render(screen, &g_record_button) == UI_EVENT_CLICKED) {
+		toggle_recording();
+	}
+
+	// the search keyboard takes the place of the player while open
+	if (!g_search.is_active) {
+		ui_media_player_render(screen, &g_player);
+	}
 }
 
 void app_radio_close(struct Screen *screen)
@@ -5,6 +5,7 @@
 #include <mpg123.h>
 
 #include <assert.h>
+#include <linux/limits.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -13,11 +14,32 @@
 #include "libcutils/util_makros.h"
 
 
+#include "audio_stats.h"
 #include "config.h"
+#include "hls.h"
+#include "hooks.h"
+#include "icy.h"
+#include "jitterbuffer.h"
+#include "metrics.h"
+#include "mpegframe.h"
+#include "netcache.h"
+#include "playlist.h"
+#include "prefetch.h"
+#include "recorder.h"
+#include "relay.h"
+#include "rtcheck.h"
+#include "rtlog.h"
+#include "splice.h"
+#include "trace.h"
+#include "timeshift.h"
 
-#define RINGBUFFER_SIZE (1024 * 1024)
 #define MAX_FEED_CAPACITY (1024 *1024)
-#define DOWNLOAD_BUFFER_SIZE RINGBUFFER_SIZE
+#define DOWNLOAD_BUFFER_SIZE (1024 * 1024)
+#define FEED_CHUNK_SIZE 4096
+#define RECONNECT_MIN_BACKOFF_MS 250
+#define RECONNECT_MAX_BACKOFF_MS 8000
+#define RECONNECT_MAX_ATTEMPTS   20
+#define PLAYLIST_MAX_DEPTH       4
 
 enum Stream_Type {
 	STREAM_TYPE_NONE,
@@ -25,48 +47,42 @@ enum Stream_Type {
 	STREAM_TYPE_URL
 };
 
-struct Static_Buffer {
-	uint8_t data[DOWNLOAD_BUFFER_SIZE];
-	size_t used;
-};
-
-
-size_t static_buffer_bytes_free(const struct Static_Buffer *b) { return (sizeof(b->data) - b->used); }
-void   static_buffer_dup(struct Static_Buffer *dst, const struct Static_Buffer *src) {
-	memcpy(dst->data, src->data, src->used);
-	dst->used = src->used;
-}
-
-void   static_buffer_reset(struct Static_Buffer *b) { b->used = 0; }
-size_t static_buffer_append(struct Static_Buffer *b, uint8_t *data, size_t data_len) {
-	const size_t bytes_to_write = MIN(static_buffer_bytes_free(b), data_len);
-	memcpy(b->data+b->used, data, bytes_to_write);
-	b->used += bytes_to_write;
-	return bytes_to_write;
-}
-
-
 static struct Shard_Audio {
 	SDL_AudioStream *stream;
 	enum Stream_Type  type;
 	mpg123_handle    *decode_handle;
 	enum Play_Status play_status;
 	bool              is_format_set;
-	size_t bytes_feed;
 	struct Audio_Metadata metadata;
+	struct Timeshift timeshift;
+	bool is_timeshift_ready;          /* the ring file is mapped */
+	bool is_timeshift;                /* the current stream goes through it */
 	struct Track_Info {
 		long rate_hz;
 		int channels;
 		int encoding;
 	} track_info;
 
-	struct Static_Buffer download_buffer;
+	struct Jitterbuffer jitterbuffer;
 	struct Urlstream {
 		pthread_t download_thread;
 		bool thread_running;
-		bool   eof;                       /* set when curl finishes (unlikely) */
+		bool   eof;                       /* set when curl gave up reconnecting */
 		pthread_mutex_t lock;
 		bool quit;
+		CURL *curl;
+		struct Mpeg_Framer framer;
+		struct Splice splice;
+		struct Icy_Demuxer icy;
+		char url[PLAYLIST_MAX_URL_LEN];   /* current url, playlists are resolved into it */
+		bool is_playlist;                 /* the current response is a playlist, not audio */
+		char playlist[PLAYLIST_MAX_SIZE+1];
+		size_t playlist_used;
+		size_t bytes_received;            /* of the current connection */
+		_Atomic bool is_reconnecting;
+		_Atomic int reconnects;
+		_Atomic int timeshift_seek_secs;  /* requested by the ui, applied by the download thread */
+		_Atomic int timeshift_delay_ms;
 
 	} stream_by_url;
 } g_audio;
@@ -80,23 +96,34 @@ static void set_audio_format_if_needed(void)
 		&g_audio.track_info.channels, &g_audio.track_info.encoding);
 
 	if ( error == MPG123_OK) {
-		log_info("New format: %li Hz, %i channels, encoding value %i\n", 
+		rtlog_info("New format: %li Hz, %i channels, encoding value %i\n", 
 			g_audio.track_info.rate_hz,
 			g_audio.track_info.channels,
 			g_audio.track_info.encoding);
 
 		SDL_AudioSpec src_spec;
+		RTCHECK_EXCLUDE_BEGIN();
 		SDL_GetAudioStreamFormat(g_audio.stream, &src_spec, NULL);
-		log_info("SDL format: %li Hz, %i channels, encoding value %i\n",
+		RTCHECK_EXCLUDE_END();
+		rtlog_info("SDL format: %d Hz, %i channels, encoding value %i\n",
 			src_spec.freq, src_spec.channels, src_spec.format);
 
 		src_spec.freq = (int)g_audio.track_info.rate_hz;
+		RTCHECK_EXCLUDE_BEGIN();
 		SDL_SetAudioStreamFormat(g_audio.stream, &src_spec, NULL);
+		RTCHECK_EXCLUDE_END();
 
 		if (g_audio.type == STREAM_TYPE_FILE) {
 			off_t samples = mpg123_length(g_audio.decode_handle);
 			g_audio.metadata.length_secs = (double) samples / (double)g_audio.track_info.rate_hz;
 		}
+		else if (g_audio.type == STREAM_TYPE_URL) {
+			struct mpg123_frameinfo info;
+			if (mpg123_info(g_audio.decode_handle, &info) == MPG123_OK) {
+				rtlog_info("stream bitrate: %d kbit/s\n", info.bitrate);
+				jitterbuffer_set_byte_rate(&g_audio.jitterbuffer, info.bitrate*1000/8);
+			}
+		}
 		g_audio.is_format_set = true;
 	}
 }
@@ -143,133 +170,429 @@ static Result audio_parse_id3_metadata(void)
 
 static size_t fill_stream_from_url(uint8_t *dst, size_t bytes_wanted)
 {
-	static struct Static_Buffer tmp_buffer = {0};
+	size_t bytes_done = 0;
+
+	// only feed as much as the decoder asks for, everything else stays in
+	// the jitterbuffer where it counts as buffered
+	while (bytes_done < bytes_wanted) {
+		size_t bytes_decoded = 0;
+		TRACE_BEGIN("mpg123_read");
+		int error = mpg123_read(g_audio.decode_handle, dst+bytes_done, bytes_wanted-bytes_done, &bytes_decoded);
+		TRACE_END("mpg123_read");
+		bytes_done += bytes_decoded;
+
+		if (error == MPG123_NEED_MORE) {
+			audio_stats_count_need_more();
+
+			uint8_t chunk[FEED_CHUNK_SIZE];
+			const size_t bytes_read = jitterbuffer_read(&g_audio.jitterbuffer, chunk, sizeof(chunk));
+			TRACE_COUNTER("jitterbuffer_read_bytes", bytes_read);
+
+			// (re)buffering, the audio device plays silence meanwhile
+			if (bytes_read == 0) break;
+
+			TRACE_BEGIN("mpg123_feed");
+			error = mpg123_feed(g_audio.decode_handle, chunk, bytes_read);
+			TRACE_END("mpg123_feed");
+			if (error != MPG123_OK) {
+				rtlog_error("error while mpg123_feed via url: %s\n", mpg123_plain_strerror(error));
+				break;
+			}
+		}
+		else if (error == MPG123_NEW_FORMAT) {
+			// the format has to be applied before more samples are put
+			g_audio.is_format_set = false;
+			break;
+		}
+		else if (error != MPG123_OK) {
+			rtlog_error("error while mpg123_read() via url: %s\n", mpg123_plain_strerror(error));
+			break;
+		}
+	}
 
-	if (audio_get_buffered_bytes() < MAX_FEED_CAPACITY) {
-		pthread_mutex_lock(&g_audio.stream_by_url.lock);
-		static_buffer_dup(&tmp_buffer, &g_audio.download_buffer);
-		g_audio.download_buffer.used = 0;
-		pthread_mutex_unlock(&g_audio.stream_by_url.lock);
+	return bytes_done;
+}
 
-		int error = mpg123_feed(
-			g_audio.decode_handle,
-			tmp_buffer.data,
-			tmp_buffer.used);
-		g_audio.bytes_feed += tmp_buffer.used;
+static bool urlstream_should_quit(void)
+{
+	pthread_mutex_lock(&g_audio.stream_by_url.lock);
+	const bool quit = g_audio.stream_by_url.quit;
+	pthread_mutex_unlock(&g_audio.stream_by_url.lock);
+	return quit;
+}
 
-		if (error != MPG123_OK) {
-			log_error("error while mpg123_feed via url: %s\n", mpg123_plain_strerror(error));
+/**
+ * Moves what was not fed yet from the time-shift ring into the jitterbuffer.
+ * Seeks are applied here as well, the download thread is the only producer
+ * and the audio callback is locked out while everything starts over.
+ */
+static void urlstream_feed_timeshift(struct Urlstream *buf)
+{
+	struct Timeshift *ts = &g_audio.timeshift;
+	struct Jitterbuffer *jb = &g_audio.jitterbuffer;
+
+	const int seek_secs = atomic_exchange(&buf->timeshift_seek_secs, 0);
+	if (seek_secs != 0) {
+		SDL_LockAudioStream(g_audio.stream);
+
+		const uint64_t play_pos = ts->feed_pos - spsc_ring_bytes_used(&jb->ring);
+		if (timeshift_seek(ts, seek_secs, play_pos)) {
+			jitterbuffer_flush(jb);
+			mpg123_close(g_audio.decode_handle);
+			mpg123_open_feed(g_audio.decode_handle);
+			SDL_ClearAudioStream(g_audio.stream);
 		}
-	}
 
-	//int retval = mpg123_meta_check(g_audio.decode_handle);
-	//log_info("meta check return : 0x%x\n", retval);
-	//if ((retval&(1<< MPG123_ID3)) != 0 || (retval&(1<<MPG123_NEW_ID3)) != 0) {
-	//	Result ret = audio_parse_id3_metadata();
-	//	if (ret.success) {
-	//		log_info("successfully parsed id3 metadata:\n"
-	//			"\tartist: %s\n"
-	//			"\ttitle: %s\n",
-	//			g_audio.metadata.artist,
-	//			g_audio.metadata.title);
-	//	}
-	//	else {
-	//		log_warning("failed to parse id3 metadata: %s\n", ret.msg);
-	//	}
-	//}
-	//else if (retval != 0) {
-	//	// nothing
-	//}
-
-	size_t bytes_done;
-	int error = mpg123_read(g_audio.decode_handle, dst, bytes_wanted, &bytes_done);
-	if (error != MPG123_OK) {
-		log_error("error while mpg123_read() via url: %s\n", mpg123_plain_strerror(error));
+		SDL_UnlockAudioStream(g_audio.stream);
 	}
 
-	if (bytes_done > g_audio.bytes_feed) {
-		g_audio.bytes_feed = 0;
+	size_t size = 0;
+	const uint8_t *data = timeshift_peek(ts, &size);
+
+	while (size > 0) {
+		const size_t bytes_written = jitterbuffer_write(jb, data, size);
+		timeshift_consume(ts, bytes_written);
+		if (bytes_written < size) break;
+
+		data = timeshift_peek(ts, &size);
 	}
-	else {
-		g_audio.bytes_feed -= bytes_done;
+
+	const uint64_t play_pos = ts->feed_pos - spsc_ring_bytes_used(&jb->ring);
+	atomic_store(&buf->timeshift_delay_ms, timeshift_get_delay_ms(ts, play_pos));
+}
+
+/**
+ * Only whole frames go into the jitterbuffer, so the incomplete frame at the
+ * end of a dropped connection never reaches the decoder. Returns false if
+ * the stream is to be stopped.
+ */
+static bool urlstream_push_audio(struct Urlstream *buf, const uint8_t *data, size_t size)
+{
+	size_t bytes_taken = 0;
+
+	while (bytes_taken < size) {
+		if (urlstream_should_quit()) {
+			rtlog_info("write: detected quit action,!\n");
+			return false;
+		}
+
+		bytes_taken += mpeg_framer_push(&buf->framer, data+bytes_taken, size-bytes_taken);
+
+		size_t bytes_ready = 0;
+		const uint8_t *frames = mpeg_framer_ready(&buf->framer, &bytes_ready);
+
+		// drop what the server repeats at the start of a new connection
+		const size_t bytes_duplicate = splice_take_duplicates(&buf->splice, frames, bytes_ready);
+		if (bytes_duplicate > 0) {
+			mpeg_framer_consume(&buf->framer, bytes_duplicate);
+			frames = mpeg_framer_ready(&buf->framer, &bytes_ready);
+		}
+
+		// with time-shift the download never waits for playback
+		if (g_audio.is_timeshift) {
+			timeshift_write(&g_audio.timeshift, frames, bytes_ready);
+			splice_record(&buf->splice, frames, bytes_ready);
+			recorder_write(frames, bytes_ready);
+			relay_write(frames, bytes_ready);
+			mpeg_framer_consume(&buf->framer, bytes_ready);
+			urlstream_feed_timeshift(buf);
+			continue;
+		}
+
+		const size_t bytes_written = jitterbuffer_write(&g_audio.jitterbuffer, frames, bytes_ready);
+		TRACE_COUNTER("jitterbuffer_bytes", spsc_ring_bytes_used(&g_audio.jitterbuffer.ring));
+		splice_record(&buf->splice, frames, bytes_written);
+		recorder_write(frames, bytes_written);
+		relay_write(frames, bytes_written);
+		mpeg_framer_consume(&buf->framer, bytes_written);
+
+		if (bytes_written < bytes_ready) {
+			rtlog_debug("write: buffer full, waiting...\n");
+			SDL_Delay(50);
+		}
 	}
-	return bytes_done;
+	return true;
 }
 
-static size_t curl_buffer_write_callback(void *ptr, size_t size, size_t nmemb, void *userdata)
+static void urlstream_publish_title(struct Urlstream *buf)
 {
-	UNUSED(userdata);
-	struct Urlstream *buf = &g_audio.stream_by_url;
+	buf->icy.has_new_title = false;
+	rtlog_info("stream title: %s\n", buf->icy.title);
 
 	pthread_mutex_lock(&buf->lock);
-	buf->thread_running = true;
+	snprintf(g_audio.metadata.title, sizeof(g_audio.metadata.title), "%s", buf->icy.title);
 	pthread_mutex_unlock(&buf->lock);
 
-	const size_t bytes_total   = size * nmemb;
-	size_t       bytes_written = 0;
+	recorder_split(buf->icy.title);
+}
 
-	while (bytes_written < bytes_total) {
-		pthread_mutex_lock(&buf->lock);
+static size_t urlstream_write(void *ptr, size_t bytes_total, struct Urlstream *buf)
+{
+	size_t bytes_taken = 0;
 
-		if (buf->quit) {
-			log_info("write: detected quit action,!\n");
-			buf->thread_running = false;
-			pthread_mutex_unlock(&buf->lock);
+	if (buf->bytes_received == 0 && buf->playlist_used == 0) {
+		netcache_log_timings(buf->curl);
+
+		const char *content_type = NULL;
+		curl_easy_getinfo(buf->curl, CURLINFO_CONTENT_TYPE, &content_type);
+		buf->is_playlist = playlist_detect(buf->url, content_type, ptr, bytes_total);
+	}
+
+	// playlists are collected and resolved once complete
+	if (buf->is_playlist) {
+		if (buf->playlist_used + bytes_total > PLAYLIST_MAX_SIZE) {
+			rtlog_error("playlist is larger than %d bytes\n", PLAYLIST_MAX_SIZE);
 			return CURL_WRITEFUNC_ERROR;
 		}
+		memcpy(buf->playlist+buf->playlist_used, ptr, bytes_total);
+		buf->playlist_used += bytes_total;
+		buf->playlist[buf->playlist_used] = '\0';
+		return bytes_total;
+	}
 
-		size_t bytes_left = bytes_total-bytes_written;
+	jitterbuffer_note_arrival(&g_audio.jitterbuffer, bytes_total);
+	buf->bytes_received += bytes_total;
+	atomic_store(&buf->is_reconnecting, false);
 
-		size_t tmp = static_buffer_append(
-			&g_audio.download_buffer,
-			(uint8_t*)ptr+bytes_written,
-			bytes_left);
+	// metadata blocks are skipped, the audio in between is passed on as is
+	while (bytes_taken < bytes_total) {
+		const uint8_t *data = (uint8_t*)ptr + bytes_taken;
+		size_t bytes_audio  = 0;
 
-		bytes_written += tmp;
+		bytes_taken += icy_demux(&buf->icy, data, bytes_total-bytes_taken, &bytes_audio);
 
-		if (tmp < bytes_left) {
-			log_debug("write: buffer full, waiting...\n");
-			pthread_mutex_unlock(&buf->lock);
-			sleep(1);
-			continue;
+		if (bytes_audio > 0 && !urlstream_push_audio(buf, data, bytes_audio)) {
+			return CURL_WRITEFUNC_ERROR;
+		}
+		if (buf->icy.has_new_title) {
+			urlstream_publish_title(buf);
 		}
+	}
+	return bytes_taken;
+}
+
+static size_t curl_buffer_write_callback(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	TRACE_BEGIN("curl_write");
+	TRACE_COUNTER("curl_write_bytes", size * nmemb);
+	metrics_add(METRICS_NET_RECEIVED_BYTES, size * nmemb);
+
+	const size_t bytes_taken = urlstream_write(ptr, size * nmemb, userdata);
+
+	TRACE_END("curl_write");
+	return bytes_taken;
+}
+
+static size_t curl_header_callback(char *line, size_t size, size_t nitems, void *userdata)
+{
+	struct Urlstream *buf = userdata;
+	const size_t bytes_total = size * nitems;
+
+	size_t metaint = 0;
+
+	// every response of a redirect chain starts over
+	if (strncmp(line, "HTTP/", 5) == 0 || strncmp(line, "ICY ", 4) == 0) {
+		icy_reset(&buf->icy, 0);
+	}
+	else if (icy_parse_metaint_header(line, bytes_total, &metaint)) {
+		log_debug("stream metadata every %zu bytes\n", metaint);
+		icy_reset(&buf->icy, metaint);
+	}
+	return bytes_total;
+}
+
+static int urlstream_progress_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	UNUSED(dltotal);
+	UNUSED(dlnow);
+	UNUSED(ultotal);
+	UNUSED(ulnow);
+
+	// keeps a paused time-shift moving while no data arrives
+	if (g_audio.is_timeshift) urlstream_feed_timeshift(userdata);
+
+	// also called while connecting, when the write callback is not
+	return urlstream_should_quit() ? 1 : 0;
+}
+
+static void urlstream_wait(uint32_t delay_ms)
+{
+	for (uint32_t waited = 0; waited < delay_ms && !urlstream_should_quit(); waited += 50) {
+		SDL_Delay(50);
+	}
+}
+
+static bool hls_sink_push(void *userdata, const uint8_t *data, size_t size)
+{
+	struct Urlstream *buf = userdata;
+
+	TRACE_COUNTER("hls_segment_bytes", size);
+
+	// a segment is the unit of arrival, its duration balances the wait for it
+	jitterbuffer_note_arrival(&g_audio.jitterbuffer, size);
+	buf->bytes_received += size;
+	atomic_store(&buf->is_reconnecting, false);
+
+	return urlstream_push_audio(buf, data, size);
+}
 
-		pthread_mutex_unlock(&buf->lock);
+static void hls_sink_discontinuity(void *userdata)
+{
+	struct Urlstream *buf = userdata;
+	mpeg_framer_reset(&buf->framer);
+}
+
+static bool hls_sink_should_quit(void *userdata)
+{
+	// polled between segments as well, so seeks do not wait for the next one
+	if (g_audio.is_timeshift) urlstream_feed_timeshift(userdata);
+
+	return urlstream_should_quit();
+}
+
+/**
+ * Plays or resolves the playlist the last transfer received. Returns true
+ * if buf->url was set to an entry of a .pls or .m3u, which is to be
+ * connected right away. finished is set if the stream must not be retried.
+ */
+static bool urlstream_open_playlist(struct Urlstream *buf, int *depth, bool *finished)
+{
+	char base_url[PLAYLIST_MAX_URL_LEN];
+	const char *effective_url = NULL;
+
+	curl_easy_getinfo(buf->curl, CURLINFO_EFFECTIVE_URL, &effective_url);
+	snprintf(base_url, sizeof(base_url), "%s", (effective_url != NULL) ? effective_url : buf->url);
+
+	if (playlist_get_type(buf->playlist) == PLAYLIST_TYPE_HLS) {
+		const struct Hls_Sink sink = {
+			.push          = hls_sink_push,
+			.discontinuity = hls_sink_discontinuity,
+			.should_quit   = hls_sink_should_quit,
+			.userdata      = buf,
+		};
+
+		const enum Hls_Status status = hls_play(base_url, buf->playlist, &sink);
+		*finished = (status == HLS_STATUS_ENDED || status == HLS_STATUS_UNSUPPORTED);
+		if (status == HLS_STATUS_FAILED) log_warning("hls stream failed\n");
+		return false;
+	}
+
+	if (++(*depth) > PLAYLIST_MAX_DEPTH) {
+		log_error("too many nested playlists at %s\n", base_url);
+		return false;
+	}
+
+	if (!playlist_get_first_entry(buf->playlist, base_url, buf->url, sizeof(buf->url))) {
+		log_error("no playable entry in playlist %s\n", base_url);
+		return false;
 	}
-	return bytes_written;
+
+	log_info("playlist entry: %s\n", buf->url);
+	return true;
 }
 
 static void *curl_thread(void *arg)
 {
-	const char *url = (const char*) arg;
+	const char *station_url = (const char*) arg;
+	struct Urlstream *buf = &g_audio.stream_by_url;
 
-	CURL *curl = curl_easy_init();
+	trace_set_thread_name("download");
+
+	CURL *curl = netcache_acquire();
 	if (!curl) {
 		log_error("curl init failed\n");
 		return NULL;
 	}
+	buf->curl = curl;
+
+	// asks shoutcast/icecast servers to interleave the stream title
+	struct curl_slist *headers = curl_slist_append(NULL, "Icy-MetaData: 1");
 
-	curl_easy_setopt(curl, CURLOPT_URL, url);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_buffer_write_callback);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &g_audio.stream_by_url);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, buf);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curl_header_callback);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, buf);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, urlstream_progress_callback);
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, buf);
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
 	curl_easy_setopt(curl, CURLOPT_USERAGENT, "DuckAI/1.0");
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
 	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L);          /* no timeout for live stream */
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+
+	/* a connection without any data for 10s is dropped and reconnected */
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L);
+
+	log_info("start streaming from %s\n", station_url);
+	snprintf(buf->url, sizeof(buf->url), "%s", station_url);
+
+	uint32_t backoff_ms      = 0;
+	int      failed_attempts = 0;
+	int      playlist_depth  = 0;
+
+	while (!urlstream_should_quit()) {
+		mpeg_framer_reset(&buf->framer);
+		splice_begin(&buf->splice);
+		icy_reset(&buf->icy, 0);
+		buf->bytes_received = 0;
+		buf->is_playlist    = false;
+		buf->playlist_used  = 0;
+
+		curl_easy_setopt(curl, CURLOPT_URL, buf->url);
+		CURLcode res = curl_easy_perform(curl);
+		if (urlstream_should_quit()) break;
+
+		if (buf->is_playlist && res == CURLE_OK) {
+			bool finished = false;
+			if (urlstream_open_playlist(buf, &playlist_depth, &finished)) continue;
+			if (finished || urlstream_should_quit()) break;
+		}
+		else {
+			curl_off_t content_length = -1;
+			curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
 
-	log_info("start streaming from %s\n", url);
+			if (res == CURLE_OK && content_length > 0) {
+				log_info("finished download of %s\n", buf->url);
+				break;
+			}
 
+			if (res != CURLE_OK) log_warning("curl error: %s\n", curl_easy_strerror(res));
+			else                 log_warning("stream closed by server\n");
+		}
 
-	CURLcode res = curl_easy_perform(curl);
-	if (res != CURLE_OK) {
-		log_error("curl error: %s\n", curl_easy_strerror(res));
+		// reconnect at once after a working connection, the jitterbuffer
+		// is still playing and the new stream is spliced on a frame border
+		if (buf->bytes_received > 0) {
+			backoff_ms      = 0;
+			failed_attempts = 0;
+		}
+		else if (++failed_attempts >= RECONNECT_MAX_ATTEMPTS) {
+			log_error("giving up on %s after %d attempts\n", station_url, failed_attempts);
+			break;
+		}
+
+		atomic_store(&buf->is_reconnecting, true);
+		atomic_fetch_add(&buf->reconnects, 1);
+		log_info("reconnecting in %u ms\n", backoff_ms);
+
+		urlstream_wait(backoff_ms);
+		backoff_ms = MAX(RECONNECT_MIN_BACKOFF_MS, MIN(backoff_ms*2, RECONNECT_MAX_BACKOFF_MS));
+
+		// playlists may point somewhere else by now, resolve them again
+		snprintf(buf->url, sizeof(buf->url), "%s", station_url);
+		playlist_depth = 0;
 	}
 
 	log_debug("CURL END!\n");
-	pthread_mutex_lock(&g_audio.stream_by_url.lock);
-	g_audio.stream_by_url.eof = true;
-	pthread_mutex_unlock(&g_audio.stream_by_url.lock);
+	pthread_mutex_lock(&buf->lock);
+	buf->eof = true;
+	pthread_mutex_unlock(&buf->lock);
 
-	curl_easy_cleanup(curl);
+	netcache_release(curl);
+	curl_slist_free_all(headers);
 
 	return NULL;
 }
@@ -279,14 +602,16 @@ static void *curl_thread(void *arg)
 static size_t fill_stream_from_file(uint8_t *dst, size_t bytes_wanted)
 {
 	size_t bytes_decoded = 0;
+	TRACE_BEGIN("mpg123_read");
 	int merror = mpg123_read(g_audio.decode_handle, dst, bytes_wanted, &bytes_decoded);
+	TRACE_END("mpg123_read");
 
 	if (merror == MPG123_DONE) {
 		audio_pause();
 		g_audio.play_status = PLAY_STATUS_FINISHED;
 	}
 	else if (merror != MPG123_OK) {
-		log_error("failed to decode audio file: %s\n", mpg123_plain_strerror(merror));
+		rtlog_error("failed to decode audio file: %s\n", mpg123_plain_strerror(merror));
 	}
 
 	return bytes_decoded;
@@ -295,31 +620,63 @@ static size_t fill_stream_from_file(uint8_t *dst, size_t bytes_wanted)
 static void fill_sdl_stream_callback(void *userdata, SDL_AudioStream *stream, int additional_amount, int total_amount)
 {
 	uint8_t buffer[5000];
-	size_t bytes_decoded = 0;
+	const size_t bytes_requested = (size_t) MAX(additional_amount, 0);
+	size_t bytes_put = 0;
+
+	const uint64_t start_ns = SDL_GetTicksNS();
+	const int fill_percent  = (g_audio.type == STREAM_TYPE_URL)
+		? (int)(spsc_ring_bytes_used(&g_audio.jitterbuffer.ring)*100 / g_audio.jitterbuffer.ring.capacity)
+		: -1;
+
+	// the trace points are checked as well, they claim a buffer on the
+	// first call of a new audio thread
+	RTCHECK_ENTER();
+	trace_set_thread_name("audio");
+	TRACE_BEGIN("fill_sdl_stream");
+	TRACE_COUNTER("audio_wanted_bytes", bytes_requested);
+
+	// SDL may ask for more than the buffer holds, a short put is played as silence
+	do {
+		const size_t bytes_wanted = MIN(sizeof(buffer), bytes_requested-bytes_put);
+		size_t bytes_decoded = 0;
+
+		switch (g_audio.type) {
+			case STREAM_TYPE_NONE:
+				rtlog_error("forbidden state! Stream callback but not stream type is set!\n");
+				assert(false);
+				break;
+
+			case STREAM_TYPE_FILE:
+				bytes_decoded = fill_stream_from_file(buffer, bytes_wanted);
+				break;
+
+			case STREAM_TYPE_URL:
+				bytes_decoded = fill_stream_from_url(buffer, bytes_wanted);
+		}
 
-	const size_t bytes_wanted  = MIN(sizeof(buffer),(size_t)additional_amount);
-	switch (g_audio.type) {
-		case STREAM_TYPE_NONE:
-			log_error("forbidden state! Stream callback but not stream type is set!\n");
-			assert(false);
-			break;
+		// only the SDL calls are left out, they take the stream lock SDL
+		// already holds for the callback
+		set_audio_format_if_needed();
+		RTCHECK_EXCLUDE_BEGIN();
+		const bool is_put = SDL_PutAudioStreamData(g_audio.stream, buffer, (int)bytes_decoded);
+		RTCHECK_EXCLUDE_END();
 
-		case STREAM_TYPE_FILE:
-			bytes_decoded = fill_stream_from_file(buffer, bytes_wanted);
+		if (!is_put) {
+			rtlog_error("failed to put audio stream data: %s\n", SDL_GetError());
 			break;
+		}
+		bytes_put += bytes_decoded;
 
-		case STREAM_TYPE_URL:
-			bytes_decoded = fill_stream_from_url(buffer, bytes_wanted);
-	}
+		// buffering, a new format or the end of the file
+		if (bytes_decoded < bytes_wanted) break;
+	} while (bytes_put < bytes_requested);
+
+	TRACE_END("fill_sdl_stream");
+	audio_stats_record_callback(bytes_requested, bytes_put, SDL_GetTicksNS()-start_ns, fill_percent);
+	RTCHECK_LEAVE();
 
-	set_audio_format_if_needed();
-	if (!SDL_PutAudioStreamData(g_audio.stream, buffer, (int)bytes_decoded)) {
-		log_error("failed to put audio stream data: %s\n", SDL_GetError());
-		return;
-	}
 	(void) userdata;
 	(void) stream;
-	(void) additional_amount;
 	(void) total_amount;
 }
 
@@ -351,17 +708,17 @@ static SDL_AudioDeviceID get_audio_device_or_default(const char *device_name)
 
 static void clear_download_and_cache(void)
 {
+	if (!g_audio.stream_by_url.thread_running) return;
+
 	pthread_mutex_lock(&g_audio.stream_by_url.lock);
-	if (g_audio.stream_by_url.thread_running) {
-		g_audio.stream_by_url.quit = true;
-		pthread_mutex_unlock(&g_audio.stream_by_url.lock);
-		assert(pthread_join(g_audio.stream_by_url.download_thread, NULL) == 0);
-		log_info("stopped old download thread\n");
-	}
-	else {
-		pthread_mutex_unlock(&g_audio.stream_by_url.lock);
-	}
-	static_buffer_reset(&g_audio.download_buffer);
+	g_audio.stream_by_url.quit = true;
+	pthread_mutex_unlock(&g_audio.stream_by_url.lock);
+
+	TRACE_BEGIN("download_join");
+	assert(pthread_join(g_audio.stream_by_url.download_thread, NULL) == 0);
+	TRACE_END("download_join");
+	g_audio.stream_by_url.thread_running = false;
+	log_info("stopped old download thread\n");
 }
 
 static void init_play_audio(void)
@@ -370,48 +727,99 @@ static void init_play_audio(void)
 	PRECONDITION(g_audio.decode_handle != NULL);
 
 	clear_download_and_cache();
-
-	mpg123_close(g_audio.decode_handle);
+	recorder_stop();
 
 	memset(&g_audio.metadata, 0, sizeof(g_audio.metadata));
-	g_audio.bytes_feed = 0;
 	g_audio.stream_by_url.quit         = false;
 	g_audio.stream_by_url.eof          = false;
-	g_audio.stream_by_url.thread_running = false;
+	atomic_store(&g_audio.stream_by_url.is_reconnecting, false);
+	atomic_store(&g_audio.stream_by_url.reconnects, 0);
+	atomic_store(&g_audio.stream_by_url.timeshift_seek_secs, 0);
+	atomic_store(&g_audio.stream_by_url.timeshift_delay_ms, 0);
 	g_audio.is_format_set = false;
 }
 
-Result audio_play_url(const char *url)
+static void audio_prepare_timeshift(void)
 {
-	init_play_audio();
+	g_audio.is_timeshift = false;
+	if (g_config.radio_timeshift_min <= 0) return;
 
-	if (pthread_create(&g_audio.stream_by_url.download_thread, NULL, curl_thread, (void*)url) != 0) {
-		return result_make(false, "Failed to start curl thread\n");
+	if (!g_audio.is_timeshift_ready) {
+		char path[PATH_MAX];
+
+		Result r = config_get_cache_path("radio", path, sizeof(path));
+		if (r.success) {
+			strncat(path, "/timeshift.ring", sizeof(path)-strlen(path)-1);
+			r = timeshift_init(&g_audio.timeshift, path, g_config.radio_timeshift_min);
+		}
+
+		if (!r.success) {
+			log_error("time-shift disabled: %s\n", r.msg);
+			return;
+		}
+		g_audio.is_timeshift_ready = true;
 	}
 
-	// TODO: smarter way of doing this, e.g. play silence until buffer is
-	// filled enough or something. Waiting here just blocks screen
-	// refreshing.
-	while (true) {
-		pthread_mutex_lock(&g_audio.stream_by_url.lock);
-		size_t bytes_buffered = g_audio.download_buffer.used;
-		pthread_mutex_unlock(&g_audio.stream_by_url.lock);
+	timeshift_reset(&g_audio.timeshift);
+	g_audio.is_timeshift = true;
+}
 
-		log_debug("buffered %zu bytes\n", bytes_buffered);
-		if ((double)bytes_buffered >= (DOWNLOAD_BUFFER_SIZE*0.1)) {
-			break;
+Result audio_play_url(const char *url)
+{
+	// every worker is stopped before the audio callback is locked out, the
+	// download thread locks the stream itself for time-shift seeks
+	init_play_audio();
+	audio_prepare_timeshift();
+	splice_reset(&g_audio.stream_by_url.splice);
+	memset(&g_audio.stream_by_url.icy, 0, sizeof(g_audio.stream_by_url.icy));
+
+	// start from the standby buffer, the first connection continues it
+	void  *prefetched      = NULL;
+	size_t prefetched_size = 0;
+	const bool is_prefetched = prefetch_take(url, &prefetched, &prefetched_size);
+	if (is_prefetched) {
+		log_info("starting with %zu prefetched bytes\n", prefetched_size);
+		metrics_add(METRICS_PREFETCH_HITS, 1);
+
+		if (g_audio.is_timeshift) {
+			timeshift_write(&g_audio.timeshift, prefetched, prefetched_size);
+			splice_record(&g_audio.stream_by_url.splice, prefetched, prefetched_size);
 		}
+	}
+	else if (g_config.radio_prefetch) {
+		metrics_add(METRICS_PREFETCH_MISSES, 1);
+	}
 
-		SDL_Delay(500);
+	// keep the audio callback out only while the decoder and the buffer are swapped
+	SDL_LockAudioStream(g_audio.stream);
+	mpg123_close(g_audio.decode_handle);
+	const int feed_error = mpg123_open_feed(g_audio.decode_handle);
+	jitterbuffer_reset(&g_audio.jitterbuffer, url);
 
+	if (is_prefetched && g_audio.is_timeshift) {
+		urlstream_feed_timeshift(&g_audio.stream_by_url);
 	}
+	else if (is_prefetched) {
+		const size_t bytes_written = jitterbuffer_write(&g_audio.jitterbuffer, prefetched, prefetched_size);
+		splice_record(&g_audio.stream_by_url.splice, prefetched, bytes_written);
+	}
+	g_audio.is_format_set = false;
+	if (feed_error == MPG123_OK) g_audio.type = STREAM_TYPE_URL;
+	SDL_UnlockAudioStream(g_audio.stream);
+	free(prefetched);
 
-	if (mpg123_open_feed(g_audio.decode_handle) != MPG123_OK) {
+	if (feed_error != MPG123_OK) {
 		return result_make(false, "failed to open feed: %s",
 			mpg123_strerror(g_audio.decode_handle));
 	}
 
-	g_audio.type = STREAM_TYPE_URL;
+	// no waiting here, playback starts by itself once the jitterbuffer
+	// reached its target depth
+	if (pthread_create(&g_audio.stream_by_url.download_thread, NULL, curl_thread, (void*)url) != 0) {
+		return result_make(false, "Failed to start curl thread\n");
+	}
+	g_audio.stream_by_url.thread_running = true;
+
 	audio_resume();
 
 	return result_make_success();
@@ -420,12 +828,15 @@ Result audio_play_url(const char *url)
 Result audio_play_file(const char *filepath)
 {
 	init_play_audio();
+	mpg123_close(g_audio.decode_handle);
 
 	if (mpg123_open(g_audio.decode_handle, filepath) != MPG123_OK) {
 		return result_make(false, "failed to open file %s: %s",
 			filepath, mpg123_strerror(g_audio.decode_handle));
 	}
+	TRACE_BEGIN("mpg123_scan");
 	mpg123_scan(g_audio.decode_handle);
+	TRACE_END("mpg123_scan");
 	Result r = audio_parse_id3_metadata();
 	if (!r.success) {
 		log_warning("unable to parse id3 metadata: %s\n", r.msg);
@@ -442,9 +853,9 @@ Result audio_open(void)
 {
 	log_info("opening audio device...\n");
 
-	char buffer[1024];
-	snprintf(buffer, sizeof(buffer), "%s/hooks/on_audio_open.sh", g_config.resources_dir);
-	system(buffer);
+	TRACE_BEGIN("hook_audio_open");
+	hooks_run("on_audio_open", g_config.hook_on_audio_open_barrier);
+	TRACE_END("hook_audio_open");
 
 	SDL_AudioDeviceID audio_device = get_audio_device_or_default(g_config.audio_device_name);
 
@@ -465,6 +876,16 @@ Result audio_open(void)
 	memset(&g_audio.stream_by_url, 0, sizeof(g_audio.stream_by_url));
 	pthread_mutex_init(&g_audio.stream_by_url.lock, NULL);
 
+	if (g_audio.jitterbuffer.ring.data == NULL) {
+		Result r = jitterbuffer_init(&g_audio.jitterbuffer, DOWNLOAD_BUFFER_SIZE);
+		if (!r.success) return r;
+	}
+
+	if (g_config.radio_relay_port > 0) {
+		Result r = relay_start(g_config.radio_relay_port);
+		if (!r.success) log_error("relay disabled: %s\n", r.msg);
+	}
+
 	return result_make_success();
 }
 
@@ -472,9 +893,16 @@ void audio_close(void)
 {
 	log_info("closing audio device...\n");
 
-	char buffer[1024];
-	snprintf(buffer, sizeof(buffer), "%s/hooks/on_audio_close.sh", g_config.resources_dir);
-	system(buffer);
+	TRACE_BEGIN("hook_audio_close");
+	hooks_run("on_audio_close", g_config.hook_on_audio_close_barrier);
+	TRACE_END("hook_audio_close");
+
+	// the workers go first, the download thread locks the stream and
+	// reopens the decoder for time-shift seeks
+	clear_download_and_cache();
+	recorder_stop();
+	relay_stop();
+	prefetch_stop_all();
 
 	if (g_audio.stream != NULL) {
 		SDL_DestroyAudioStream(g_audio.stream);
@@ -487,8 +915,10 @@ void audio_close(void)
 		g_audio.decode_handle = NULL;
 	}
 
-	if (g_audio.type == STREAM_TYPE_URL) {
-		g_audio.stream_by_url.quit = true;
+	if (g_audio.is_timeshift_ready) {
+		timeshift_free(&g_audio.timeshift);
+		g_audio.is_timeshift_ready = false;
+		g_audio.is_timeshift       = false;
 	}
 
 	g_audio.play_status = PLAY_STATUS_STOPPED;
@@ -543,6 +973,25 @@ int audio_get_buffered_bytes(void) {
 	mpg123_getstate(g_audio.decode_handle, MPG123_BUFFERFILL, &buffered_bytes, NULL);
 	return (int) buffered_bytes;
 }
+void audio_get_buffer_health(struct Audio_Buffer_Health *health)
+{
+	if (g_audio.type != STREAM_TYPE_URL) {
+		memset(health, 0, sizeof(*health));
+		return;
+	}
+	jitterbuffer_get_health(&g_audio.jitterbuffer, health);
+	health->is_reconnecting = atomic_load(&g_audio.stream_by_url.is_reconnecting);
+	health->reconnects      = atomic_load(&g_audio.stream_by_url.reconnects);
+	health->is_timeshift    = g_audio.is_timeshift;
+	health->timeshift_delay_ms = atomic_load(&g_audio.stream_by_url.timeshift_delay_ms);
+}
+
+void audio_timeshift_seek(int delta_secs)
+{
+	if (!g_audio.is_timeshift) return;
+	atomic_fetch_add(&g_audio.stream_by_url.timeshift_seek_secs, delta_secs);
+}
+
 int audio_get_buffered_percent(void)
 {
 	return audio_get_buffered_bytes()*100/MAX_FEED_CAPACITY;
@@ -561,9 +1010,12 @@ void audio_set_volume(int volume)
 
 Result audio_get_metadata(struct Audio_Metadata *metadata)
 {
+	// the title of a radio stream is updated by the download thread
+	pthread_mutex_lock(&g_audio.stream_by_url.lock);
 	strncpy(metadata->title, g_audio.metadata.title, sizeof(metadata->title));
 	strncpy(metadata->artist, g_audio.metadata.artist, sizeof(metadata->artist));
 	metadata->length_secs = g_audio.metadata.length_secs;
+	pthread_mutex_unlock(&g_audio.stream_by_url.lock);
 
 	return result_make_success();
 }
@@ -9,6 +9,18 @@ struct Audio_Metadata{
 	double length_secs;
 };
 
+struct Audio_Buffer_Health {
+	bool is_buffering;
+	int buffered_ms;
+	int target_ms;
+	int jitter_ms;
+	int underruns;
+	bool is_reconnecting;
+	int reconnects;
+	bool is_timeshift;
+	int timeshift_delay_ms;     // from the live end to what is heard
+};
+
 enum Play_Status {
 	PLAY_STATUS_STOPPED,
 	PLAY_STATUS_PLAYING,
@@ -22,6 +34,13 @@ Result audio_play_file(const char *filepath);
 Result audio_get_metadata(struct Audio_Metadata *metadata);
 int audio_get_buffered_bytes(void);
 int audio_get_buffered_percent(void);
+void audio_get_buffer_health(struct Audio_Buffer_Health *health);
+
+/**
+ * Seeks within the time-shift window of the playing radio stream, if
+ * radio_timeshift_minutes is set.
+ */
+void audio_timeshift_seek(int delta_secs);
 bool audio_is_playing(void);
 enum Play_Status audio_get_play_status(void);
 void audio_pause(void);
@@ -0,0 +1,179 @@
+#include "audio_stats.h"
+
+#include <linux/limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio.h"
+#include "config.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define AUDIO_STATS_FILE  "stats.txt"
+
+// single writer, the audio thread, so plain stores of the new values do
+static struct {
+	_Atomic uint64_t callbacks;
+	_Atomic uint64_t bytes_requested;
+	_Atomic uint64_t bytes_delivered;
+	_Atomic uint64_t short_callbacks;
+	_Atomic uint64_t need_more;
+	_Atomic uint64_t max_duration_ns;
+	_Atomic uint64_t duration_ns_sum;
+	_Atomic uint64_t duration[AUDIO_STATS_DURATION_BUCKETS];
+	_Atomic uint64_t fill[AUDIO_STATS_FILL_BUCKETS];
+} g_stats;
+
+static time_t g_last_report;
+
+static void stats_add(_Atomic uint64_t *counter, uint64_t value)
+{
+	const uint64_t old = atomic_load_explicit(counter, memory_order_relaxed);
+	atomic_store_explicit(counter, old + value, memory_order_relaxed);
+}
+
+static size_t duration_bucket(uint64_t duration_ns)
+{
+	size_t bucket = 0;
+	for (uint64_t limit_us = 32; duration_ns/1000 >= limit_us && bucket < AUDIO_STATS_DURATION_BUCKETS-1; limit_us *= 2) {
+		bucket++;
+	}
+	return bucket;
+}
+
+/** Upper limit of a duration bucket in us, the last one is open. */
+static uint64_t duration_bucket_limit_us(size_t bucket)
+{
+	return 32ull << bucket;
+}
+
+void audio_stats_record_callback(size_t requested, size_t delivered, uint64_t duration_ns, int fill_percent)
+{
+	stats_add(&g_stats.callbacks, 1);
+	stats_add(&g_stats.bytes_requested, requested);
+	stats_add(&g_stats.bytes_delivered, delivered);
+	if (delivered < requested) stats_add(&g_stats.short_callbacks, 1);
+
+	stats_add(&g_stats.duration[duration_bucket(duration_ns)], 1);
+	stats_add(&g_stats.duration_ns_sum, duration_ns);
+	if (duration_ns > atomic_load_explicit(&g_stats.max_duration_ns, memory_order_relaxed)) {
+		atomic_store_explicit(&g_stats.max_duration_ns, duration_ns, memory_order_relaxed);
+	}
+
+	if (fill_percent >= 0) {
+		stats_add(&g_stats.fill[MIN(fill_percent/10, AUDIO_STATS_FILL_BUCKETS-1)], 1);
+	}
+}
+
+void audio_stats_count_need_more(void)
+{
+	stats_add(&g_stats.need_more, 1);
+}
+
+void audio_stats_get(struct Audio_Stats *stats)
+{
+	stats->callbacks       = atomic_load(&g_stats.callbacks);
+	stats->bytes_requested = atomic_load(&g_stats.bytes_requested);
+	stats->bytes_delivered = atomic_load(&g_stats.bytes_delivered);
+	stats->short_callbacks = atomic_load(&g_stats.short_callbacks);
+	stats->need_more       = atomic_load(&g_stats.need_more);
+	stats->max_duration_ns = atomic_load(&g_stats.max_duration_ns);
+	stats->duration_ns_sum = atomic_load(&g_stats.duration_ns_sum);
+
+	for (size_t i = 0; i < AUDIO_STATS_DURATION_BUCKETS; ++i) {
+		stats->duration[i] = atomic_load(&g_stats.duration[i]);
+	}
+	for (size_t i = 0; i < AUDIO_STATS_FILL_BUCKETS; ++i) {
+		stats->fill[i] = atomic_load(&g_stats.fill[i]);
+	}
+}
+
+static size_t percentile_bucket(const uint64_t *buckets, size_t count, int percent)
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < count; ++i) total += buckets[i];
+
+	const uint64_t wanted = (total*(uint64_t)percent + 99) / 100;
+	uint64_t seen = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		seen += buckets[i];
+		if (seen >= wanted && seen > 0) return i;
+	}
+	return 0;
+}
+
+static void audio_stats_write_file(const struct Audio_Stats *stats, int underruns)
+{
+	char dir[PATH_MAX];
+	Result r = config_get_cache_path("audio", dir, sizeof(dir));
+	if (!r.success) {
+		log_warning("audio stats: %s\n", r.msg);
+		return;
+	}
+
+	char path[PATH_MAX+16];
+	char tmp_path[PATH_MAX+16];
+	snprintf(path, sizeof(path), "%s/%s", dir, AUDIO_STATS_FILE);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	FILE *file = fopen(tmp_path, "w");
+	if (file == NULL) {
+		log_warning("audio stats: unable to write %s\n", tmp_path);
+		return;
+	}
+
+	fprintf(file, "time %lld\n", (long long) time(NULL));
+	fprintf(file, "callbacks %llu\n", (unsigned long long) stats->callbacks);
+	fprintf(file, "bytes_requested %llu\n", (unsigned long long) stats->bytes_requested);
+	fprintf(file, "bytes_delivered %llu\n", (unsigned long long) stats->bytes_delivered);
+	fprintf(file, "short_callbacks %llu\n", (unsigned long long) stats->short_callbacks);
+	fprintf(file, "need_more %llu\n", (unsigned long long) stats->need_more);
+	fprintf(file, "underruns %d\n", underruns);
+	fprintf(file, "max_duration_us %llu\n", (unsigned long long)(stats->max_duration_ns/1000));
+
+	for (size_t i = 0; i < AUDIO_STATS_DURATION_BUCKETS; ++i) {
+		fprintf(file, "duration_below_us %llu %llu\n",
+			(unsigned long long) duration_bucket_limit_us(i), (unsigned long long) stats->duration[i]);
+	}
+	for (size_t i = 0; i < AUDIO_STATS_FILL_BUCKETS; ++i) {
+		fprintf(file, "fill_percent %zu %llu\n", i*10, (unsigned long long) stats->fill[i]);
+	}
+
+	// replaced at once, readers never see half a file
+	if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+		log_warning("audio stats: unable to replace %s\n", path);
+	}
+}
+
+void audio_stats_report_if_due(void)
+{
+	if (g_config.audio_stats_interval_secs <= 0) return;
+
+	const time_t now = time(NULL);
+	if (now - g_last_report < g_config.audio_stats_interval_secs) return;
+	g_last_report = now;
+
+	struct Audio_Stats stats;
+	audio_stats_get(&stats);
+
+	struct Audio_Buffer_Health health;
+	audio_get_buffer_health(&health);
+
+	const double delivered_percent = (stats.bytes_requested > 0)
+		? (double) stats.bytes_delivered * 100.0 / (double) stats.bytes_requested : 100.0;
+
+	log_info("audio stats: %llu callbacks, %.1f%% delivered, %llu short, %llu need-more, %d underruns, "
+		"callback p50 <%lluus p99 <%lluus max %lluus, fill p50 %zu%%\n",
+		(unsigned long long) stats.callbacks, delivered_percent,
+		(unsigned long long) stats.short_callbacks, (unsigned long long) stats.need_more, health.underruns,
+		(unsigned long long) duration_bucket_limit_us(percentile_bucket(stats.duration, AUDIO_STATS_DURATION_BUCKETS, 50)),
+		(unsigned long long) duration_bucket_limit_us(percentile_bucket(stats.duration, AUDIO_STATS_DURATION_BUCKETS, 99)),
+		(unsigned long long)(stats.max_duration_ns/1000),
+		percentile_bucket(stats.fill, AUDIO_STATS_FILL_BUCKETS, 50)*10);
+
+	audio_stats_write_file(&stats, health.underruns);
+}
@@ -0,0 +1,38 @@
+#ifndef AUDIO_STATS_H
+#define AUDIO_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AUDIO_STATS_DURATION_BUCKETS  12   // powers of two from 32 us up
+#define AUDIO_STATS_FILL_BUCKETS      11   // tens of percent
+
+/**
+ * Counters and histograms of the audio callback, recorded by the audio
+ * thread without locks and read as a snapshot. Counters run since start,
+ * so rates are the difference of two reports.
+ */
+struct Audio_Stats {
+	uint64_t callbacks;
+	uint64_t bytes_requested;
+	uint64_t bytes_delivered;
+	uint64_t short_callbacks;         // delivered less than requested
+	uint64_t need_more;               // MPG123_NEED_MORE from the decoder
+	uint64_t max_duration_ns;
+	uint64_t duration_ns_sum;
+	uint64_t duration[AUDIO_STATS_DURATION_BUCKETS];
+	uint64_t fill[AUDIO_STATS_FILL_BUCKETS];   // jitterbuffer fill at callback start
+};
+
+/** fill_percent is negative if there is no stream buffer, like for files. */
+void audio_stats_record_callback(size_t requested, size_t delivered, uint64_t duration_ns, int fill_percent);
+void audio_stats_count_need_more(void);
+void audio_stats_get(struct Audio_Stats *stats);
+
+/**
+ * Logs a summary line and rewrites <cache_dir>/audio/stats.txt every
+ * audio_stats_interval_secs. Called from the main loop.
+ */
+void audio_stats_report_if_due(void);
+
+#endif // AUDIO_STATS_H
@@ -0,0 +1,294 @@
+#define UTIL_STRINGS_IMPLEMENTATION
+#include "libcutils/util_strings.h"
+
+#define RESULT_IMPLEMENTATION
+#include "libcutils/result.h"
+
+#define LOGGER_IMPLEMENTATION
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#include "config.h"
+#include "fixture.h"
+#include "screen.h"
+#include "screensaver.h"
+#include "ui_main.h"
+#include "netcache.h"
+#include "station_prober.h"
+
+#include <linux/limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Render benchmark, renders scripted scenes offscreen with the software
+ * renderer and prints frame time percentiles, draw calls and allocations
+ * per frame. The scenes run on generated radio stations and jukebox files,
+ * the fonts, icons and colors come from the given resources directory.
+ *
+ *   shard-os-bench [resources_dir] [frames_per_scene]
+ */
+
+#define SCREEN_WIDTH  1024
+#define SCREEN_HEIGHT  600
+
+#define BENCH_DEFAULT_FRAMES  300
+#define BENCH_WARMUP_FRAMES    30
+#define BENCH_RADIO_STATIONS  200
+#define BENCH_JUKEBOX_FILES  1000
+
+struct Bench_Scene {
+	const char *name;
+	bool (*open)(struct Screen *screen);
+};
+
+struct Bench_Result {
+	uint64_t frame_ns_p50;
+	uint64_t frame_ns_p90;
+	uint64_t frame_ns_p99;
+	uint64_t frame_ns_max;
+	double   draw_calls;
+	double   texture_uploads;
+	double   text_rasterizations;
+	double   allocations;
+};
+
+// counts every thread, the tagreader and prober threads run alongside
+static _Atomic uint64_t g_allocations = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+static bool open_home(struct Screen *screen)
+{
+	ui_main_close(screen);
+	return true;
+}
+
+static bool open_radio(struct Screen *screen)
+{
+	return ui_main_open_app(screen, "Radio");
+}
+
+static bool open_jukebox(struct Screen *screen)
+{
+	return ui_main_open_app(screen, "Jukebox");
+}
+
+static bool open_dialog(struct Screen *screen)
+{
+	ui_main_close(screen);
+	return ui_main_open_dialog("[AUDIO]");
+}
+
+static const struct Bench_Scene g_scenes[] = {
+	{"home"   , open_home},
+	{"radio"  , open_radio},
+	{"jukebox", open_jukebox},
+	{"dialog" , open_dialog},
+};
+
+/** Known radio stations and jukebox files next to the real fonts and icons. */
+static Result bench_create_fixture(const char *resources_dir, char *fixture_dir, size_t fixture_dir_size)
+{
+	Result r = fixture_create(resources_dir, fixture_dir, fixture_dir_size);
+	if (!r.success) return r;
+
+	// nothing listens on the discard port, the stations are never connected
+	char stations[BENCH_RADIO_STATIONS*64];
+	size_t used = 0;
+	for (int i=0; i < BENCH_RADIO_STATIONS; ++i) {
+		used += (size_t) snprintf(stations+used, sizeof(stations)-used,
+			"Benchmark Station %03d = http://127.0.0.1:9/station-%03d\n", i, i);
+	}
+	r = fixture_write_file(fixture_dir, "data/radiostations.conf", stations, used);
+	if (!r.success) return r;
+
+	for (int i=0; i < BENCH_JUKEBOX_FILES; ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "data/jukebox/Track %04d.mp3", i);
+
+		r = fixture_write_file(fixture_dir, name, "", 0);
+		if (!r.success) return r;
+	}
+	return result_make_success();
+}
+
+static int compare_u64(const void *lhs, const void *rhs)
+{
+	const uint64_t a = *(const uint64_t *) lhs;
+	const uint64_t b = *(const uint64_t *) rhs;
+	return (a > b) - (a < b);
+}
+
+/** Nearest rank on sorted values. */
+static uint64_t percentile(const uint64_t *sorted, size_t count, int percent)
+{
+	size_t rank = (count * (size_t) percent + 99) / 100;
+	if (rank > 0) rank--;
+	return sorted[MIN(rank, count-1)];
+}
+
+static void bench_render_frame(struct Screen *screen)
+{
+	// the screensaver would skip the whole frame
+	screensaver_reset();
+
+	screen_rendering_start(screen);
+	ui_main_render(screen);
+	screen_rendering_stop(screen);
+}
+
+static Result bench_run_scene(struct Screen *screen, const struct Bench_Scene *scene, size_t frames, struct Bench_Result *result)
+{
+	if (!scene->open(screen)) {
+		return result_make(false, "unable to open scene %s", scene->name);
+	}
+
+	// fonts, glyph caches and the first tags are not what we are after
+	for (int i=0; i < BENCH_WARMUP_FRAMES; ++i) {
+		bench_render_frame(screen);
+	}
+
+	uint64_t *frame_ns = calloc(frames, sizeof(frame_ns[0]));
+	if (frame_ns == NULL) {
+		return result_make(false, "unable to allocate %zu frame times", frames);
+	}
+
+	uint64_t draw_calls          = 0;
+	uint64_t texture_uploads     = 0;
+	uint64_t text_rasterizations = 0;
+	const uint64_t allocations_before = atomic_load(&g_allocations);
+
+	for (size_t i=0; i < frames; ++i) {
+		const uint64_t start_ns = SDL_GetTicksNS();
+		bench_render_frame(screen);
+		frame_ns[i] = SDL_GetTicksNS() - start_ns;
+
+		draw_calls          += (uint64_t) screen->last_frame.draw_calls;
+		texture_uploads     += (uint64_t) screen->last_frame.texture_uploads;
+		text_rasterizations += (uint64_t) screen->last_frame.text_rasterizations;
+	}
+
+	const uint64_t allocations = atomic_load(&g_allocations) - allocations_before;
+
+	qsort(frame_ns, frames, sizeof(frame_ns[0]), compare_u64);
+	result->frame_ns_p50        = percentile(frame_ns, frames, 50);
+	result->frame_ns_p90        = percentile(frame_ns, frames, 90);
+	result->frame_ns_p99        = percentile(frame_ns, frames, 99);
+	result->frame_ns_max        = frame_ns[frames-1];
+	result->draw_calls          = (double) draw_calls / (double) frames;
+	result->texture_uploads     = (double) texture_uploads / (double) frames;
+	result->text_rasterizations = (double) text_rasterizations / (double) frames;
+	result->allocations         = (double) allocations / (double) frames;
+
+	free(frame_ns);
+	return result_make_success();
+}
+
+static double ns_to_ms(uint64_t ns)
+{
+	return (double) ns / 1e6;
+}
+
+static int bench_run(const char *fixture_dir, long frames)
+{
+	Result result = config_init(fixture_dir);
+	if (!result.success) {
+		log_error("Failed to load config: %s\n", result.msg);
+		return 1;
+	}
+
+	result = netcache_init();
+	if (!result.success) {
+		log_error("failed to init network: %s\n", result.msg);
+		return 1;
+	}
+
+	struct Screen screen = {.is_headless = true};
+
+	result = screen_init(&screen, SCREEN_WIDTH, SCREEN_HEIGHT);
+	if (!result.success) {
+		log_error("failed to load screen: %s\n", result.msg);
+		netcache_destroy();
+		return 1;
+	}
+
+	// the HUD text changes every frame, it would be measured as well
+	screen.show_perf_hud = false;
+	ui_main_init(&screen);
+
+	printf("%-8s %7s %8s %8s %8s %8s %7s %8s %6s %8s\n",
+		"scene", "frames", "p50 ms", "p90 ms", "p99 ms", "max ms", "draws", "uploads", "texts", "allocs");
+
+	int exit_code = 0;
+	for (size_t i=0; i < ARRAY_SIZE(g_scenes); ++i) {
+		struct Bench_Result scene_result = {0};
+
+		result = bench_run_scene(&screen, &g_scenes[i], (size_t) frames, &scene_result);
+		if (!result.success) {
+			log_error("%s\n", result.msg);
+			exit_code = 1;
+			continue;
+		}
+
+		printf("%-8s %7ld %8.3f %8.3f %8.3f %8.3f %7.1f %8.1f %6.1f %8.1f\n",
+			g_scenes[i].name, frames,
+			ns_to_ms(scene_result.frame_ns_p50), ns_to_ms(scene_result.frame_ns_p90),
+			ns_to_ms(scene_result.frame_ns_p99), ns_to_ms(scene_result.frame_ns_max),
+			scene_result.draw_calls, scene_result.texture_uploads,
+			scene_result.text_rasterizations, scene_result.allocations);
+	}
+
+	ui_main_close(&screen);
+	station_prober_stop();
+	screen_destroy(&screen);
+	netcache_destroy();
+	return exit_code;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *resources_dir = (argc > 1) ? argv[1] : "../resources";
+	const long frames         = (argc > 2) ? strtol(argv[2], NULL, 10) : BENCH_DEFAULT_FRAMES;
+
+	if (frames <= 0) {
+		log_error("invalid frame count: %s\n", argv[2]);
+		return 1;
+	}
+
+	char fixture_dir[PATH_MAX];
+	int exit_code = 1;
+
+	Result result = bench_create_fixture(resources_dir, fixture_dir, sizeof(fixture_dir));
+	if (result.success) {
+		exit_code = bench_run(fixture_dir, frames);
+	}
+	else {
+		log_error("failed to create the benchmark data: %s\n", result.msg);
+	}
+
+	fixture_remove(fixture_dir);
+	return exit_code;
+}
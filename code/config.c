@@ -1,9 +1,13 @@
 #include "config.h"
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #define CONFIG_FILE_IMPLEMENTATION
 #include "libcutils/config_file.h"
+#include "libcutils/util_makros.h"
 
 
 struct Config g_config = {0};
@@ -29,6 +33,51 @@ static Result config_parse_color(struct Config_File *cfg, struct Color *color, c
 	return result_make_success();
 }
 
+static void config_set_cache_dir(struct Config_File *cfg)
+{
+	const char *value = config_file_gets(cfg, "cache_dir");
+
+	if (value != NULL) {
+		strncpy(g_config.cache_dir, value, sizeof(g_config.cache_dir));
+	}
+	else if (getenv("XDG_CACHE_HOME") != NULL) {
+		snprintf(g_config.cache_dir, sizeof(g_config.cache_dir), "%s/shard-os", getenv("XDG_CACHE_HOME"));
+	}
+	else if (getenv("HOME") != NULL) {
+		snprintf(g_config.cache_dir, sizeof(g_config.cache_dir), "%s/.cache/shard-os", getenv("HOME"));
+	}
+	else {
+		strncpy(g_config.cache_dir, "/tmp/shard-os", sizeof(g_config.cache_dir));
+	}
+}
+
+static void config_set_recordings_dir(struct Config_File *cfg)
+{
+	const char *value = config_file_gets(cfg, "radio_recordings_dir");
+
+	if (value != NULL) {
+		strncpy(g_config.recordings_dir, value, sizeof(g_config.recordings_dir));
+	}
+	else if (getenv("HOME") != NULL) {
+		snprintf(g_config.recordings_dir, sizeof(g_config.recordings_dir), "%s/Music/shard-os", getenv("HOME"));
+	}
+	else {
+		snprintf(g_config.recordings_dir, sizeof(g_config.recordings_dir), "%s/recordings", g_config.cache_dir);
+	}
+}
+
+static int config_get_int_or(struct Config_File *cfg, const char *key, int fallback)
+{
+	const char *value = config_file_gets(cfg, key);
+	return (value != NULL) ? atoi(value) : fallback;
+}
+
+static bool config_get_bool_or(struct Config_File *cfg, const char *key, bool fallback)
+{
+	const char *value = config_file_gets(cfg, key);
+	return (value != NULL) ? (strcmp(value, "true") == 0) : fallback;
+}
+
 Result config_load_colorscheme(const char *filepath)
 {
 	struct Config_File cfg = {0};
@@ -78,8 +127,61 @@ Result config_init(const char *resources_path)
 		g_config.screen_hide_cursor = false;
 	}
 
+	g_config.screen_perf_hud = config_get_bool_or(&cfg, "screen_perf_hud", false);
+
 	strncpy(g_config.audio_device_name, config_file_gets(&cfg, "audio_device_name"), sizeof(g_config.audio_device_name));
 	g_config.screensaver_delay_min = config_file_geti(&cfg, "screensaver_delay_minutes");
+	g_config.audio_stats_interval_secs = MAX(0, config_get_int_or(&cfg, "audio_stats_interval_seconds", 0));
+	config_set_cache_dir(&cfg);
+	config_set_recordings_dir(&cfg);
+
+	g_config.radio_prefetch           = config_get_bool_or(&cfg, "radio_prefetch", false);
+	g_config.radio_prefetch_buffer_kb = MAX(16, config_get_int_or(&cfg, "radio_prefetch_buffer_kb", 256));
+	g_config.radio_prefetch_rate_kbps = MAX(8 , config_get_int_or(&cfg, "radio_prefetch_rate_kbps", 256));
+	g_config.radio_probe              = config_get_bool_or(&cfg, "radio_probe", true);
+	g_config.radio_probe_ttl_min      = MAX(0 , config_get_int_or(&cfg, "radio_probe_ttl_minutes", 60));
+	g_config.radio_timeshift_min      = MAX(0 , config_get_int_or(&cfg, "radio_timeshift_minutes", 0));
+	g_config.radio_relay_port         = MAX(0 , config_get_int_or(&cfg, "radio_relay_port", 0));
+
+	const char *metrics_socket = config_file_gets(&cfg, "metrics_socket");
+	snprintf(g_config.metrics_socket, sizeof(g_config.metrics_socket), "%s", (metrics_socket != NULL) ? metrics_socket : "");
+	g_config.metrics_port = MAX(0, config_get_int_or(&cfg, "metrics_port", 0));
+	g_config.watchdog_stall_ms = MAX(0, config_get_int_or(&cfg, "watchdog_stall_ms", 1000));
+
+	g_config.hooks_timeout_secs          = MAX(1, config_get_int_or(&cfg, "hooks_timeout_seconds", 10));
+	g_config.hook_on_audio_open_barrier  = config_get_bool_or(&cfg, "hook_on_audio_open_barrier", false);
+	g_config.hook_on_audio_close_barrier = config_get_bool_or(&cfg, "hook_on_audio_close_barrier", false);
 	g_config.volume = 100;
 	return result_make_success();
 }
+
+/** Creates every missing directory of path, like mkdir -p. */
+static Result config_create_dirs(char *path)
+{
+	for (char *p = strchr(path+1, '/'); ; p = strchr(p+1, '/')) {
+		if (p != NULL) *p = '\0';
+
+		if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+			Result r = result_make(false, "unable to create %s: %s", path, strerror(errno));
+			if (p != NULL) *p = '/';
+			return r;
+		}
+
+		if (p == NULL) break;
+		*p = '/';
+	}
+
+	return result_make_success();
+}
+
+Result config_get_cache_path(const char *name, char *path, size_t path_size)
+{
+	snprintf(path, path_size, "%s/%s", g_config.cache_dir, name);
+	return config_create_dirs(path);
+}
+
+Result config_get_recordings_path(char *path, size_t path_size)
+{
+	snprintf(path, path_size, "%s", g_config.recordings_dir);
+	return config_create_dirs(path);
+}
@@ -1,6 +1,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 #include "libcutils/result.h"
 
 struct Color {
@@ -17,9 +19,12 @@ struct Config {
 	int screen_font_size_s;
 	int screen_font_size_xs;
 	bool screen_hide_cursor;
+	bool screen_perf_hud;
 
 	char resources_dir[255];
 	char font_file[255];
+	char cache_dir[255];
+	char recordings_dir[255];
 
 	struct Color screen_color_primary;
 	struct Color screen_color_highlight;
@@ -28,10 +33,38 @@ struct Config {
 	char audio_device_name[255];
 	int volume;
 	int screensaver_delay_min;
+	int audio_stats_interval_secs;
+
+	bool radio_prefetch;
+	int radio_prefetch_buffer_kb;
+	int radio_prefetch_rate_kbps;
+
+	bool radio_probe;
+	int radio_probe_ttl_min;
+
+	int radio_timeshift_min;
+	int radio_relay_port;
+
+	char metrics_socket[255];
+	int metrics_port;
+	int watchdog_stall_ms;
+
+	int hooks_timeout_secs;
+	bool hook_on_audio_open_barrier;
+	bool hook_on_audio_close_barrier;
 };
 
 extern struct Config g_config;
 
 Result config_init(const char *resources_path);
 
+/**
+ * Returns the directory <cache_dir>/<name> in path and creates it if it does
+ * not exist yet.
+ */
+Result config_get_cache_path(const char *name, char *path, size_t path_size);
+
+/** Returns radio_recordings_dir in path and creates it if necessary. */
+Result config_get_recordings_path(char *path, size_t path_size);
+
 #endif//  CONFIG_H
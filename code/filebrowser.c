@@ -11,14 +11,27 @@
 
 #define ENABLE_FILEBROWSER_DEBUG_LOG 0
 
+#define FILEBROWSER_INITIAL_CAPACITY 64
+
 static void filebrowser_append_node(struct Filebrowser *fb, const char *name, enum Node_Type type)
 {
-	if (fb->node_count < ARRAY_SIZE(fb->nodes)) {
-		struct Node *ptr = &fb->nodes[fb->node_count++];
+	if (fb->node_count >= fb->node_capacity) {
+		const size_t new_capacity = MAX(FILEBROWSER_INITIAL_CAPACITY, fb->node_capacity*2);
+		struct Node *new_nodes = realloc(fb->nodes, new_capacity*sizeof(fb->nodes[0]));
 
-		strncpy(ptr->name, name, sizeof(ptr->name));
-		ptr->type = type;
+		if (new_nodes == NULL) {
+			log_error("unable to grow filebrowser to %zu entries\n", new_capacity);
+			return;
+		}
+		fb->nodes         = new_nodes;
+		fb->node_capacity = new_capacity;
 	}
+
+	struct Node *ptr = &fb->nodes[fb->node_count++];
+
+	snprintf(ptr->name, sizeof(ptr->name), "%s", name);
+	ptr->label[0] = '\0';
+	ptr->type = type;
 }
 
 static int filebrowser_sort_nodes(const void *lhs, const void *rhs)
@@ -9,15 +9,17 @@ enum Node_Type {
 };
 
 struct Node {
-	char name[1024];
+	char name[256];
+	char label[128]; // human readable name, e.g. from id3 tags, empty if unknown
 	enum Node_Type type;
 };
 
 struct Filebrowser {
 	char root_path[2048];
 	char sub_path[2048];
-	struct Node nodes[40];
+	struct Node *nodes; // grows with the directory size
 	size_t node_count;
+	size_t node_capacity;
 };
 
 void filebrowser_init(struct Filebrowser *fb, const char *root_path);
@@ -0,0 +1,137 @@
+#include "fixture.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <linux/limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libcutils/util_makros.h"
+
+// cache_dir and radio_recordings_dir take the fixture directory
+#define FIXTURE_CONFIG \
+	"audio_device_name = \"default\"\n" \
+	"\n" \
+	"screen_hide_cursor  = false\n" \
+	"screen_colorscheme  = \"colorschemes/cyberpunk.conf\"\n" \
+	"screen_font_file    = \"fonts/orbitron/Orbitron Medium.ttf\"\n" \
+	"screen_font_size_xl = 54\n" \
+	"screen_font_size_l  = 36\n" \
+	"screen_font_size_m  = 24\n" \
+	"screen_font_size_s  = 18\n" \
+	"screen_font_size_xs = 16\n" \
+	"screen_perf_hud     = false\n" \
+	"\n" \
+	"screensaver_delay_minutes    = 5\n" \
+	"audio_stats_interval_seconds = 0\n" \
+	"\n" \
+	"cache_dir            = \"%s/cache\"\n" \
+	"radio_recordings_dir = \"%s/recordings\"\n" \
+	"\n" \
+	"radio_prefetch          = false\n" \
+	"radio_probe             = false\n" \
+	"radio_timeshift_minutes = 0\n" \
+	"radio_relay_port        = 0\n" \
+	"metrics_port            = 0\n" \
+	"watchdog_stall_ms       = 0\n"
+
+static const char *const g_fixture_linked[] = {"colorschemes", "fonts", "icons"};
+
+
+static Result fixture_link_resource(const char *resources_dir, const char *fixture_dir, const char *name)
+{
+	char target[PATH_MAX];
+	char link_path[PATH_MAX];
+
+	if (realpath(resources_dir, target) == NULL) {
+		return result_make(false, "unable to resolve %s", resources_dir);
+	}
+	snprintf(target+strlen(target), sizeof(target)-strlen(target), "/%s", name);
+	snprintf(link_path, sizeof(link_path), "%s/%s", fixture_dir, name);
+
+	if (symlink(target, link_path) != 0) {
+		return result_make(false, "unable to link %s", link_path);
+	}
+	return result_make_success();
+}
+
+Result fixture_create(const char *resources_dir, char *fixture_dir, size_t fixture_dir_size)
+{
+	snprintf(fixture_dir, fixture_dir_size, "/tmp/shard-os-fixture-XXXXXX");
+	if (mkdtemp(fixture_dir) == NULL) {
+		return result_make(false, "unable to create %s", fixture_dir);
+	}
+
+	for (size_t i=0; i < ARRAY_SIZE(g_fixture_linked); ++i) {
+		Result r = fixture_link_resource(resources_dir, fixture_dir, g_fixture_linked[i]);
+		if (!r.success) return r;
+	}
+
+	char config[sizeof(FIXTURE_CONFIG) + 2*PATH_MAX];
+	const int size = snprintf(config, sizeof(config), FIXTURE_CONFIG, fixture_dir, fixture_dir);
+
+	return fixture_write_file(fixture_dir, "shard-os.conf", config, (size_t) size);
+}
+
+Result fixture_write_file(const char *fixture_dir, const char *name, const void *data, size_t size)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", fixture_dir, name);
+
+	// every directory below the fixture, like mkdir -p
+	for (char *p = strchr(path+strlen(fixture_dir)+1, '/'); p != NULL; p = strchr(p+1, '/')) {
+		*p = '\0';
+		const bool is_created = (mkdir(path, 0700) == 0 || errno == EEXIST);
+		*p = '/';
+
+		if (!is_created) return result_make(false, "unable to create the directory of %s", path);
+	}
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return result_make(false, "unable to write %s", path);
+	}
+
+	const bool is_written = (fwrite(data, 1, size, file) == size);
+	if (fclose(file) != 0 || !is_written) {
+		return result_make(false, "unable to write %s", path);
+	}
+	return result_make_success();
+}
+
+static void fixture_remove_path(const char *path)
+{
+	struct stat st;
+	if (lstat(path, &st) != 0) return;
+
+	if (!S_ISDIR(st.st_mode)) {
+		unlink(path);
+		return;
+	}
+
+	DIR *dir = opendir(path);
+	if (dir != NULL) {
+		struct dirent *ent = NULL;
+		while ((ent = readdir(dir)) != NULL) {
+			if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+
+			char child[PATH_MAX];
+			snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+			fixture_remove_path(child);
+		}
+		closedir(dir);
+	}
+	rmdir(path);
+}
+
+void fixture_remove(const char *fixture_dir)
+{
+	// only what mkdtemp() created, never a path handed in by mistake
+	if (strncmp(fixture_dir, "/tmp/shard-os-fixture-", strlen("/tmp/shard-os-fixture-")) != 0) return;
+
+	fixture_remove_path(fixture_dir);
+}
@@ -0,0 +1,23 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <stddef.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Temporary resources directory for the benchmark and the tests. The fonts,
+ * icons and colorschemes are linked from the real resources directory, the
+ * config is written by the fixture. It keeps the cache and the recordings
+ * inside the fixture, runs no hooks, probes no stations and listens on no
+ * port, so a run never touches the data of the installed box.
+ */
+Result fixture_create(const char *resources_dir, char *fixture_dir, size_t fixture_dir_size);
+
+/** Writes a file relative to the fixture, creating its directories. */
+Result fixture_write_file(const char *fixture_dir, const char *name, const void *data, size_t size);
+
+/** Removes the fixture with everything created in it, links are not followed. */
+void   fixture_remove(const char *fixture_dir);
+
+#endif // FIXTURE_H
@@ -0,0 +1,611 @@
+#include "hls.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+#include <SDL3/SDL.h>
+
+#include "mpegts.h"
+#include "netcache.h"
+#include "playlist.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define HLS_MAX_PARALLEL_SEGMENTS  3
+#define HLS_LIVE_START_SEGMENTS    3
+#define HLS_MAX_SEGMENT_SIZE       (16*1024*1024)
+#define HLS_MAX_PLAYLIST_SIZE      (1024*1024)
+#define HLS_MAX_SEGMENT_RETRIES    2
+#define HLS_MAX_REFRESH_FAILURES   5
+#define HLS_DEFAULT_TARGET_MS      6000
+#define HLS_POLL_TIMEOUT_MS        50
+
+struct Hls_Segment {
+	uint64_t sequence;
+	char *url;
+	bool is_discontinuity;
+};
+
+struct Hls_Playlist {
+	char url[PLAYLIST_MAX_URL_LEN];
+	struct Hls_Segment *segments;
+	size_t count;
+	size_t capacity;
+	int target_duration_ms;
+	bool is_endlist;
+};
+
+struct Hls_Buffer {
+	uint8_t *data;
+	size_t used;
+	size_t capacity;
+	size_t max_size;
+};
+
+struct Hls_Transfer {
+	CURL *curl;           // NULL if not running
+	uint64_t sequence;
+	bool is_discontinuity;
+	bool is_done;         // finished but not delivered yet
+	bool is_failed;
+	int retries;
+	struct Hls_Buffer buffer;
+};
+
+struct Hls_Player {
+	const struct Hls_Sink *sink;
+	CURLM *multi;
+	struct Hls_Playlist playlist;
+	struct Hls_Transfer segments[HLS_MAX_PARALLEL_SEGMENTS];
+	struct Hls_Transfer refresh;
+	struct Mpegts_Demuxer ts;
+
+	uint64_t next_fetch;
+	uint64_t next_deliver;
+	uint64_t next_refresh_ms;
+	int refresh_failures;
+	enum Hls_Status status;
+	bool is_finished;
+};
+
+static bool starts_with(const char *line, size_t len, const char *prefix)
+{
+	const size_t prefix_len = strlen(prefix);
+	return len >= prefix_len && strncmp(line, prefix, prefix_len) == 0;
+}
+
+static void hls_playlist_clear(struct Hls_Playlist *playlist)
+{
+	for (size_t i=0; i < playlist->count; ++i) {
+		free(playlist->segments[i].url);
+	}
+	playlist->count = 0;
+}
+
+static void hls_playlist_free(struct Hls_Playlist *playlist)
+{
+	hls_playlist_clear(playlist);
+	free(playlist->segments);
+	playlist->segments = NULL;
+	playlist->capacity = 0;
+}
+
+static bool hls_playlist_append(struct Hls_Playlist *playlist, uint64_t sequence, const char *line, size_t len, bool is_discontinuity)
+{
+	char ref[PLAYLIST_MAX_URL_LEN];
+	char url[PLAYLIST_MAX_URL_LEN];
+
+	if (len >= sizeof(ref)) return false;
+	memcpy(ref, line, len);
+	ref[len] = '\0';
+
+	if (!playlist_resolve_url(playlist->url, ref, url, sizeof(url))) return false;
+
+	if (playlist->count >= playlist->capacity) {
+		const size_t new_capacity = MAX(playlist->capacity*2, (size_t)16);
+
+		struct Hls_Segment *segments = realloc(playlist->segments, new_capacity*sizeof(segments[0]));
+		if (segments == NULL) return false;
+
+		playlist->segments = segments;
+		playlist->capacity = new_capacity;
+	}
+
+	char *copy = strdup(url);
+	if (copy == NULL) return false;
+
+	playlist->segments[playlist->count++] = (struct Hls_Segment) {
+		.sequence         = sequence,
+		.url              = copy,
+		.is_discontinuity = is_discontinuity,
+	};
+	return true;
+}
+
+static enum Hls_Status hls_parse_media_playlist(struct Hls_Playlist *playlist, const char *text)
+{
+	hls_playlist_clear(playlist);
+	playlist->target_duration_ms = HLS_DEFAULT_TARGET_MS;
+	playlist->is_endlist         = false;
+
+	uint64_t sequence     = 0;
+	bool is_discontinuity = false;
+
+	const char *line = NULL;
+	size_t len = 0;
+
+	while ((line = playlist_next_line(&text, &len)) != NULL) {
+		if (starts_with(line, len, "#EXT-X-TARGETDURATION:")) {
+			playlist->target_duration_ms = MAX(1, atoi(line+22)) * 1000;
+		}
+		else if (starts_with(line, len, "#EXT-X-MEDIA-SEQUENCE:")) {
+			sequence = strtoull(line+22, NULL, 10);
+		}
+		else if (starts_with(line, len, "#EXT-X-DISCONTINUITY-SEQUENCE")) {
+			continue;
+		}
+		else if (starts_with(line, len, "#EXT-X-DISCONTINUITY")) {
+			is_discontinuity = true;
+		}
+		else if (starts_with(line, len, "#EXT-X-ENDLIST")) {
+			playlist->is_endlist = true;
+		}
+		else if (starts_with(line, len, "#EXT-X-KEY:") && !starts_with(line, len, "#EXT-X-KEY:METHOD=NONE")) {
+			log_error("hls: encrypted segments are not supported\n");
+			return HLS_STATUS_UNSUPPORTED;
+		}
+		else if (len > 0 && line[0] != '#') {
+			if (!hls_playlist_append(playlist, sequence, line, len, is_discontinuity)) {
+				log_error("hls: unable to add segment %llu\n", (unsigned long long) sequence);
+				return HLS_STATUS_FAILED;
+			}
+			++sequence;
+			is_discontinuity = false;
+		}
+	}
+	return HLS_STATUS_ENDED;
+}
+
+static const struct Hls_Segment *hls_find_segment(const struct Hls_Playlist *playlist, uint64_t sequence)
+{
+	if (playlist->count == 0) return NULL;
+
+	const uint64_t first = playlist->segments[0].sequence;
+	if (sequence < first || sequence - first >= playlist->count) return NULL;
+
+	return &playlist->segments[sequence - first];
+}
+
+static size_t hls_buffer_write_callback(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	struct Hls_Buffer *buffer = userdata;
+	const size_t bytes_total  = size * nmemb;
+
+	// one spare byte to terminate playlists
+	if (buffer->used + bytes_total + 1 > buffer->capacity) {
+		size_t new_capacity = MAX(buffer->capacity*2, (size_t)64*1024);
+		while (new_capacity < buffer->used + bytes_total + 1) new_capacity *= 2;
+
+		if (new_capacity > buffer->max_size) return CURL_WRITEFUNC_ERROR;
+
+		uint8_t *data = realloc(buffer->data, new_capacity);
+		if (data == NULL) return CURL_WRITEFUNC_ERROR;
+
+		buffer->data     = data;
+		buffer->capacity = new_capacity;
+	}
+
+	memcpy(buffer->data+buffer->used, ptr, bytes_total);
+	buffer->used += bytes_total;
+	buffer->data[buffer->used] = '\0';
+	return bytes_total;
+}
+
+static int hls_progress_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	UNUSED(dltotal);
+	UNUSED(dlnow);
+	UNUSED(ultotal);
+	UNUSED(ulnow);
+
+	const struct Hls_Sink *sink = userdata;
+	return sink->should_quit(sink->userdata) ? 1 : 0;
+}
+
+static CURL *hls_create_transfer(struct Hls_Player *player, struct Hls_Transfer *transfer, const char *url, size_t max_size)
+{
+	CURL *curl = netcache_acquire();
+	if (curl == NULL) return NULL;
+
+	transfer->buffer.used     = 0;
+	transfer->buffer.max_size = max_size;
+	transfer->is_done         = false;
+	transfer->is_failed       = false;
+
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, hls_buffer_write_callback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->buffer);
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, hls_progress_callback);
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void*) player->sink);
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "DuckAI/1.0");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L);
+	return curl;
+}
+
+static bool hls_start_transfer(struct Hls_Player *player, struct Hls_Transfer *transfer, const char *url, size_t max_size)
+{
+	CURL *curl = hls_create_transfer(player, transfer, url, max_size);
+	if (curl == NULL) return false;
+
+	if (curl_multi_add_handle(player->multi, curl) != CURLM_OK) {
+		netcache_release(curl);
+		return false;
+	}
+	transfer->curl = curl;
+	return true;
+}
+
+static void hls_stop_transfer(struct Hls_Player *player, struct Hls_Transfer *transfer)
+{
+	if (transfer->curl == NULL) return;
+
+	curl_multi_remove_handle(player->multi, transfer->curl);
+	netcache_release(transfer->curl);
+	transfer->curl = NULL;
+}
+
+/**
+ * Blocking download, only used for the variant of a master playlist before
+ * anything else is running.
+ */
+static bool hls_fetch_playlist(struct Hls_Player *player, const char *url)
+{
+	CURL *curl = hls_create_transfer(player, &player->refresh, url, HLS_MAX_PLAYLIST_SIZE);
+	if (curl == NULL) return false;
+
+	const CURLcode res = curl_easy_perform(curl);
+	netcache_release(curl);
+
+	if (res != CURLE_OK) {
+		log_error("hls: unable to load %s: %s\n", url, curl_easy_strerror(res));
+		return false;
+	}
+	return player->refresh.buffer.used > 0;
+}
+
+/**
+ * A master playlist lists the same stream in different qualities, the
+ * first variant is the one the broadcaster recommends.
+ */
+static bool hls_get_variant(const char *text, const char *base_url, char *url, size_t url_size)
+{
+	const char *line = NULL;
+	size_t len = 0;
+	bool is_variant_next = false;
+
+	while ((line = playlist_next_line(&text, &len)) != NULL) {
+		if (starts_with(line, len, "#EXT-X-STREAM-INF:")) {
+			is_variant_next = true;
+		}
+		else if (is_variant_next && len > 0 && line[0] != '#') {
+			char ref[PLAYLIST_MAX_URL_LEN];
+			if (len >= sizeof(ref)) return false;
+
+			memcpy(ref, line, len);
+			ref[len] = '\0';
+			return playlist_resolve_url(base_url, ref, url, url_size);
+		}
+	}
+	return false;
+}
+
+static enum Hls_Status hls_load(struct Hls_Player *player, const char *url, const char *text)
+{
+	snprintf(player->playlist.url, sizeof(player->playlist.url), "%s", url);
+
+	if (strstr(text, "#EXT-X-STREAM-INF:") != NULL) {
+		char variant_url[PLAYLIST_MAX_URL_LEN];
+
+		if (!hls_get_variant(text, url, variant_url, sizeof(variant_url))) {
+			log_error("hls: no variant in %s\n", url);
+			return HLS_STATUS_FAILED;
+		}
+		log_info("hls: playing variant %s\n", variant_url);
+
+		if (!hls_fetch_playlist(player, variant_url)) return HLS_STATUS_FAILED;
+
+		snprintf(player->playlist.url, sizeof(player->playlist.url), "%s", variant_url);
+		text = (const char*) player->refresh.buffer.data;
+	}
+
+	const enum Hls_Status status = hls_parse_media_playlist(&player->playlist, text);
+	if (status != HLS_STATUS_ENDED) return status;
+
+	if (player->playlist.count == 0 && player->playlist.is_endlist) {
+		log_error("hls: empty playlist %s\n", player->playlist.url);
+		return HLS_STATUS_FAILED;
+	}
+
+	// live streams start close to their end, but with segments to spare
+	const struct Hls_Playlist *playlist = &player->playlist;
+	const uint64_t first = (playlist->count > 0) ? playlist->segments[0].sequence : 0;
+	const size_t   skip  = (!playlist->is_endlist && playlist->count > HLS_LIVE_START_SEGMENTS)
+	                     ? playlist->count - HLS_LIVE_START_SEGMENTS : 0;
+
+	player->next_fetch      = first + skip;
+	player->next_deliver    = player->next_fetch;
+	player->next_refresh_ms = SDL_GetTicks() + (uint64_t) playlist->target_duration_ms;
+
+	log_info("hls: %zu segments of %d s, starting at %llu%s\n", playlist->count,
+		playlist->target_duration_ms/1000, (unsigned long long) player->next_fetch,
+		playlist->is_endlist ? "" : " (live)");
+	return HLS_STATUS_ENDED;
+}
+
+static void hls_start_segments(struct Hls_Player *player)
+{
+	for (size_t i=0; i < ARRAY_SIZE(player->segments); ++i) {
+		struct Hls_Transfer *transfer = &player->segments[i];
+		if (transfer->curl != NULL || transfer->is_done) continue;
+
+		const struct Hls_Segment *segment = hls_find_segment(&player->playlist, player->next_fetch);
+		if (segment == NULL) return;
+
+		if (!hls_start_transfer(player, transfer, segment->url, HLS_MAX_SEGMENT_SIZE)) return;
+
+		transfer->sequence         = segment->sequence;
+		transfer->is_discontinuity = segment->is_discontinuity;
+		transfer->retries          = 0;
+		++player->next_fetch;
+	}
+}
+
+static void hls_finish_refresh(struct Hls_Player *player, bool is_ok)
+{
+	struct Hls_Playlist *playlist = &player->playlist;
+	const uint64_t now = SDL_GetTicks();
+
+	const uint64_t last_before = (playlist->count > 0) ? playlist->segments[playlist->count-1].sequence : 0;
+
+	if (is_ok) {
+		const enum Hls_Status status = hls_parse_media_playlist(playlist, (const char*) player->refresh.buffer.data);
+		if (status == HLS_STATUS_UNSUPPORTED) {
+			player->status      = status;
+			player->is_finished = true;
+			return;
+		}
+		is_ok = (status == HLS_STATUS_ENDED);
+	}
+
+	if (!is_ok) {
+		player->refresh_failures++;
+		player->next_refresh_ms = now + (uint64_t) playlist->target_duration_ms/2;
+		log_warning("hls: playlist refresh failed (%d)\n", player->refresh_failures);
+		return;
+	}
+	player->refresh_failures = 0;
+
+	if (playlist->count == 0) {
+		player->next_refresh_ms = now + (uint64_t) playlist->target_duration_ms/2;
+		return;
+	}
+
+	const uint64_t first = playlist->segments[0].sequence;
+	const uint64_t last  = playlist->segments[playlist->count-1].sequence;
+
+	// fell behind the live window, the missing segments are skipped
+	if (player->next_fetch < first) {
+		log_warning("hls: fell behind the live window, jumping to %llu\n", (unsigned long long) first);
+		player->next_fetch = first;
+	}
+
+	// the sequence started over, nothing fetched so far belongs to it
+	if (player->next_fetch > last + 1 + playlist->count) {
+		log_warning("hls: media sequence restarted at %llu\n", (unsigned long long) first);
+
+		for (size_t i=0; i < ARRAY_SIZE(player->segments); ++i) {
+			hls_stop_transfer(player, &player->segments[i]);
+			player->segments[i].is_done = false;
+		}
+		player->sink->discontinuity(player->sink->userdata);
+		player->next_fetch   = first;
+		player->next_deliver = first;
+	}
+
+	// an unchanged playlist is checked again after half the target duration
+	const uint64_t delay_ms = (uint64_t) playlist->target_duration_ms / ((last > last_before) ? 1 : 2);
+	player->next_refresh_ms = now + delay_ms;
+}
+
+static void hls_handle_done(struct Hls_Player *player, CURL *curl, CURLcode result)
+{
+	struct Hls_Transfer *transfer = NULL;
+	curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**) &transfer);
+
+	hls_stop_transfer(player, transfer);
+
+	if (transfer == &player->refresh) {
+		hls_finish_refresh(player, result == CURLE_OK);
+		return;
+	}
+
+	if (result == CURLE_OK) {
+		transfer->is_done = true;
+		return;
+	}
+
+	const struct Hls_Segment *segment = hls_find_segment(&player->playlist, transfer->sequence);
+	log_warning("hls: segment %llu failed: %s\n", (unsigned long long) transfer->sequence, curl_easy_strerror(result));
+
+	if (segment != NULL && transfer->retries < HLS_MAX_SEGMENT_RETRIES &&
+	    hls_start_transfer(player, transfer, segment->url, HLS_MAX_SEGMENT_SIZE)) {
+		transfer->retries++;
+		return;
+	}
+
+	transfer->is_done   = true;
+	transfer->is_failed = true;
+}
+
+static size_t hls_get_id3_size(const uint8_t *data, size_t size)
+{
+	if (size < 10 || memcmp(data, "ID3", 3) != 0) return 0;
+
+	const size_t tag_size = ((size_t)(data[6] & 0x7F) << 21) | ((size_t)(data[7] & 0x7F) << 14) |
+	                        ((size_t)(data[8] & 0x7F) << 7)  |  (size_t)(data[9] & 0x7F);
+	const size_t footer   = (data[5] & 0x10) ? 10 : 0;
+
+	return MIN(size, 10 + tag_size + footer);
+}
+
+static bool hls_push_segment(struct Hls_Player *player, struct Hls_Transfer *transfer)
+{
+	uint8_t *data = transfer->buffer.data;
+	size_t   size = transfer->buffer.used;
+
+	if (mpegts_detect(data, size)) {
+		size = mpegts_demux(&player->ts, data, size);
+
+		if (mpegts_is_unsupported(&player->ts)) {
+			log_error("hls: stream type 0x%02x is not supported, only MPEG audio\n", player->ts.stream_type);
+			player->status = HLS_STATUS_UNSUPPORTED;
+			return false;
+		}
+	}
+	else {
+		// packed audio segments start with an id3 tag holding the timestamp
+		const size_t id3_size = hls_get_id3_size(data, size);
+		data += id3_size;
+		size -= id3_size;
+
+		if (size >= 2 && data[0] == 0xFF && (data[1] & 0xF6) == 0xF0) {
+			log_error("hls: AAC segments are not supported, only MPEG audio\n");
+			player->status = HLS_STATUS_UNSUPPORTED;
+			return false;
+		}
+	}
+
+	if (transfer->is_discontinuity) player->sink->discontinuity(player->sink->userdata);
+
+	if (!player->sink->push(player->sink->userdata, data, size)) {
+		player->status = HLS_STATUS_STOPPED;
+		return false;
+	}
+	return true;
+}
+
+static struct Hls_Transfer *hls_find_transfer(struct Hls_Player *player, uint64_t sequence)
+{
+	for (size_t i=0; i < ARRAY_SIZE(player->segments); ++i) {
+		struct Hls_Transfer *transfer = &player->segments[i];
+		if ((transfer->curl != NULL || transfer->is_done) && transfer->sequence == sequence) return transfer;
+	}
+	return NULL;
+}
+
+/**
+ * Segments finish in any order, but are handed to the sink in sequence.
+ */
+static void hls_deliver_segments(struct Hls_Player *player)
+{
+	while (!player->is_finished) {
+		struct Hls_Transfer *transfer = hls_find_transfer(player, player->next_deliver);
+
+		if (transfer == NULL) {
+			// skipped after falling behind the live window
+			if (player->next_deliver >= player->next_fetch) return;
+
+			player->sink->discontinuity(player->sink->userdata);
+			++player->next_deliver;
+			continue;
+		}
+		if (!transfer->is_done) return;
+
+		if (transfer->is_failed) {
+			player->sink->discontinuity(player->sink->userdata);
+		}
+		else if (!hls_push_segment(player, transfer)) {
+			player->is_finished = true;
+			return;
+		}
+
+		transfer->is_done = false;
+		++player->next_deliver;
+	}
+}
+
+enum Hls_Status hls_play(const char *url, const char *text, const struct Hls_Sink *sink)
+{
+	struct Hls_Player player = {0};
+	player.sink   = sink;
+	player.status = HLS_STATUS_ENDED;
+	mpegts_reset(&player.ts);
+
+	player.multi = curl_multi_init();
+	if (player.multi == NULL) {
+		log_error("hls: curl multi init failed\n");
+		return HLS_STATUS_FAILED;
+	}
+	curl_multi_setopt(player.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+	player.status = hls_load(&player, url, text);
+	player.is_finished = (player.status != HLS_STATUS_ENDED);
+
+	while (!player.is_finished) {
+		if (sink->should_quit(sink->userdata)) {
+			player.status = HLS_STATUS_STOPPED;
+			break;
+		}
+
+		hls_start_segments(&player);
+
+		if (!player.playlist.is_endlist && player.refresh.curl == NULL && SDL_GetTicks() >= player.next_refresh_ms) {
+			hls_start_transfer(&player, &player.refresh, player.playlist.url, HLS_MAX_PLAYLIST_SIZE);
+		}
+
+		int running = 0;
+		curl_multi_perform(player.multi, &running);
+
+		CURLMsg *msg = NULL;
+		int msgs_left = 0;
+		while ((msg = curl_multi_info_read(player.multi, &msgs_left)) != NULL) {
+			if (msg->msg == CURLMSG_DONE) hls_handle_done(&player, msg->easy_handle, msg->data.result);
+		}
+
+		hls_deliver_segments(&player);
+
+		const struct Hls_Playlist *playlist = &player.playlist;
+		if (playlist->is_endlist && hls_find_segment(playlist, player.next_deliver) == NULL &&
+		    hls_find_transfer(&player, player.next_deliver) == NULL) {
+			log_info("hls: end of playlist\n");
+			break;
+		}
+
+		if (player.refresh_failures >= HLS_MAX_REFRESH_FAILURES) {
+			player.status = HLS_STATUS_FAILED;
+			break;
+		}
+
+		curl_multi_poll(player.multi, NULL, 0, HLS_POLL_TIMEOUT_MS, NULL);
+	}
+
+	for (size_t i=0; i < ARRAY_SIZE(player.segments); ++i) {
+		hls_stop_transfer(&player, &player.segments[i]);
+		free(player.segments[i].buffer.data);
+	}
+	hls_stop_transfer(&player, &player.refresh);
+	free(player.refresh.buffer.data);
+
+	hls_playlist_free(&player.playlist);
+	curl_multi_cleanup(player.multi);
+	return player.status;
+}
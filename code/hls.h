@@ -0,0 +1,40 @@
+#ifndef HLS_H
+#define HLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum Hls_Status {
+	HLS_STATUS_ENDED,        // the playlist has an end and was played completely
+	HLS_STATUS_STOPPED,      // the sink asked to stop
+	HLS_STATUS_FAILED,       // the playlist became unavailable, worth a retry
+	HLS_STATUS_UNSUPPORTED,  // encrypted or not MPEG audio, retrying is pointless
+};
+
+/**
+ * Receives the audio of the segments in playlist order. push() may block
+ * and returns false to stop playback. discontinuity() is called before
+ * audio which does not continue the previous one.
+ */
+struct Hls_Sink {
+	bool (*push)(void *userdata, const uint8_t *data, size_t size);
+	void (*discontinuity)(void *userdata);
+	bool (*should_quit)(void *userdata);
+	void *userdata;
+};
+
+/**
+ * Plays an HLS playlist, text is its already downloaded content.
+ *
+ * A master playlist is resolved to its first variant. The next segments
+ * are fetched in parallel through one curl_multi handle on the shared
+ * connection pool, so they are ready before the previous ones are played.
+ * Live playlists are started a few segments before their end and
+ * refreshed every target duration.
+ *
+ * Segments are MPEG audio, either raw or in a transport stream.
+ */
+enum Hls_Status hls_play(const char *url, const char *text, const struct Hls_Sink *sink);
+
+#endif // HLS_H
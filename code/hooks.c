@@ -0,0 +1,145 @@
+#include "hooks.h"
+
+#include <errno.h>
+#include <linux/limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <SDL3/SDL.h>
+
+#include "config.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define HOOKS_MAX_RUNNING       8
+#define HOOKS_KILL_GRACE_MS     2000
+#define HOOKS_BARRIER_POLL_MS   10
+
+extern char **environ;
+
+struct Hook {
+	pid_t pid;                 // 0 if the slot is free
+	char name[64];
+	uint64_t start_ms;
+	bool is_terminated;        // SIGTERM was sent
+};
+
+static struct Hook g_hooks[HOOKS_MAX_RUNNING];
+
+static void hooks_report(const struct Hook *hook, int status)
+{
+	const uint64_t runtime_ms = SDL_GetTicks() - hook->start_ms;
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+		log_info("hook %s finished after %llu ms\n", hook->name, (unsigned long long) runtime_ms);
+	}
+	else if (WIFEXITED(status)) {
+		log_warning("hook %s exited with %d after %llu ms\n", hook->name, WEXITSTATUS(status), (unsigned long long) runtime_ms);
+	}
+	else if (WIFSIGNALED(status)) {
+		log_warning("hook %s was killed by signal %d after %llu ms\n", hook->name, WTERMSIG(status), (unsigned long long) runtime_ms);
+	}
+}
+
+/** Returns true once the hook is gone and its slot is free again. */
+static bool hooks_check(struct Hook *hook)
+{
+	int status = 0;
+	const pid_t pid = waitpid(hook->pid, &status, WNOHANG);
+
+	if (pid == hook->pid || (pid < 0 && errno == ECHILD)) {
+		if (pid == hook->pid) hooks_report(hook, status);
+		hook->pid = 0;
+		return true;
+	}
+
+	const uint64_t runtime_ms = SDL_GetTicks() - hook->start_ms;
+	const uint64_t timeout_ms = (uint64_t) g_config.hooks_timeout_secs * 1000;
+
+	// the whole process group, scripts tend to start children of their own
+	if (!hook->is_terminated && runtime_ms > timeout_ms) {
+		log_warning("hook %s still runs after %llu ms, terminating it\n", hook->name, (unsigned long long) runtime_ms);
+		kill(-hook->pid, SIGTERM);
+		hook->is_terminated = true;
+	}
+	else if (hook->is_terminated && runtime_ms > timeout_ms + HOOKS_KILL_GRACE_MS) {
+		kill(-hook->pid, SIGKILL);
+	}
+	return false;
+}
+
+static pid_t hooks_spawn(const char *path)
+{
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+
+	// an own process group to stop it as a whole, default signals and no
+	// blocked ones, whatever the app set up for itself
+	sigset_t no_signals, default_signals;
+	sigemptyset(&no_signals);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);
+	sigaddset(&default_signals, SIGUSR2);
+
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setsigmask(&attr, &no_signals);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	char *const argv[] = { (char*) path, NULL };
+	pid_t pid = 0;
+	const int error = posix_spawn(&pid, path, NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+
+	if (error != 0) {
+		log_error("unable to start hook %s: %s\n", path, strerror(error));
+		return 0;
+	}
+	return pid;
+}
+
+void hooks_run(const char *name, bool is_barrier)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/hooks/%s.sh", g_config.resources_dir, name);
+
+	if (access(path, F_OK) != 0) {
+		log_debug("no hook %s\n", path);
+		return;
+	}
+
+	struct Hook *hook = NULL;
+	for (size_t i = 0; i < ARRAY_SIZE(g_hooks) && hook == NULL; ++i) {
+		if (g_hooks[i].pid == 0) hook = &g_hooks[i];
+	}
+	if (hook == NULL) {
+		log_error("more than %d hooks running, skipping %s\n", HOOKS_MAX_RUNNING, name);
+		return;
+	}
+
+	hook->pid = hooks_spawn(path);
+	if (hook->pid == 0) return;
+
+	snprintf(hook->name, sizeof(hook->name), "%s", name);
+	hook->start_ms      = SDL_GetTicks();
+	hook->is_terminated = false;
+	log_debug("started hook %s as pid %d\n", name, (int) hook->pid);
+
+	if (!is_barrier) return;
+
+	while (!hooks_check(hook)) {
+		SDL_Delay(HOOKS_BARRIER_POLL_MS);
+	}
+}
+
+void hooks_update(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(g_hooks); ++i) {
+		if (g_hooks[i].pid != 0) hooks_check(&g_hooks[i]);
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include <stdbool.h>
+
+/**
+ * Scripts in <resources_dir>/hooks, started with posix_spawn() and without
+ * a shell, so they need a shebang and the executable bit. They run next to
+ * the app, hooks_update() collects their exit status and stops the ones
+ * running longer than hooks_timeout_seconds.
+ *
+ * A barrier hook is waited for (up to its timeout) before hooks_run()
+ * returns, for scripts that have to finish before the app goes on.
+ */
+void hooks_run(const char *name, bool is_barrier);
+
+/** Called from the main loop, never blocks. */
+void hooks_update(void);
+
+#endif // HOOKS_H
@@ -0,0 +1,95 @@
+#include "icy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "libcutils/util_makros.h"
+
+#define ICY_METAINT_HEADER "icy-metaint:"
+
+void icy_reset(struct Icy_Demuxer *icy, size_t metaint)
+{
+	icy->metaint    = metaint;
+	icy->audio_left = metaint;
+	icy->meta_left  = 0;
+	icy->meta_used  = 0;
+	icy->is_in_meta = false;
+}
+
+bool icy_parse_metaint_header(const char *line, size_t size, size_t *metaint)
+{
+	const size_t prefix_len = strlen(ICY_METAINT_HEADER);
+	if (size <= prefix_len || strncasecmp(line, ICY_METAINT_HEADER, prefix_len) != 0) return false;
+
+	// header lines are not NUL terminated
+	char value[16] = {0};
+	memcpy(value, line+prefix_len, MIN(size-prefix_len, sizeof(value)-1));
+
+	const long parsed = strtol(value, NULL, 10);
+	*metaint = (parsed > 0) ? (size_t)parsed : 0;
+	return true;
+}
+
+/**
+ * A block looks like "StreamTitle='Artist - Title';StreamUrl='';" padded
+ * with NULs. Titles may contain quotes, so the value ends at "';".
+ */
+static void icy_parse_metadata(struct Icy_Demuxer *icy)
+{
+	icy->meta[icy->meta_used] = '\0';
+
+	const char *start = strstr(icy->meta, "StreamTitle='");
+	if (start == NULL) return;
+	start += strlen("StreamTitle='");
+
+	const char *end = strstr(start, "';");
+	const size_t len = (end != NULL) ? (size_t)(end - start) : strlen(start);
+
+	char title[ICY_MAX_TITLE_LEN];
+	snprintf(title, sizeof(title), "%.*s", (int)MIN(len, sizeof(title)-1), start);
+
+	if (strcmp(title, icy->title) != 0) {
+		memcpy(icy->title, title, sizeof(icy->title));
+		icy->has_new_title = true;
+	}
+}
+
+size_t icy_demux(struct Icy_Demuxer *icy, const uint8_t *data, size_t size, size_t *audio_size)
+{
+	*audio_size = 0;
+	if (size == 0) return 0;
+
+	if (icy->metaint == 0) {
+		*audio_size = size;
+		return size;
+	}
+
+	if (!icy->is_in_meta && icy->audio_left > 0) {
+		*audio_size      = MIN(size, icy->audio_left);
+		icy->audio_left -= *audio_size;
+		return *audio_size;
+	}
+
+	if (!icy->is_in_meta) {
+		// the length byte counts in 16 byte units, 0 means no update
+		icy->meta_left  = (size_t)data[0] * 16;
+		icy->meta_used  = 0;
+		icy->is_in_meta = (icy->meta_left > 0);
+		if (!icy->is_in_meta) icy->audio_left = icy->metaint;
+		return 1;
+	}
+
+	const size_t bytes_meta = MIN(size, icy->meta_left);
+	memcpy(icy->meta+icy->meta_used, data, bytes_meta);
+	icy->meta_used += bytes_meta;
+	icy->meta_left -= bytes_meta;
+
+	if (icy->meta_left == 0) {
+		icy->is_in_meta = false;
+		icy->audio_left = icy->metaint;
+		icy_parse_metadata(icy);
+	}
+	return bytes_meta;
+}
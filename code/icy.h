@@ -0,0 +1,51 @@
+#ifndef ICY_H
+#define ICY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ICY_MAX_METADATA_SIZE (255*16)
+#define ICY_MAX_TITLE_LEN     256
+
+/**
+ * Splits a shoutcast/icecast stream requested with "Icy-MetaData: 1" into
+ * audio and the metadata blocks the server inserts every metaint bytes.
+ *
+ * The demuxer does not copy audio. icy_demux() tells how much of the given
+ * data is audio, which can be passed on directly, and swallows metadata
+ * blocks. Only the metadata itself is collected, because a block may be
+ * split across chunks.
+ */
+struct Icy_Demuxer {
+	size_t metaint;        // 0 if the stream has no metadata
+	size_t audio_left;     // audio bytes until the next length byte
+	size_t meta_left;      // bytes of the current block still missing
+	bool   is_in_meta;
+
+	char   meta[ICY_MAX_METADATA_SIZE+1];
+	size_t meta_used;
+
+	char   title[ICY_MAX_TITLE_LEN];
+	bool   has_new_title;
+};
+
+void icy_reset(struct Icy_Demuxer *icy, size_t metaint);
+
+/**
+ * Parses the icy-metaint value out of a response header line, returns false
+ * for any other line.
+ */
+bool icy_parse_metaint_header(const char *line, size_t size, size_t *metaint);
+
+/**
+ * Consumes a prefix of data and returns its size. The first audio_size
+ * bytes of the consumed prefix are audio, audio_size is either the whole
+ * prefix or 0 for metadata.
+ *
+ * Sets has_new_title once a block with a StreamTitle different from the
+ * last one is complete.
+ */
+size_t icy_demux(struct Icy_Demuxer *icy, const uint8_t *data, size_t size, size_t *audio_size);
+
+#endif // ICY_H
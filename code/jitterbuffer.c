@@ -0,0 +1,216 @@
+#include "jitterbuffer.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "rtlog.h"
+
+#include "libcutils/util_makros.h"
+
+#define JITTERBUFFER_DEFAULT_BYTE_RATE (128000/8)
+#define JITTERBUFFER_MIN_TARGET_MS     1500
+#define JITTERBUFFER_MAX_TARGET_MS     20000
+#define JITTERBUFFER_JITTER_FACTOR     1.5f
+#define JITTERBUFFER_PEAK_DECAY_MS     30000.0f
+#define JITTERBUFFER_STALL_PENALTY_MS  1500
+#define JITTERBUFFER_MAX_PENALTY_MS    10000
+#define JITTERBUFFER_RELIEF_STEP_MS    500
+#define JITTERBUFFER_RELIEF_AFTER_NS   (60ull*1000*1000*1000)
+#define JITTERBUFFER_MAX_STATIONS      32
+
+enum Jitterbuffer_State {
+	JITTERBUFFER_BUFFERING,
+	JITTERBUFFER_PLAYING
+};
+
+/**
+ * Stall history per station, kept across station changes for the whole
+ * runtime. A station which stalled before starts with a deeper buffer.
+ */
+static struct Jitterbuffer_Station {
+	uint64_t key;
+	uint64_t last_used;
+	int penalty_ms;
+	int stalls;
+} g_stations[JITTERBUFFER_MAX_STATIONS];
+
+static uint64_t g_station_use_counter = 0;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t url_key(const char *url)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	for (const char *p = url; *p != '\0'; ++p) {
+		hash ^= (uint8_t) *p;
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static size_t jitterbuffer_find_station(const char *url)
+{
+	const uint64_t key = url_key(url);
+	size_t victim = 0;
+
+	for (size_t i=0; i < ARRAY_SIZE(g_stations); ++i) {
+		if (g_stations[i].key == key) {
+			g_stations[i].last_used = ++g_station_use_counter;
+			return i;
+		}
+		if (g_stations[i].last_used < g_stations[victim].last_used) {
+			victim = i;
+		}
+	}
+
+	memset(&g_stations[victim], 0, sizeof(g_stations[victim]));
+	g_stations[victim].key       = key;
+	g_stations[victim].last_used = ++g_station_use_counter;
+	return victim;
+}
+
+static size_t ms_to_bytes(const struct Jitterbuffer *jb, int ms)
+{
+	return (size_t) ms * (size_t) atomic_load(&jb->byte_rate) / 1000;
+}
+
+static int jitterbuffer_update_target(struct Jitterbuffer *jb)
+{
+	const int jitter_ms  = atomic_load(&jb->jitter_ms);
+	const int penalty_ms = g_stations[jb->station].penalty_ms;
+
+	int target_ms = JITTERBUFFER_MIN_TARGET_MS + (int)((float)jitter_ms*JITTERBUFFER_JITTER_FACTOR) + penalty_ms;
+	target_ms = MIN(target_ms, JITTERBUFFER_MAX_TARGET_MS);
+
+	atomic_store(&jb->target_ms, target_ms);
+	return target_ms;
+}
+
+Result jitterbuffer_init(struct Jitterbuffer *jb, size_t capacity)
+{
+	Result r = spsc_ring_init(&jb->ring, capacity);
+	if (!r.success) return r;
+
+	atomic_init(&jb->state    , JITTERBUFFER_BUFFERING);
+	atomic_init(&jb->byte_rate, JITTERBUFFER_DEFAULT_BYTE_RATE);
+	atomic_init(&jb->jitter_ms, 0);
+	atomic_init(&jb->target_ms, JITTERBUFFER_MIN_TARGET_MS);
+	atomic_init(&jb->underruns, 0);
+	return result_make_success();
+}
+
+void jitterbuffer_reset(struct Jitterbuffer *jb, const char *url)
+{
+	spsc_ring_reset(&jb->ring);
+
+	jb->station          = jitterbuffer_find_station(url);
+	jb->last_arrival_ns  = 0;
+	jb->drift_ms         = 0.0f;
+	jb->peak_drift_ms    = 0.0f;
+	jb->playing_since_ns = 0;
+
+	atomic_store(&jb->state    , JITTERBUFFER_BUFFERING);
+	atomic_store(&jb->byte_rate, JITTERBUFFER_DEFAULT_BYTE_RATE);
+	atomic_store(&jb->jitter_ms, 0);
+	atomic_store(&jb->underruns, 0);
+
+	const struct Jitterbuffer_Station *station = &g_stations[jb->station];
+	// called with the audio stream locked
+	rtlog_debug("jitterbuffer: station stalled %d times before, target %d ms\n",
+		station->stalls, jitterbuffer_update_target(jb));
+}
+
+void jitterbuffer_flush(struct Jitterbuffer *jb)
+{
+	spsc_ring_reset(&jb->ring);
+	jb->playing_since_ns = 0;
+	atomic_store(&jb->state, JITTERBUFFER_BUFFERING);
+}
+
+void jitterbuffer_set_byte_rate(struct Jitterbuffer *jb, int byte_rate)
+{
+	if (byte_rate > 0) atomic_store(&jb->byte_rate, byte_rate);
+}
+
+void jitterbuffer_note_arrival(struct Jitterbuffer *jb, size_t size)
+{
+	const uint64_t now = now_ns();
+
+	if (jb->last_arrival_ns != 0) {
+		const float gap_ms   = (float)(now - jb->last_arrival_ns) / 1e6f;
+		const float chunk_ms = (float)size * 1000.0f / (float)atomic_load(&jb->byte_rate);
+
+		// how far the download fell behind real time since it was last
+		// ahead, this is the depth a buffer needs to get over it
+		jb->drift_ms = MAX(0.0f, jb->drift_ms + gap_ms - chunk_ms);
+
+		// keep the peak for a while, it only fades towards the current
+		// drift over JITTERBUFFER_PEAK_DECAY_MS
+		const float decay = MIN(1.0f, gap_ms / JITTERBUFFER_PEAK_DECAY_MS);
+		jb->peak_drift_ms = MAX(jb->drift_ms, jb->peak_drift_ms - (jb->peak_drift_ms - jb->drift_ms)*decay);
+
+		atomic_store(&jb->jitter_ms, (int) jb->peak_drift_ms);
+	}
+	jb->last_arrival_ns = now;
+}
+
+size_t jitterbuffer_write(struct Jitterbuffer *jb, const void *data, size_t size)
+{
+	return spsc_ring_write(&jb->ring, data, size);
+}
+
+size_t jitterbuffer_read(struct Jitterbuffer *jb, void *dst, size_t size)
+{
+	struct Jitterbuffer_Station *station = &g_stations[jb->station];
+	const int target_ms = jitterbuffer_update_target(jb);
+	const uint64_t now  = now_ns();
+
+	if (atomic_load(&jb->state) == JITTERBUFFER_BUFFERING) {
+		// never wait for more than the ring is able to hold
+		const size_t target_bytes = MIN(ms_to_bytes(jb, target_ms), jb->ring.capacity*3/4);
+		if (spsc_ring_bytes_used(&jb->ring) < target_bytes) return 0;
+
+		rtlog_info("jitterbuffer: reached %d ms, start playing\n", target_ms);
+		atomic_store(&jb->state, JITTERBUFFER_PLAYING);
+		jb->playing_since_ns = now;
+	}
+
+	const size_t bytes = spsc_ring_read(&jb->ring, dst, size);
+
+	if (bytes == 0) {
+		station->stalls++;
+		station->penalty_ms = MIN(station->penalty_ms + JITTERBUFFER_STALL_PENALTY_MS, JITTERBUFFER_MAX_PENALTY_MS);
+
+		atomic_store(&jb->state, JITTERBUFFER_BUFFERING);
+		atomic_fetch_add(&jb->underruns, 1);
+
+		rtlog_warning("jitterbuffer: underrun (%d stalls on this station), rebuffering to %d ms\n",
+			station->stalls, jitterbuffer_update_target(jb));
+		return 0;
+	}
+
+	// a long stable run slowly gives back the extra depth of earlier stalls
+	if (station->penalty_ms > 0 && now - jb->playing_since_ns > JITTERBUFFER_RELIEF_AFTER_NS) {
+		station->penalty_ms  = MAX(0, station->penalty_ms - JITTERBUFFER_RELIEF_STEP_MS);
+		jb->playing_since_ns = now;
+	}
+
+	return bytes;
+}
+
+void jitterbuffer_get_health(const struct Jitterbuffer *jb, struct Audio_Buffer_Health *health)
+{
+	const size_t byte_rate = (size_t) atomic_load(&jb->byte_rate);
+
+	health->is_buffering = (atomic_load(&jb->state) == JITTERBUFFER_BUFFERING);
+	health->buffered_ms  = (int)(spsc_ring_bytes_used(&jb->ring) * 1000 / byte_rate);
+	health->target_ms    = atomic_load(&jb->target_ms);
+	health->jitter_ms    = atomic_load(&jb->jitter_ms);
+	health->underruns    = atomic_load(&jb->underruns);
+}
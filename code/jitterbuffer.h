@@ -0,0 +1,75 @@
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "spsc_ring.h"
+
+/**
+ * Buffer between the download thread (producer) and the audio callback
+ * (consumer) of a radio stream.
+ *
+ * Playback starts once the buffered audio reaches the target depth. The
+ * target grows with the measured arrival jitter, i.e. how far the download
+ * fell behind real time recently, and with the number of stalls seen on the
+ * station. When the consumer finds the buffer empty while playing, that is
+ * counted as underrun and playback pauses until the target is reached again.
+ */
+struct Jitterbuffer {
+	struct Spsc_Ring ring;
+	size_t station;
+
+	// producer side
+	uint64_t last_arrival_ns;
+	float drift_ms;
+	float peak_drift_ms;
+
+	// consumer side
+	uint64_t playing_since_ns;
+
+	// read from every thread
+	_Atomic int state;
+	_Atomic int byte_rate;
+	_Atomic int jitter_ms;
+	_Atomic int target_ms;
+	_Atomic int underruns;
+};
+
+Result jitterbuffer_init(struct Jitterbuffer *jb, size_t capacity);
+
+/**
+ * Starts buffering a new stream. Both threads have to be stopped, the url
+ * is used to look up the stall history of the station.
+ */
+void jitterbuffer_reset(struct Jitterbuffer *jb, const char *url);
+
+/**
+ * Drops the buffered audio of the current stream and buffers again, e.g.
+ * after seeking. Both threads have to be stopped.
+ */
+void jitterbuffer_flush(struct Jitterbuffer *jb);
+
+/**
+ * Encoded bytes per second, used to convert between bytes and playing time.
+ * A default of 128 kbit/s is assumed until this is set.
+ */
+void jitterbuffer_set_byte_rate(struct Jitterbuffer *jb, int byte_rate);
+
+/**
+ * Has to be called once for every chunk received from the network, before
+ * writing it. Retries of a partial write must not be reported again.
+ */
+void   jitterbuffer_note_arrival(struct Jitterbuffer *jb, size_t size);
+size_t jitterbuffer_write(struct Jitterbuffer *jb, const void *data, size_t size);
+
+/**
+ * Returns 0 while (re)buffering, in that case the consumer should just
+ * output nothing and try again.
+ */
+size_t jitterbuffer_read(struct Jitterbuffer *jb, void *dst, size_t size);
+
+void jitterbuffer_get_health(const struct Jitterbuffer *jb, struct Audio_Buffer_Health *health);
+
+#endif // JITTERBUFFER_H
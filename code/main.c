@@ -8,9 +8,23 @@
 #include "libcutils/logger.h"
 
 #include "config.h"
+#include "hooks.h"
 #include "screen.h"
 #include "ui_main.h"
 #include "audio.h"
+#include "audio_stats.h"
+#include "metrics.h"
+#include "netcache.h"
+#include "recorder.h"
+#include "replay.h"
+#include "rtcheck.h"
+#include "rtlog.h"
+#include "station_prober.h"
+#include "trace.h"
+#include "watchdog.h"
+
+#include <linux/limits.h>
+#include <stdlib.h>
 
 #define SCREEN_WIDTH  1024
 #define SCREEN_HEIGHT  600
@@ -32,8 +46,33 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	result = rtlog_start();
+	if (!result.success) log_error("audio thread logs are written directly: %s\n", result.msg);
+
+	result = netcache_init();
+	if (!result.success) {
+		log_error("failed to init network: %s\n", result.msg);
+		return 1;
+	}
+
 	struct Screen screen = {0};
 
+	// SHARDOS_RECORD=<file> captures the input of a session, SHARDOS_REPLAY=<file>
+	// plays it back, e.g. with SHARDOS_HEADLESS=1 to compare builds
+	screen.is_headless = (getenv("SHARDOS_HEADLESS") != NULL);
+
+	if (getenv("SHARDOS_REPLAY") != NULL) {
+		result = replay_play(getenv("SHARDOS_REPLAY"));
+		if (!result.success) {
+			log_error("failed to replay input: %s\n", result.msg);
+			return 1;
+		}
+	}
+	else if (getenv("SHARDOS_RECORD") != NULL) {
+		result = replay_record(getenv("SHARDOS_RECORD"));
+		if (!result.success) log_error("input is not recorded: %s\n", result.msg);
+	}
+
 	result = screen_init(&screen, SCREEN_WIDTH, SCREEN_HEIGHT);
 	if (!result.success) {
 		log_error("failed to load screen: %s\n", result.msg);
@@ -42,12 +81,50 @@ int main(int argc, char *argv[])
 
 	ui_main_init(&screen);
 
+	result = metrics_start(g_config.metrics_socket, g_config.metrics_port);
+	if (!result.success) log_error("metrics disabled: %s\n", result.msg);
+
+	result = watchdog_start(g_config.watchdog_stall_ms);
+	if (!result.success) log_error("watchdog disabled: %s\n", result.msg);
+
+	trace_set_thread_name("render");
+	if (getenv("SHARDOS_TRACE") != NULL) {
+		result = trace_start();
+		if (!result.success) log_error("failed to start tracing: %s\n", result.msg);
+	}
+
 	while (!screen.quit) {
+		watchdog_frame_begin();
+
+		TRACE_BEGIN("screen_rendering_start");
 		screen_rendering_start(&screen);
+		TRACE_END("screen_rendering_start");
+
+		TRACE_BEGIN("ui_main_render");
 		ui_main_render(&screen);
+		TRACE_END("ui_main_render");
 
+		TRACE_BEGIN("screen_rendering_stop");
 		screen_rendering_stop(&screen);
+		TRACE_END("screen_rendering_stop");
+
+		audio_stats_report_if_due();
+		hooks_update();
+		RTCHECK_REPORT();
+	}
+
+	if (TRACE_IS_ENABLED()) {
+		char trace_path[PATH_MAX];
+		result = trace_stop(trace_path, sizeof(trace_path));
+		if (!result.success) log_error("failed to write trace: %s\n", result.msg);
 	}
 
+	replay_stop();
+	recorder_finish();
+	watchdog_stop();
+	metrics_stop();
+	station_prober_stop();
 	screen_destroy(&screen);
+	netcache_destroy();
+	rtlog_stop();
 }
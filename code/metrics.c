@@ -0,0 +1,460 @@
+#include "metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <SDL3/SDL.h>
+
+#include "audio.h"
+#include "audio_stats.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define METRICS_MAX_CLIENTS        4
+#define METRICS_MAX_REQUEST_SIZE   1024
+#define METRICS_MAX_BODY_SIZE      (16*1024)
+#define METRICS_MAX_HEADER_SIZE    256
+#define METRICS_CLIENT_TIMEOUT_MS  5000
+
+#define METRICS_RESPONSE_NOT_FOUND \
+	"HTTP/1.0 404 Not Found\r\n" \
+	"Content-Length: 0\r\n" \
+	"\r\n"
+
+struct Metrics_Client {
+	int fd;                    // -1 if the slot is free
+	uint64_t accepted_ms;
+	char request[METRICS_MAX_REQUEST_SIZE];
+	size_t request_used;
+	char response[METRICS_MAX_HEADER_SIZE + METRICS_MAX_BODY_SIZE];
+	size_t response_size;      // 0 while the request is read
+	size_t response_sent;
+};
+
+static const struct {
+	const char *name;
+	const char *help;
+} g_counter_info[METRICS_COUNTER_COUNT] = {
+	[METRICS_NET_RECEIVED_BYTES]     = {"shardos_net_received_bytes_total"    , "Bytes received from radio stations."},
+	[METRICS_NET_TRANSFERS]          = {"shardos_net_transfers_total"         , "Started downloads."},
+	[METRICS_NET_REUSED_CONNECTIONS] = {"shardos_net_reused_connections_total", "Downloads on a pooled connection."},
+	[METRICS_PREFETCH_HITS]          = {"shardos_prefetch_hits_total"         , "Station switches started from a prefetched window."},
+	[METRICS_PREFETCH_MISSES]        = {"shardos_prefetch_misses_total"       , "Station switches without a prefetched window."},
+	[METRICS_ALBUMART_CACHE_HITS]    = {"shardos_albumart_cache_hits_total"   , "Cover art taken from the thumbnail cache."},
+	[METRICS_ALBUMART_CACHE_MISSES]  = {"shardos_albumart_cache_misses_total" , "Cover art decoded and scaled again."},
+};
+
+// upper limits of the frame time buckets, everything above goes to +Inf
+static const uint64_t g_frame_bucket_ms[] = {2, 4, 8, 16, 33, 50, 100, 250};
+
+static struct {
+	_Atomic uint64_t counters[METRICS_COUNTER_COUNT];
+
+	// only written by the render thread
+	_Atomic uint64_t frames;
+	_Atomic uint64_t frame_cpu_ns;
+	_Atomic uint64_t frame_buckets[ARRAY_SIZE(g_frame_bucket_ms)];
+
+	int unix_fd;
+	int tcp_fd;
+	char socket_path[PATH_MAX];
+	struct Metrics_Client clients[METRICS_MAX_CLIENTS];
+} g_metrics = {
+	.unix_fd = -1,
+	.tcp_fd  = -1,
+};
+
+struct Metrics_Text {
+	char *data;
+	size_t size;
+	size_t used;
+};
+
+void metrics_add(enum Metrics_Counter counter, uint64_t value)
+{
+	atomic_fetch_add_explicit(&g_metrics.counters[counter], value, memory_order_relaxed);
+}
+
+void metrics_record_frame(uint64_t cpu_ns)
+{
+	atomic_fetch_add_explicit(&g_metrics.frames, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&g_metrics.frame_cpu_ns, cpu_ns, memory_order_relaxed);
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_frame_bucket_ms); ++i) {
+		if (cpu_ns <= g_frame_bucket_ms[i]*1000000ull) {
+			atomic_fetch_add_explicit(&g_metrics.frame_buckets[i], 1, memory_order_relaxed);
+			break;
+		}
+	}
+}
+
+__attribute__((format(printf, 2, 3)))
+static void text_append(struct Metrics_Text *text, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	const int written = vsnprintf(text->data+text->used, text->size-text->used, fmt, args);
+	va_end(args);
+
+	// a cut off body is still valid up to its last complete line
+	if (written > 0) text->used = MIN(text->used + (size_t) written, text->size-1);
+}
+
+static void text_append_metric(struct Metrics_Text *text, const char *name, const char *type, const char *help, double value)
+{
+	text_append(text, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+}
+
+static uint64_t metrics_get_rss_bytes(void)
+{
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (file == NULL) return 0;
+
+	unsigned long long size = 0, resident = 0;
+	const int parsed = fscanf(file, "%llu %llu", &size, &resident);
+	fclose(file);
+
+	return (parsed == 2) ? resident * (uint64_t) sysconf(_SC_PAGESIZE) : 0;
+}
+
+static void metrics_write_frames(struct Metrics_Text *text)
+{
+	const char *name = "shardos_frame_cpu_seconds";
+	text_append(text, "# HELP %s Time spent on a frame before waiting for the next one.\n# TYPE %s histogram\n", name, name);
+
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(g_frame_bucket_ms); ++i) {
+		cumulative += atomic_load_explicit(&g_metrics.frame_buckets[i], memory_order_relaxed);
+		text_append(text, "%s_bucket{le=\"%.3f\"} %llu\n", name, (double) g_frame_bucket_ms[i]/1000.0, (unsigned long long) cumulative);
+	}
+
+	const uint64_t frames = atomic_load_explicit(&g_metrics.frames, memory_order_relaxed);
+	text_append(text, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long) frames);
+	text_append(text, "%s_sum %.9f\n", name, (double) atomic_load_explicit(&g_metrics.frame_cpu_ns, memory_order_relaxed) / 1e9);
+	text_append(text, "%s_count %llu\n", name, (unsigned long long) frames);
+}
+
+static void metrics_write_audio(struct Metrics_Text *text)
+{
+	struct Audio_Buffer_Health health;
+	audio_get_buffer_health(&health);
+
+	text_append_metric(text, "shardos_audio_buffered_seconds", "gauge", "Audio buffered ahead of the decoder.", (double) health.buffered_ms / 1000.0);
+	text_append_metric(text, "shardos_audio_buffer_target_seconds", "gauge", "Buffer the jitterbuffer aims for.", (double) health.target_ms / 1000.0);
+	text_append_metric(text, "shardos_audio_buffering", "gauge", "1 while playback waits for the buffer to fill.", health.is_buffering ? 1.0 : 0.0);
+	text_append_metric(text, "shardos_audio_underruns_total", "counter", "Buffer underruns of the playing station.", (double) health.underruns);
+	text_append_metric(text, "shardos_radio_reconnects_total", "counter", "Reconnects to the playing station.", (double) health.reconnects);
+
+	struct Audio_Stats stats;
+	audio_stats_get(&stats);
+
+	text_append_metric(text, "shardos_audio_callbacks_total", "counter", "Audio device callbacks.", (double) stats.callbacks);
+	text_append_metric(text, "shardos_audio_short_callbacks_total", "counter", "Callbacks that delivered less than requested.", (double) stats.short_callbacks);
+	text_append_metric(text, "shardos_audio_requested_bytes_total", "counter", "PCM bytes the audio device asked for.", (double) stats.bytes_requested);
+	text_append_metric(text, "shardos_audio_delivered_bytes_total", "counter", "PCM bytes handed to the audio device.", (double) stats.bytes_delivered);
+	text_append_metric(text, "shardos_audio_decoder_need_more_total", "counter", "Times the decoder ran out of input.", (double) stats.need_more);
+
+	const char *name = "shardos_audio_callback_seconds";
+	text_append(text, "# HELP %s Duration of the audio device callback.\n# TYPE %s histogram\n", name, name);
+
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i+1 < AUDIO_STATS_DURATION_BUCKETS; ++i) {
+		cumulative += stats.duration[i];
+		text_append(text, "%s_bucket{le=\"%.6f\"} %llu\n", name, (double)(32ull << i) / 1e6, (unsigned long long) cumulative);
+	}
+	// not the callbacks counter, the snapshot may be torn between the two
+	cumulative += stats.duration[AUDIO_STATS_DURATION_BUCKETS-1];
+	text_append(text, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long) cumulative);
+	text_append(text, "%s_sum %.9f\n", name, (double) stats.duration_ns_sum / 1e9);
+	text_append(text, "%s_count %llu\n", name, (unsigned long long) cumulative);
+}
+
+static size_t metrics_write_body(char *data, size_t size)
+{
+	struct Metrics_Text text = { .data = data, .size = size, .used = 0 };
+	data[0] = '\0';
+
+	metrics_write_frames(&text);
+	metrics_write_audio(&text);
+
+	for (size_t i = 0; i < METRICS_COUNTER_COUNT; ++i) {
+		const uint64_t value = atomic_load_explicit(&g_metrics.counters[i], memory_order_relaxed);
+		text_append_metric(&text, g_counter_info[i].name, "counter", g_counter_info[i].help, (double) value);
+	}
+
+	text_append_metric(&text, "shardos_process_resident_memory_bytes", "gauge", "Resident set size.", (double) metrics_get_rss_bytes());
+	return text.used;
+}
+
+static void metrics_close_client(struct Metrics_Client *client)
+{
+	close(client->fd);
+	client->fd = -1;
+}
+
+static void metrics_accept(int listen_fd)
+{
+	for (;;) {
+		const int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) return;
+
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		struct Metrics_Client *client = NULL;
+		for (size_t i = 0; i < ARRAY_SIZE(g_metrics.clients) && client == NULL; ++i) {
+			if (g_metrics.clients[i].fd < 0) client = &g_metrics.clients[i];
+		}
+
+		if (client == NULL) {
+			log_warning("metrics: more than %d clients, refusing\n", METRICS_MAX_CLIENTS);
+			close(fd);
+			continue;
+		}
+
+		client->fd            = fd;
+		client->accepted_ms   = SDL_GetTicks();
+		client->request_used  = 0;
+		client->response_size = 0;
+		client->response_sent = 0;
+	}
+}
+
+static void metrics_prepare_response(struct Metrics_Client *client)
+{
+	const bool is_metrics = (strncmp(client->request, "GET /metrics ", 13) == 0 || strncmp(client->request, "GET / ", 6) == 0);
+
+	if (!is_metrics) {
+		client->response_size = (size_t) snprintf(client->response, sizeof(client->response), "%s", METRICS_RESPONSE_NOT_FOUND);
+		return;
+	}
+
+	// the body goes behind room for the header, which needs its length
+	char *body = client->response + METRICS_MAX_HEADER_SIZE;
+	const size_t body_size = metrics_write_body(body, METRICS_MAX_BODY_SIZE);
+
+	char header[METRICS_MAX_HEADER_SIZE];
+	const int header_size = snprintf(header, sizeof(header),
+		"HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: %zu\r\n"
+		"\r\n", body_size);
+
+	memmove(client->response + header_size, body, body_size);
+	memcpy(client->response, header, (size_t) header_size);
+	client->response_size = (size_t) header_size + body_size;
+}
+
+static void metrics_read_request(struct Metrics_Client *client)
+{
+	for (;;) {
+		char *dst        = client->request + client->request_used;
+		const size_t max = sizeof(client->request) - client->request_used - 1;
+
+		const ssize_t received = recv(client->fd, dst, max, 0);
+		if (received < 0 && errno == EAGAIN) return;
+		if (received <= 0 || (size_t) received == max) {
+			metrics_close_client(client);
+			return;
+		}
+
+		client->request_used += (size_t) received;
+		client->request[client->request_used] = '\0';
+
+		if (strstr(client->request, "\r\n\r\n") != NULL) break;
+	}
+
+	metrics_prepare_response(client);
+}
+
+static void metrics_send_response(struct Metrics_Client *client)
+{
+	while (client->response_sent < client->response_size) {
+		const ssize_t sent = send(client->fd, client->response + client->response_sent,
+			client->response_size - client->response_sent, MSG_NOSIGNAL);
+
+		if (sent < 0 && errno == EAGAIN) return;
+		if (sent < 0) break;
+		client->response_sent += (size_t) sent;
+	}
+	metrics_close_client(client);
+}
+
+static void metrics_serve(struct Metrics_Client *client, short revents)
+{
+	if (revents & (POLLERR | POLLNVAL)) {
+		metrics_close_client(client);
+		return;
+	}
+
+	if (client->response_size == 0) {
+		if (revents & (POLLIN | POLLHUP)) metrics_read_request(client);
+		if (client->fd < 0 || client->response_size == 0) return;
+	}
+	metrics_send_response(client);
+}
+
+void metrics_wait(uint32_t timeout_ms)
+{
+	if (g_metrics.unix_fd < 0 && g_metrics.tcp_fd < 0) {
+		SDL_Delay(timeout_ms);
+		return;
+	}
+
+	const uint64_t deadline = SDL_GetTicks() + timeout_ms;
+
+	for (;;) {
+		const uint64_t now = SDL_GetTicks();
+		if (now >= deadline) return;
+
+		struct pollfd fds[2 + METRICS_MAX_CLIENTS];
+		struct Metrics_Client *owners[ARRAY_SIZE(fds)];
+		nfds_t count = 0;
+
+		if (g_metrics.unix_fd >= 0) {
+			owners[count] = NULL;
+			fds[count++]  = (struct pollfd) { .fd = g_metrics.unix_fd, .events = POLLIN };
+		}
+		if (g_metrics.tcp_fd >= 0) {
+			owners[count] = NULL;
+			fds[count++]  = (struct pollfd) { .fd = g_metrics.tcp_fd, .events = POLLIN };
+		}
+
+		for (size_t i = 0; i < ARRAY_SIZE(g_metrics.clients); ++i) {
+			struct Metrics_Client *client = &g_metrics.clients[i];
+			if (client->fd < 0) continue;
+
+			// a client that never finishes its request must not keep the slot
+			if (now - client->accepted_ms > METRICS_CLIENT_TIMEOUT_MS) {
+				metrics_close_client(client);
+				continue;
+			}
+
+			owners[count] = client;
+			fds[count++]  = (struct pollfd) {
+				.fd     = client->fd,
+				.events = (client->response_size == 0) ? POLLIN : POLLOUT,
+			};
+		}
+
+		const int ready = poll(fds, count, (int)(deadline - now));
+		if (ready == 0) return;
+		if (ready < 0) {
+			if (errno == EINTR) continue;
+			log_error("metrics: poll failed: %s\n", strerror(errno));
+			SDL_Delay((uint32_t)(deadline - now));
+			return;
+		}
+
+		for (nfds_t i = 0; i < count; ++i) {
+			if (fds[i].revents == 0) continue;
+
+			if (owners[i] == NULL) metrics_accept(fds[i].fd);
+			else metrics_serve(owners[i], fds[i].revents);
+		}
+	}
+}
+
+static Result metrics_listen_unix(const char *socket_path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		return result_make(false, "socket path too long: %s", socket_path);
+	}
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
+
+	g_metrics.unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (g_metrics.unix_fd < 0) {
+		return result_make(false, "unable to create socket: %s", strerror(errno));
+	}
+
+	// left over from a crash, nobody else may be listening there
+	struct stat st;
+	if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path);
+
+	if (bind(g_metrics.unix_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(g_metrics.unix_fd, 4) != 0) {
+		return result_make(false, "unable to listen on %s: %s", socket_path, strerror(errno));
+	}
+
+	snprintf(g_metrics.socket_path, sizeof(g_metrics.socket_path), "%s", socket_path);
+	log_info("metrics: serving on %s\n", socket_path);
+	return result_make_success();
+}
+
+static Result metrics_listen_tcp(int port)
+{
+	g_metrics.tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (g_metrics.tcp_fd < 0) {
+		return result_make(false, "unable to create socket: %s", strerror(errno));
+	}
+
+	const int on = 1;
+	setsockopt(g_metrics.tcp_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	// loopback only, the numbers are nobody else's business
+	struct sockaddr_in addr = {
+		.sin_family      = AF_INET,
+		.sin_port        = htons((uint16_t) port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	if (bind(g_metrics.tcp_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(g_metrics.tcp_fd, 4) != 0) {
+		return result_make(false, "unable to listen on port %d: %s", port, strerror(errno));
+	}
+
+	log_info("metrics: serving on 127.0.0.1:%d\n", port);
+	return result_make_success();
+}
+
+Result metrics_start(const char *socket_path, int port)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(g_metrics.clients); ++i) {
+		g_metrics.clients[i].fd = -1;
+	}
+
+	if (socket_path != NULL && socket_path[0] != '\0') {
+		Result r = metrics_listen_unix(socket_path);
+		if (!r.success) {
+			metrics_stop();
+			return r;
+		}
+	}
+
+	if (port > 0) {
+		Result r = metrics_listen_tcp(port);
+		if (!r.success) {
+			metrics_stop();
+			return r;
+		}
+	}
+	return result_make_success();
+}
+
+void metrics_stop(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(g_metrics.clients); ++i) {
+		if (g_metrics.clients[i].fd >= 0) metrics_close_client(&g_metrics.clients[i]);
+	}
+
+	if (g_metrics.unix_fd >= 0) {
+		close(g_metrics.unix_fd);
+		unlink(g_metrics.socket_path);
+	}
+	if (g_metrics.tcp_fd >= 0) close(g_metrics.tcp_fd);
+
+	g_metrics.unix_fd        = -1;
+	g_metrics.tcp_fd         = -1;
+	g_metrics.socket_path[0] = '\0';
+}
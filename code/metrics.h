@@ -0,0 +1,39 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+/** Counters other modules add to, from any thread. */
+enum Metrics_Counter {
+	METRICS_NET_RECEIVED_BYTES,
+	METRICS_NET_TRANSFERS,
+	METRICS_NET_REUSED_CONNECTIONS,
+	METRICS_PREFETCH_HITS,
+	METRICS_PREFETCH_MISSES,
+	METRICS_ALBUMART_CACHE_HITS,
+	METRICS_ALBUMART_CACHE_MISSES,
+	METRICS_COUNTER_COUNT
+};
+
+void metrics_add(enum Metrics_Counter counter, uint64_t value);
+
+/** Called by the render thread once per frame. */
+void metrics_record_frame(uint64_t cpu_ns);
+
+/**
+ * Serves the metrics in the Prometheus text format over HTTP on a unix
+ * socket and/or on a loopback port, an empty path or port 0 leave that one
+ * out. Requests are answered by metrics_wait(), there is no thread.
+ */
+Result metrics_start(const char *socket_path, int port);
+void   metrics_stop(void);
+
+/**
+ * Sleeps for timeout_ms like SDL_Delay() but answers metric requests
+ * meanwhile. The main loop waits for the next frame here.
+ */
+void   metrics_wait(uint32_t timeout_ms);
+
+#endif // METRICS_H
@@ -0,0 +1,183 @@
+#include "mpegframe.h"
+
+#include <string.h>
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+// give up searching a sync after this many bytes, most likely no mpeg stream
+#define MPEG_FRAMER_MAX_SKIP (64*1024)
+
+static const int g_bitrates_kbps[2][3][15] = {
+	{ // MPEG 1
+		{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448}, // layer I
+		{0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384}, // layer II
+		{0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320}, // layer III
+	},
+	{ // MPEG 2 and 2.5
+		{0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256},
+		{0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160},
+		{0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160},
+	}
+};
+
+static const int g_samplerates_hz[3][3] = {
+	{44100, 48000, 32000}, // MPEG 1
+	{22050, 24000, 16000}, // MPEG 2
+	{11025, 12000,  8000}, // MPEG 2.5
+};
+
+bool mpegframe_parse_header(const uint8_t *data, struct Mpeg_Frame_Header *header)
+{
+	if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) return false;
+
+	const int version_bits    = (data[1] >> 3) & 0x03;
+	const int layer_bits      = (data[1] >> 1) & 0x03;
+	const int bitrate_index   = (data[2] >> 4) & 0x0F;
+	const int samplerate_bits = (data[2] >> 2) & 0x03;
+	const int padding         = (data[2] >> 1) & 0x01;
+
+	if (version_bits == 1 || layer_bits == 0) return false;
+	if (bitrate_index == 0 || bitrate_index == 15 || samplerate_bits == 3) return false;
+
+	switch (version_bits) {
+		case 0 : header->version = 25; break;
+		case 2 : header->version = 2;  break;
+		default: header->version = 1;  break;
+	}
+	header->layer = 4 - layer_bits;
+
+	const int table = (header->version == 1) ? 0 : 1;
+	const int rates = (header->version == 1) ? 0 : (header->version == 2) ? 1 : 2;
+
+	header->bitrate_kbps  = g_bitrates_kbps[table][header->layer-1][bitrate_index];
+	header->samplerate_hz = g_samplerates_hz[rates][samplerate_bits];
+
+	const int bitrate = header->bitrate_kbps * 1000;
+	int frame_size    = 0;
+
+	if (header->layer == 1) {
+		frame_size = (12*bitrate/header->samplerate_hz + padding) * 4;
+	}
+	else if (header->layer == 3 && header->version != 1) {
+		frame_size = 72*bitrate/header->samplerate_hz + padding;
+	}
+	else {
+		frame_size = 144*bitrate/header->samplerate_hz + padding;
+	}
+
+	header->frame_size = (size_t) frame_size;
+	return true;
+}
+
+static bool is_same_stream(const struct Mpeg_Frame_Header *a, const struct Mpeg_Frame_Header *b)
+{
+	return a->version == b->version && a->layer == b->layer && a->samplerate_hz == b->samplerate_hz;
+}
+
+static void mpeg_framer_drop(struct Mpeg_Framer *framer, size_t pos, size_t size)
+{
+	memmove(framer->data+pos, framer->data+pos+size, framer->used-pos-size);
+	framer->used    -= size;
+	framer->skipped += size;
+}
+
+/**
+ * Searches two consecutive matching frame headers after the ready frames,
+ * a single 0xFFE is way too common in random data.
+ */
+static bool mpeg_framer_sync(struct Mpeg_Framer *framer)
+{
+	const size_t start = framer->ready;
+
+	for (size_t pos = start; pos + MPEG_FRAME_HEADER_SIZE <= framer->used; ++pos) {
+		struct Mpeg_Frame_Header first;
+		if (!mpegframe_parse_header(framer->data+pos, &first)) continue;
+
+		const size_t next = pos + first.frame_size;
+		if (next + MPEG_FRAME_HEADER_SIZE > framer->used) {
+			// undecided until more data arrived
+			mpeg_framer_drop(framer, start, pos-start);
+			return false;
+		}
+
+		struct Mpeg_Frame_Header second;
+		if (mpegframe_parse_header(framer->data+next, &second) && is_same_stream(&first, &second)) {
+			mpeg_framer_drop(framer, start, pos-start);
+			if (framer->skipped > 0) {
+				log_debug("mpeg framer: synced after skipping %zu bytes\n", framer->skipped);
+			}
+			framer->is_synced = true;
+			return true;
+		}
+	}
+
+	// keep the last bytes, they might be the start of a header
+	if (framer->used - start >= MPEG_FRAME_HEADER_SIZE) {
+		mpeg_framer_drop(framer, start, framer->used - start - (MPEG_FRAME_HEADER_SIZE-1));
+	}
+
+	if (framer->skipped >= MPEG_FRAMER_MAX_SKIP) {
+		log_warning("mpeg framer: no frame sync found, passing stream through\n");
+		framer->is_passthrough = true;
+	}
+	return false;
+}
+
+static void mpeg_framer_scan(struct Mpeg_Framer *framer)
+{
+	while (!framer->is_passthrough) {
+		if (!framer->is_synced && !mpeg_framer_sync(framer)) break;
+
+		struct Mpeg_Frame_Header header;
+		if (framer->ready + MPEG_FRAME_HEADER_SIZE > framer->used) break;
+
+		if (!mpegframe_parse_header(framer->data+framer->ready, &header)) {
+			log_debug("mpeg framer: lost sync\n");
+			framer->is_synced = false;
+			continue;
+		}
+
+		if (framer->ready + header.frame_size > framer->used) break;
+		framer->ready += header.frame_size;
+	}
+
+	if (framer->is_passthrough) {
+		framer->ready = framer->used;
+	}
+}
+
+void mpeg_framer_reset(struct Mpeg_Framer *framer)
+{
+	// complete frames are kept, only the incomplete rest is dropped
+	framer->used           = framer->ready;
+	framer->skipped        = 0;
+	framer->is_synced      = false;
+	framer->is_passthrough = false;
+}
+
+size_t mpeg_framer_push(struct Mpeg_Framer *framer, const uint8_t *data, size_t size)
+{
+	size = MIN(size, sizeof(framer->data) - framer->used);
+
+	memcpy(framer->data+framer->used, data, size);
+	framer->used += size;
+
+	mpeg_framer_scan(framer);
+	return size;
+}
+
+const uint8_t *mpeg_framer_ready(const struct Mpeg_Framer *framer, size_t *size)
+{
+	*size = framer->ready;
+	return framer->data;
+}
+
+void mpeg_framer_consume(struct Mpeg_Framer *framer, size_t size)
+{
+	PRECONDITION(size <= framer->ready);
+
+	memmove(framer->data, framer->data+size, framer->used-size);
+	framer->used  -= size;
+	framer->ready -= size;
+}
@@ -0,0 +1,55 @@
+#ifndef MPEGFRAME_H
+#define MPEGFRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MPEG_FRAME_HEADER_SIZE 4
+#define MPEG_MAX_FRAME_SIZE    2881
+#define MPEG_FRAMER_SIZE       (32*1024)
+
+struct Mpeg_Frame_Header {
+	int version;     // 1, 2 or 25 for MPEG 2.5
+	int layer;
+	int bitrate_kbps;
+	int samplerate_hz;
+	size_t frame_size;
+};
+
+/**
+ * Parses the 4 byte header of an MPEG audio frame. Free format and reserved
+ * values are rejected, so this is also usable to find the frame sync in
+ * arbitrary data.
+ */
+bool mpegframe_parse_header(const uint8_t *data, struct Mpeg_Frame_Header *header);
+
+/**
+ * Cuts a byte stream into whole MPEG audio frames.
+ *
+ * Data is pushed in arbitrary chunks, only complete frames are handed out
+ * by mpeg_framer_ready(). After mpeg_framer_reset() a partially received
+ * frame is dropped and the following data is resynced on the next frame
+ * header, so two streams can be spliced without garbage in between.
+ *
+ * If no frame sync is found in the first bytes of a stream, it is passed
+ * through unchanged.
+ */
+struct Mpeg_Framer {
+	uint8_t data[MPEG_FRAMER_SIZE];
+	size_t used;
+	size_t ready;       // complete frames at the start of data
+	size_t skipped;     // bytes dropped while searching the sync
+	bool is_synced;
+	bool is_passthrough;
+};
+
+void   mpeg_framer_reset(struct Mpeg_Framer *framer);
+
+/** Returns the number of bytes taken, 0 if the ready frames have to be consumed first. */
+size_t mpeg_framer_push(struct Mpeg_Framer *framer, const uint8_t *data, size_t size);
+
+const uint8_t *mpeg_framer_ready(const struct Mpeg_Framer *framer, size_t *size);
+void   mpeg_framer_consume(struct Mpeg_Framer *framer, size_t size);
+
+#endif // MPEGFRAME_H
@@ -0,0 +1,145 @@
+#include "mpegts.h"
+
+#include <string.h>
+
+#include "libcutils/util_makros.h"
+
+#define MPEGTS_SYNC_BYTE          0x47
+#define MPEGTS_PID_PAT            0x0000
+#define MPEGTS_TABLE_PAT          0x00
+#define MPEGTS_TABLE_PMT          0x02
+#define MPEGTS_TYPE_MPEG1_AUDIO   0x03
+#define MPEGTS_TYPE_MPEG2_AUDIO   0x04
+#define MPEGTS_CRC_SIZE           4
+
+void mpegts_reset(struct Mpegts_Demuxer *demuxer)
+{
+	demuxer->pmt_pid     = -1;
+	demuxer->audio_pid   = -1;
+	demuxer->stream_type = 0;
+}
+
+bool mpegts_detect(const uint8_t *data, size_t size)
+{
+	return size >= 2*MPEGTS_PACKET_SIZE &&
+	       data[0] == MPEGTS_SYNC_BYTE &&
+	       data[MPEGTS_PACKET_SIZE] == MPEGTS_SYNC_BYTE;
+}
+
+bool mpegts_is_unsupported(const struct Mpegts_Demuxer *demuxer)
+{
+	return demuxer->audio_pid == -1 && demuxer->stream_type != 0;
+}
+
+/**
+ * Returns the section a psi payload starts with and its size without the
+ * crc. Sections spanning multiple packets are not supported, PAT and PMT
+ * of audio streams always fit into one.
+ */
+static const uint8_t *mpegts_get_section(const uint8_t *payload, size_t payload_size, size_t *size)
+{
+	const size_t start = 1 + (size_t)payload[0];
+	if (start+3 > payload_size) return NULL;
+
+	const uint8_t *section      = payload + start;
+	const size_t section_length = ((size_t)(section[1] & 0x0F) << 8) | section[2];
+	const size_t total          = MIN(3 + section_length, payload_size - start);
+
+	if (total < 3 + MPEGTS_CRC_SIZE) return NULL;
+
+	*size = total - MPEGTS_CRC_SIZE;
+	return section;
+}
+
+static void mpegts_parse_pat(struct Mpegts_Demuxer *demuxer, const uint8_t *payload, size_t payload_size)
+{
+	size_t size = 0;
+	const uint8_t *section = mpegts_get_section(payload, payload_size, &size);
+	if (section == NULL || section[0] != MPEGTS_TABLE_PAT) return;
+
+	// the first program is the one to play, number 0 is the network pid
+	for (size_t i=8; i+4 <= size; i += 4) {
+		const int program = (section[i] << 8) | section[i+1];
+		const int pid     = ((section[i+2] & 0x1F) << 8) | section[i+3];
+
+		if (program != 0) {
+			demuxer->pmt_pid = pid;
+			return;
+		}
+	}
+}
+
+static void mpegts_parse_pmt(struct Mpegts_Demuxer *demuxer, const uint8_t *payload, size_t payload_size)
+{
+	size_t size = 0;
+	const uint8_t *section = mpegts_get_section(payload, payload_size, &size);
+	if (section == NULL || section[0] != MPEGTS_TABLE_PMT || size < 12) return;
+
+	const size_t program_info_length = ((size_t)(section[10] & 0x0F) << 8) | section[11];
+
+	for (size_t i = 12 + program_info_length; i+5 <= size; ) {
+		const int type             = section[i];
+		const int pid              = ((section[i+1] & 0x1F) << 8) | section[i+2];
+		const size_t es_info_length = ((size_t)(section[i+3] & 0x0F) << 8) | section[i+4];
+
+		if (type == MPEGTS_TYPE_MPEG1_AUDIO || type == MPEGTS_TYPE_MPEG2_AUDIO) {
+			demuxer->audio_pid   = pid;
+			demuxer->stream_type = type;
+			return;
+		}
+
+		// remembered to tell the user why nothing plays
+		if (demuxer->stream_type == 0) demuxer->stream_type = type;
+
+		i += 5 + es_info_length;
+	}
+}
+
+size_t mpegts_demux(struct Mpegts_Demuxer *demuxer, uint8_t *data, size_t size)
+{
+	size_t bytes_out = 0;
+
+	for (size_t offset=0; offset+MPEGTS_PACKET_SIZE <= size; offset += MPEGTS_PACKET_SIZE) {
+		const uint8_t *packet = data + offset;
+		if (packet[0] != MPEGTS_SYNC_BYTE) continue;
+
+		const bool is_unit_start  = (packet[1] & 0x40) != 0;
+		const int  pid            = ((packet[1] & 0x1F) << 8) | packet[2];
+		const int  adaptation     = (packet[3] >> 4) & 0x03;
+
+		// 1: payload only, 2: adaptation field only, 3: both
+		if (adaptation == 0 || adaptation == 2) continue;
+
+		size_t pos = 4;
+		if (adaptation == 3) pos += 1 + (size_t)packet[4];
+		if (pos >= MPEGTS_PACKET_SIZE) continue;
+
+		const uint8_t *payload = packet + pos;
+		size_t payload_size    = MPEGTS_PACKET_SIZE - pos;
+
+		if (pid == MPEGTS_PID_PAT && is_unit_start) {
+			mpegts_parse_pat(demuxer, payload, payload_size);
+		}
+		else if (pid == demuxer->pmt_pid && is_unit_start) {
+			mpegts_parse_pmt(demuxer, payload, payload_size);
+		}
+		else if (pid == demuxer->audio_pid) {
+			if (is_unit_start) {
+				// skip the pes header, timestamps are of no use here
+				if (payload_size < 9 || payload[0] != 0 || payload[1] != 0 || payload[2] != 1) continue;
+
+				const size_t header_size = 9 + (size_t)payload[8];
+				if (header_size > payload_size) continue;
+
+				payload      += header_size;
+				payload_size -= header_size;
+			}
+
+			// never overtakes the read position, each packet shrinks by its header
+			memmove(data+bytes_out, payload, payload_size);
+			bytes_out += payload_size;
+		}
+	}
+
+	return bytes_out;
+}
@@ -0,0 +1,37 @@
+#ifndef MPEGTS_H
+#define MPEGTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MPEGTS_PACKET_SIZE 188
+
+/**
+ * Extracts the MPEG audio elementary stream out of a transport stream, as
+ * used by HLS segments.
+ *
+ * The program and audio pid are taken from the first PAT/PMT and kept for
+ * the following segments. Other codecs are only detected, so the caller is
+ * able to report them.
+ */
+struct Mpegts_Demuxer {
+	int pmt_pid;          // -1 until the PAT was seen
+	int audio_pid;        // -1 until the PMT was seen
+	int stream_type;      // of the first audio stream in the PMT
+};
+
+void mpegts_reset(struct Mpegts_Demuxer *demuxer);
+
+bool mpegts_detect(const uint8_t *data, size_t size);
+
+/**
+ * Demuxes whole packets in place: the audio payload is moved to the start
+ * of data and its size is returned. Trailing partial packets are ignored.
+ */
+size_t mpegts_demux(struct Mpegts_Demuxer *demuxer, uint8_t *data, size_t size);
+
+/** True once the PMT announced a non MPEG audio stream, like AAC. */
+bool mpegts_is_unsupported(const struct Mpegts_Demuxer *demuxer);
+
+#endif // MPEGTS_H
@@ -0,0 +1,159 @@
+#include "netcache.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "metrics.h"
+#include "rtlog.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define NETCACHE_MAX_IDLE_HANDLES  8
+#define NETCACHE_DNS_CACHE_TIMEOUT 600L
+
+static struct {
+	CURLSH *share;
+	pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+	pthread_mutex_t pool_lock;
+	CURL *idle_handles[NETCACHE_MAX_IDLE_HANDLES];
+	size_t idle_count;
+
+	// connect times, to see what the cache saves
+	_Atomic uint64_t transfers;
+	_Atomic uint64_t total_setup_us;
+	bool is_initialized;
+} g_netcache;
+
+static void netcache_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userdata)
+{
+	UNUSED(curl);
+	UNUSED(access);
+	UNUSED(userdata);
+	pthread_mutex_lock(&g_netcache.share_locks[data]);
+}
+
+static void netcache_unlock(CURL *curl, curl_lock_data data, void *userdata)
+{
+	UNUSED(curl);
+	UNUSED(userdata);
+	pthread_mutex_unlock(&g_netcache.share_locks[data]);
+}
+
+Result netcache_init(void)
+{
+	if (g_netcache.is_initialized) return result_make_success();
+
+	CURLcode res = curl_global_init(CURL_GLOBAL_DEFAULT);
+	if (res != CURLE_OK) {
+		return result_make(false, "curl_global_init failed: %s", curl_easy_strerror(res));
+	}
+
+	for (size_t i=0; i < ARRAY_SIZE(g_netcache.share_locks); ++i) {
+		pthread_mutex_init(&g_netcache.share_locks[i], NULL);
+	}
+	pthread_mutex_init(&g_netcache.pool_lock, NULL);
+
+	g_netcache.share = curl_share_init();
+	if (g_netcache.share == NULL) {
+		return result_make(false, "curl_share_init failed");
+	}
+
+	curl_share_setopt(g_netcache.share, CURLSHOPT_LOCKFUNC  , netcache_lock);
+	curl_share_setopt(g_netcache.share, CURLSHOPT_UNLOCKFUNC, netcache_unlock);
+	curl_share_setopt(g_netcache.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(g_netcache.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+	CURLSHcode shres = curl_share_setopt(g_netcache.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+	if (shres != CURLSHE_OK) {
+		log_warning("curl connection pool not shared: %s\n", curl_share_strerror(shres));
+	}
+
+	g_netcache.is_initialized = true;
+	return result_make_success();
+}
+
+void netcache_destroy(void)
+{
+	if (!g_netcache.is_initialized) return;
+
+	pthread_mutex_lock(&g_netcache.pool_lock);
+	for (size_t i=0; i < g_netcache.idle_count; ++i) {
+		curl_easy_cleanup(g_netcache.idle_handles[i]);
+	}
+	g_netcache.idle_count = 0;
+	pthread_mutex_unlock(&g_netcache.pool_lock);
+
+	curl_share_cleanup(g_netcache.share);
+	curl_global_cleanup();
+	g_netcache.is_initialized = false;
+}
+
+CURL *netcache_acquire(void)
+{
+	CURL *curl = NULL;
+
+	pthread_mutex_lock(&g_netcache.pool_lock);
+	if (g_netcache.idle_count > 0) {
+		curl = g_netcache.idle_handles[--g_netcache.idle_count];
+	}
+	pthread_mutex_unlock(&g_netcache.pool_lock);
+
+	if (curl == NULL) {
+		curl = curl_easy_init();
+		if (curl == NULL) return NULL;
+	}
+
+	curl_easy_setopt(curl, CURLOPT_SHARE, g_netcache.share);
+	curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, NETCACHE_DNS_CACHE_TIMEOUT);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	return curl;
+}
+
+void netcache_release(CURL *curl)
+{
+	if (curl == NULL) return;
+
+	// resets the options only, connections and caches stay alive
+	curl_easy_reset(curl);
+
+	pthread_mutex_lock(&g_netcache.pool_lock);
+	if (g_netcache.idle_count < ARRAY_SIZE(g_netcache.idle_handles)) {
+		g_netcache.idle_handles[g_netcache.idle_count++] = curl;
+		curl = NULL;
+	}
+	pthread_mutex_unlock(&g_netcache.pool_lock);
+
+	if (curl != NULL) curl_easy_cleanup(curl);
+}
+
+void netcache_log_timings(CURL *curl)
+{
+	curl_off_t dns_us = 0, connect_us = 0, tls_us = 0, first_byte_us = 0;
+	long reused = 0;
+
+	curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T   , &dns_us);
+	curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T      , &connect_us);
+	curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T   , &tls_us);
+	curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us);
+	curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS        , &reused);
+
+	// all values are measured from the start, appconnect is 0 without tls
+	const double dns_ms     = (double) dns_us / 1000.0;
+	const double tcp_ms     = (double)(connect_us - dns_us) / 1000.0;
+	const double tls_ms     = (tls_us > 0) ? (double)(tls_us - connect_us) / 1000.0 : 0.0;
+	const uint64_t setup_us = (uint64_t) MAX(connect_us, tls_us);
+
+	// called from the curl write path, no lock and no blocking log
+	const uint64_t transfers      = atomic_fetch_add(&g_netcache.transfers, 1) + 1;
+	const uint64_t total_setup_us = atomic_fetch_add(&g_netcache.total_setup_us, setup_us) + setup_us;
+	const double avg_setup_ms     = (double) total_setup_us / (double) transfers / 1000.0;
+
+	metrics_add(METRICS_NET_TRANSFERS, 1);
+	if (reused == 0) metrics_add(METRICS_NET_REUSED_CONNECTIONS, 1);
+
+	rtlog_info("net: dns %.1f ms, tcp %.1f ms, tls %.1f ms, first byte %.1f ms%s (avg setup %.1f ms)\n",
+		dns_ms, tcp_ms, tls_ms, (double) first_byte_us / 1000.0,
+		(reused == 0) ? ", reused connection" : "", avg_setup_ms);
+}
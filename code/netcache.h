@@ -0,0 +1,33 @@
+#ifndef NETCACHE_H
+#define NETCACHE_H
+
+#include <curl/curl.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Process wide curl state, shared by all downloads.
+ *
+ * One CURLSH shares the DNS cache, TLS session ids and the connection pool
+ * between all easy handles. Easy handles are recycled instead of created per
+ * download, so switching back to a station resumes the TLS session and
+ * skips the DNS lookup.
+ */
+Result netcache_init(void);
+void   netcache_destroy(void);
+
+/**
+ * Returns a handle with default options and the share attached. Handles
+ * have to be given back with netcache_release(), not curl_easy_cleanup().
+ */
+CURL  *netcache_acquire(void);
+void   netcache_release(CURL *curl);
+
+/**
+ * Logs how long DNS, TCP and TLS took for the current transfer of the
+ * handle. Call once the first data arrived, it neither locks nor blocks
+ * on the log.
+ */
+void   netcache_log_timings(CURL *curl);
+
+#endif // NETCACHE_H
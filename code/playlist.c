@@ -0,0 +1,154 @@
+#include "playlist.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <curl/curl.h>
+
+#include "libcutils/util_makros.h"
+
+static const char *g_playlist_content_types[] = {
+	"audio/x-scpls",
+	"audio/scpls",
+	"audio/x-mpegurl",
+	"audio/mpegurl",
+	"application/x-mpegurl",
+	"application/vnd.apple.mpegurl",
+};
+
+static const char *g_playlist_extensions[] = {
+	".pls",
+	".m3u",
+	".m3u8",
+};
+
+static bool starts_with_nocase(const char *text, size_t size, const char *prefix)
+{
+	const size_t len = strlen(prefix);
+	return size >= len && strncasecmp(text, prefix, len) == 0;
+}
+
+static bool url_has_playlist_extension(const char *url)
+{
+	// only the path counts, not the query or fragment
+	const size_t path_len = strcspn(url, "?#");
+
+	for (size_t i=0; i < ARRAY_SIZE(g_playlist_extensions); ++i) {
+		const size_t ext_len = strlen(g_playlist_extensions[i]);
+
+		if (path_len >= ext_len &&
+		    strncasecmp(url+path_len-ext_len, g_playlist_extensions[i], ext_len) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool playlist_detect(const char *url, const char *content_type, const uint8_t *data, size_t size)
+{
+	if (content_type != NULL) {
+		for (size_t i=0; i < ARRAY_SIZE(g_playlist_content_types); ++i) {
+			const char *type = g_playlist_content_types[i];
+			if (starts_with_nocase(content_type, strlen(content_type), type)) return true;
+		}
+	}
+
+	const char *text = (const char*) data;
+	if (starts_with_nocase(text, size, "[playlist]") || starts_with_nocase(text, size, "#EXTM3U")) {
+		return true;
+	}
+
+	// servers often send plain playlists as text/plain or octet-stream
+	return url_has_playlist_extension(url) && !(size >= 2 && data[0] == 0xFF && (data[1] & 0xE0) == 0xE0);
+}
+
+const char *playlist_next_line(const char **text, size_t *len)
+{
+	const char *line = *text;
+	if (*line == '\0') return NULL;
+
+	const size_t line_len = strcspn(line, "\r\n");
+	*text = line + line_len;
+	*text += strspn(*text, "\r\n");
+
+	*len = line_len;
+	return line;
+}
+
+enum Playlist_Type playlist_get_type(const char *text)
+{
+	text += strspn(text, " \t\r\n");
+
+	if (starts_with_nocase(text, strlen(text), "[playlist]")) return PLAYLIST_TYPE_PLS;
+
+	if (!starts_with_nocase(text, strlen(text), "#EXTM3U")) {
+		return PLAYLIST_TYPE_M3U;
+	}
+
+	// an extended m3u is only hls if it has any of the hls tags
+	return (strstr(text, "#EXT-X-") != NULL) ? PLAYLIST_TYPE_HLS : PLAYLIST_TYPE_M3U;
+}
+
+bool playlist_resolve_url(const char *base_url, const char *ref, char *url, size_t url_size)
+{
+	CURLU *handle = curl_url();
+	if (handle == NULL) return false;
+
+	char *resolved = NULL;
+	bool success   = false;
+
+	// setting a relative url on top of an absolute one resolves it
+	if (curl_url_set(handle, CURLUPART_URL, base_url, 0) == CURLUE_OK &&
+	    curl_url_set(handle, CURLUPART_URL, ref, 0) == CURLUE_OK &&
+	    curl_url_get(handle, CURLUPART_URL, &resolved, 0) == CURLUE_OK) {
+		success = (size_t) snprintf(url, url_size, "%s", resolved) < url_size;
+	}
+
+	curl_free(resolved);
+	curl_url_cleanup(handle);
+	return success;
+}
+
+static bool playlist_copy_entry(const char *entry, size_t len, const char *base_url, char *url, size_t url_size)
+{
+	char ref[PLAYLIST_MAX_URL_LEN];
+
+	while (len > 0 && (entry[len-1] == ' ' || entry[len-1] == '\t')) --len;
+	if (len == 0 || len >= sizeof(ref)) return false;
+
+	memcpy(ref, entry, len);
+	ref[len] = '\0';
+
+	return playlist_resolve_url(base_url, ref, url, url_size);
+}
+
+bool playlist_get_first_entry(const char *text, const char *base_url, char *url, size_t url_size)
+{
+	const bool is_pls = (playlist_get_type(text) == PLAYLIST_TYPE_PLS);
+
+	const char *line = NULL;
+	size_t len = 0;
+
+	while ((line = playlist_next_line(&text, &len)) != NULL) {
+		const size_t indent = strspn(line, " \t");
+		line += MIN(indent, len);
+		len  -= MIN(indent, len);
+
+		if (is_pls) {
+			// File1=http://..., the entries are usually in order
+			if (!starts_with_nocase(line, len, "File")) continue;
+
+			const char *value = memchr(line, '=', len);
+			if (value == NULL) continue;
+
+			++value;
+			if (playlist_copy_entry(value, len - (size_t)(value - line), base_url, url, url_size)) return true;
+		}
+		else {
+			if (len == 0 || line[0] == '#') continue;
+			if (playlist_copy_entry(line, len, base_url, url, url_size)) return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,40 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PLAYLIST_MAX_SIZE    (64*1024)
+#define PLAYLIST_MAX_URL_LEN 2048
+
+enum Playlist_Type {
+	PLAYLIST_TYPE_NONE,
+	PLAYLIST_TYPE_PLS,
+	PLAYLIST_TYPE_M3U,
+	PLAYLIST_TYPE_HLS,
+};
+
+/**
+ * Tells from the url, the content type and the first received bytes whether
+ * a response is a playlist instead of audio. content_type may be NULL.
+ */
+bool playlist_detect(const char *url, const char *content_type, const uint8_t *data, size_t size);
+
+enum Playlist_Type playlist_get_type(const char *text);
+
+/**
+ * Copies the first entry of a .pls or .m3u playlist into url, relative
+ * entries are resolved against base_url.
+ */
+bool playlist_get_first_entry(const char *text, const char *base_url, char *url, size_t url_size);
+
+bool playlist_resolve_url(const char *base_url, const char *ref, char *url, size_t url_size);
+
+/**
+ * Iterates over the lines of text, returns NULL at the end. The returned
+ * line is not terminated, its length is stored in len without line breaks.
+ */
+const char *playlist_next_line(const char **text, size_t *len);
+
+#endif // PLAYLIST_H
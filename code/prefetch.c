@@ -0,0 +1,264 @@
+#include "prefetch.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL3/SDL.h>
+
+#include "config.h"
+#include "mpegframe.h"
+#include "netcache.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define PREFETCH_SLOTS            2
+#define PREFETCH_RETRY_DELAY_MS   5000
+#define PREFETCH_MAX_URL_LEN      2048
+
+struct Prefetch_Slot {
+	char url[PREFETCH_MAX_URL_LEN];
+	pthread_t thread;
+	bool is_running;
+
+	pthread_mutex_t lock;
+	bool quit;
+
+	// only touched by the slot thread while it is running
+	struct Mpeg_Framer framer;
+	uint8_t *window;
+	size_t window_size;
+	size_t window_used;
+};
+
+static struct Prefetch_Slot g_slots[PREFETCH_SLOTS];
+static bool g_is_initialized = false;
+
+static bool prefetch_should_quit(struct Prefetch_Slot *slot)
+{
+	pthread_mutex_lock(&slot->lock);
+	const bool quit = slot->quit;
+	pthread_mutex_unlock(&slot->lock);
+	return quit;
+}
+
+static void prefetch_window_append(struct Prefetch_Slot *slot, const uint8_t *frames, size_t size)
+{
+	if (size > slot->window_size) {
+		frames += size - slot->window_size;
+		size    = slot->window_size;
+	}
+
+	// drop the oldest frames as a whole, the window has to stay frame aligned
+	size_t drop = 0;
+	while (slot->window_used - drop + size > slot->window_size) {
+		struct Mpeg_Frame_Header header;
+
+		if (slot->window_used - drop >= MPEG_FRAME_HEADER_SIZE &&
+		    mpegframe_parse_header(slot->window+drop, &header)) {
+			drop += MIN(header.frame_size, slot->window_used - drop);
+		}
+		else {
+			drop = slot->window_used - (slot->window_size - size);
+		}
+	}
+
+	memmove(slot->window, slot->window+drop, slot->window_used-drop);
+	slot->window_used -= drop;
+
+	memcpy(slot->window+slot->window_used, frames, size);
+	slot->window_used += size;
+}
+
+static size_t prefetch_write_callback(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	struct Prefetch_Slot *slot = userdata;
+	const size_t bytes_total   = size * nmemb;
+	size_t       bytes_taken   = 0;
+
+	if (prefetch_should_quit(slot)) return CURL_WRITEFUNC_ERROR;
+
+	while (bytes_taken < bytes_total) {
+		bytes_taken += mpeg_framer_push(&slot->framer, (uint8_t*)ptr+bytes_taken, bytes_total-bytes_taken);
+
+		size_t bytes_ready = 0;
+		const uint8_t *frames = mpeg_framer_ready(&slot->framer, &bytes_ready);
+
+		prefetch_window_append(slot, frames, bytes_ready);
+		mpeg_framer_consume(&slot->framer, bytes_ready);
+	}
+	return bytes_taken;
+}
+
+static int prefetch_progress_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	UNUSED(dltotal);
+	UNUSED(dlnow);
+	UNUSED(ultotal);
+	UNUSED(ulnow);
+
+	return prefetch_should_quit(userdata) ? 1 : 0;
+}
+
+static void *prefetch_thread(void *arg)
+{
+	struct Prefetch_Slot *slot = arg;
+
+	CURL *curl = netcache_acquire();
+	if (curl == NULL) {
+		log_error("prefetch: curl init failed\n");
+		return NULL;
+	}
+
+	// the cap keeps standby stations from competing with the playing one
+	const curl_off_t max_bytes_per_sec = (curl_off_t) g_config.radio_prefetch_rate_kbps * 1000 / 8;
+
+	curl_easy_setopt(curl, CURLOPT_URL, slot->url);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, prefetch_write_callback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, slot);
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, prefetch_progress_callback);
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, slot);
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "DuckAI/1.0");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L);
+	curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, max_bytes_per_sec);
+
+	log_debug("prefetch: start %s\n", slot->url);
+
+	while (!prefetch_should_quit(slot)) {
+		mpeg_framer_reset(&slot->framer);
+
+		CURLcode res = curl_easy_perform(curl);
+		if (prefetch_should_quit(slot)) break;
+
+		log_debug("prefetch: %s ended (%s), retrying\n", slot->url, curl_easy_strerror(res));
+
+		for (int waited = 0; waited < PREFETCH_RETRY_DELAY_MS && !prefetch_should_quit(slot); waited += 50) {
+			SDL_Delay(50);
+		}
+	}
+
+	netcache_release(curl);
+	return NULL;
+}
+
+static void prefetch_init(void)
+{
+	for (size_t i=0; i < ARRAY_SIZE(g_slots); ++i) {
+		pthread_mutex_init(&g_slots[i].lock, NULL);
+	}
+	g_is_initialized = true;
+}
+
+static void prefetch_stop(struct Prefetch_Slot *slot)
+{
+	if (!slot->is_running) return;
+
+	pthread_mutex_lock(&slot->lock);
+	slot->quit = true;
+	pthread_mutex_unlock(&slot->lock);
+
+	pthread_join(slot->thread, NULL);
+	slot->is_running = false;
+
+	log_debug("prefetch: stopped %s\n", slot->url);
+}
+
+static void prefetch_start(struct Prefetch_Slot *slot, const char *url)
+{
+	slot->window_size = (size_t) g_config.radio_prefetch_buffer_kb * 1024;
+
+	if (slot->window == NULL) {
+		slot->window = malloc(slot->window_size);
+		if (slot->window == NULL) {
+			log_error("prefetch: unable to allocate %zu bytes\n", slot->window_size);
+			return;
+		}
+	}
+
+	snprintf(slot->url, sizeof(slot->url), "%s", url);
+	slot->window_used = 0;
+	slot->quit        = false;
+	mpeg_framer_reset(&slot->framer);
+
+	if (pthread_create(&slot->thread, NULL, prefetch_thread, slot) != 0) {
+		log_error("prefetch: failed to start thread for %s\n", url);
+		return;
+	}
+	slot->is_running = true;
+}
+
+static struct Prefetch_Slot *prefetch_find(const char *url)
+{
+	for (size_t i=0; i < ARRAY_SIZE(g_slots); ++i) {
+		if (g_slots[i].is_running && strcmp(g_slots[i].url, url) == 0) {
+			return &g_slots[i];
+		}
+	}
+	return NULL;
+}
+
+void prefetch_set_neighbours(const char *prev_url, const char *next_url)
+{
+	if (!g_config.radio_prefetch) return;
+	if (!g_is_initialized) prefetch_init();
+
+	const char *wanted[PREFETCH_SLOTS] = {prev_url, next_url};
+
+	// keep the connections which are still wanted, stop the others
+	for (size_t i=0; i < ARRAY_SIZE(g_slots); ++i) {
+		struct Prefetch_Slot *slot = &g_slots[i];
+		if (!slot->is_running) continue;
+
+		bool is_wanted = false;
+		for (size_t k=0; k < ARRAY_SIZE(wanted); ++k) {
+			if (wanted[k] != NULL && strcmp(slot->url, wanted[k]) == 0) is_wanted = true;
+		}
+		if (!is_wanted) prefetch_stop(slot);
+	}
+
+	for (size_t k=0; k < ARRAY_SIZE(wanted); ++k) {
+		if (wanted[k] == NULL || prefetch_find(wanted[k]) != NULL) continue;
+
+		for (size_t i=0; i < ARRAY_SIZE(g_slots); ++i) {
+			if (!g_slots[i].is_running) {
+				prefetch_start(&g_slots[i], wanted[k]);
+				break;
+			}
+		}
+	}
+}
+
+void prefetch_stop_all(void)
+{
+	if (!g_is_initialized) return;
+
+	for (size_t i=0; i < ARRAY_SIZE(g_slots); ++i) {
+		prefetch_stop(&g_slots[i]);
+	}
+}
+
+bool prefetch_take(const char *url, void **data, size_t *size)
+{
+	if (!g_is_initialized) return false;
+
+	struct Prefetch_Slot *slot = prefetch_find(url);
+	if (slot == NULL) return false;
+
+	prefetch_stop(slot);
+
+	if (slot->window_used == 0) return false;
+
+	// hand over the window itself, the slot allocates a new one when needed
+	*data = slot->window;
+	*size = slot->window_used;
+	slot->window      = NULL;
+	slot->window_used = 0;
+	return true;
+}
@@ -0,0 +1,26 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Warm standby connections for the stations around the playing one.
+ *
+ * Each standby station is downloaded with a capped rate into a window of the
+ * newest radio_prefetch_buffer_kb bytes. When the user switches to it, the
+ * window is handed over and playback starts from already buffered audio
+ * while the real connection is being set up.
+ *
+ * Disabled unless radio_prefetch is set in the config.
+ */
+void prefetch_set_neighbours(const char *prev_url, const char *next_url);
+void prefetch_stop_all(void);
+
+/**
+ * Stops the standby connection of url and returns its buffered frames, to
+ * be freed by the caller. Returns false if url was not prefetched.
+ */
+bool prefetch_take(const char *url, void **data, size_t *size);
+
+#endif // PREFETCH_H
@@ -0,0 +1,335 @@
+#include "recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <SDL3/SDL.h>
+
+#include "config.h"
+#include "rtlog.h"
+#include "spsc_ring.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+// 100 seconds at 320 kbit/s, enough to ride out a stalling sd card
+#define RECORDER_RING_SIZE       (4*1024*1024)
+#define RECORDER_WRITE_SIZE      (64*1024)
+#define RECORDER_WRITEBACK_SIZE  (1024*1024)
+#define RECORDER_MAX_SPLITS      8
+#define RECORDER_POLL_MS         100
+#define RECORDER_WAIT_MS         1
+
+struct Recorder_Split {
+	size_t pos;              // of the first byte of the new file
+	char title[256];
+};
+
+struct Recorder_File {
+	int fd;
+	off_t size;
+	off_t written_back;
+};
+
+static struct {
+	struct Spsc_Ring ring;
+	pthread_t thread;
+	bool is_running;              // until joined, the writer may still flush
+	_Atomic bool is_finished;     // the writer closed the last file and returns
+
+	/*
+	 * The download thread enters as a writer and checks is_active, stopping
+	 * clears is_active and waits until no writer is inside. That is only a
+	 * memcpy, the download thread itself never waits.
+	 */
+	_Atomic bool is_active;
+	_Atomic int writers;
+	_Atomic bool quit;            // set after the last writer left
+	_Atomic size_t bytes_recorded;
+	_Atomic size_t bytes_dropped;
+	_Atomic size_t titles_dropped;
+
+	// single producer (the download thread), single consumer (the writer)
+	struct Recorder_Split splits[RECORDER_MAX_SPLITS];
+	_Atomic size_t split_head;
+	_Atomic size_t split_tail;
+
+	// set before the writer thread starts
+	char station[128];
+	char dir[PATH_MAX];
+} g_recorder;
+
+/** Keeps file names valid on the FAT formatted sd cards as well. */
+static void recorder_clean_name(char *name)
+{
+	for (char *c = name; *c != '\0'; ++c) {
+		if ((unsigned char)*c < 0x20 || strchr("/\\:*?\"<>|", *c) != NULL) *c = '_';
+	}
+}
+
+static void recorder_open(struct Recorder_File *file, const char *title)
+{
+	char stamp[32];
+	const time_t now = time(NULL);
+	struct tm local;
+	localtime_r(&now, &local);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H.%M.%S", &local);
+
+	char name[256];
+	if (title[0] != '\0') {
+		snprintf(name, sizeof(name), "%s %.60s - %.120s", stamp, g_recorder.station, title);
+	}
+	else {
+		snprintf(name, sizeof(name), "%s %.60s", stamp, g_recorder.station);
+	}
+	recorder_clean_name(name);
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s.mp3", g_recorder.dir, name);
+
+	file->fd           = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	file->size         = 0;
+	file->written_back = 0;
+
+	if (file->fd < 0) {
+		log_error("recorder: unable to create %s: %s\n", path, strerror(errno));
+		return;
+	}
+	log_info("recorder: writing %s\n", path);
+}
+
+static void recorder_close(struct Recorder_File *file)
+{
+	if (file->fd < 0) return;
+
+	close(file->fd);
+	file->fd = -1;
+}
+
+static bool recorder_write_all(struct Recorder_File *file, const uint8_t *data, size_t size)
+{
+	while (size > 0) {
+		const ssize_t written = write(file->fd, data, size);
+		if (written < 0 && errno == EINTR) continue;
+
+		if (written < 0) {
+			log_error("recorder: write failed: %s\n", strerror(errno));
+			return false;
+		}
+		data       += written;
+		size       -= (size_t) written;
+		file->size += written;
+	}
+
+	// starts the writeback early and keeps recordings out of the page
+	// cache, so the dirty pages never pile up into one long stall
+	if (file->size - file->written_back >= RECORDER_WRITEBACK_SIZE) {
+		posix_fadvise(file->fd, file->written_back, file->size - file->written_back, POSIX_FADV_DONTNEED);
+		file->written_back = file->size;
+	}
+	return true;
+}
+
+static void *recorder_thread(void *arg)
+{
+	UNUSED(arg);
+
+	struct Recorder_File file = { .fd = -1 };
+	size_t pos = 0;
+
+	for (;;) {
+		// quit first, nothing is written into the ring once it is set
+		const bool quit   = atomic_load(&g_recorder.quit);
+		const size_t used = spsc_ring_bytes_used(&g_recorder.ring);
+
+		if (quit && used == 0) break;
+
+		size_t tail = atomic_load_explicit(&g_recorder.split_tail, memory_order_relaxed);
+		const size_t head = atomic_load_explicit(&g_recorder.split_head, memory_order_acquire);
+		const bool has_split = (tail != head);
+		const struct Recorder_Split *split = &g_recorder.splits[tail % RECORDER_MAX_SPLITS];
+
+		if (has_split && split->pos == pos) {
+			// titles without audio in between only leave the last one
+			while (tail+1 != head && g_recorder.splits[(tail+1) % RECORDER_MAX_SPLITS].pos == pos) {
+				tail++;
+			}
+			split = &g_recorder.splits[tail % RECORDER_MAX_SPLITS];
+
+			recorder_close(&file);
+			recorder_open(&file, split->title);
+			atomic_store_explicit(&g_recorder.split_tail, tail+1, memory_order_release);
+			continue;
+		}
+
+		size_t size = 0;
+		const uint8_t *data = spsc_ring_peek(&g_recorder.ring, &size);
+		if (has_split) size = MIN(size, split->pos - pos);
+
+		// small writes only before a new file starts or at the end
+		const bool is_due = quit || (has_split && split->pos - pos <= used);
+		if (size == 0 || (used < RECORDER_WRITE_SIZE && !is_due)) {
+			SDL_Delay(RECORDER_POLL_MS);
+			continue;
+		}
+
+		// written straight from the ring, a failed file is dropped until the next one
+		if (file.fd >= 0 && !recorder_write_all(&file, data, size)) {
+			recorder_close(&file);
+		}
+		spsc_ring_consume(&g_recorder.ring, size);
+		pos += size;
+	}
+
+	recorder_close(&file);
+
+	// the final flush is not waited for, so the summary comes from here
+	const size_t bytes_dropped  = atomic_load(&g_recorder.bytes_dropped);
+	const size_t titles_dropped = atomic_load(&g_recorder.titles_dropped);
+	if (bytes_dropped > 0) {
+		log_warning("recorder: %zu bytes dropped, the disk was too slow\n", bytes_dropped);
+	}
+	if (titles_dropped > 0) {
+		log_warning("recorder: %zu title changes without a new file, too many at once\n", titles_dropped);
+	}
+	log_info("recorder: stopped after %zu bytes\n", atomic_load(&g_recorder.bytes_recorded));
+	atomic_store(&g_recorder.is_finished, true);
+	return NULL;
+}
+
+/** Only by the producer, the download thread or recorder_start() before it. */
+static void recorder_queue_split(const char *title)
+{
+	const size_t head = atomic_load_explicit(&g_recorder.split_head, memory_order_relaxed);
+	const size_t tail = atomic_load_explicit(&g_recorder.split_tail, memory_order_acquire);
+
+	if (head - tail >= RECORDER_MAX_SPLITS) {
+		atomic_fetch_add(&g_recorder.titles_dropped, 1);
+		return;
+	}
+
+	struct Recorder_Split *split = &g_recorder.splits[head % RECORDER_MAX_SPLITS];
+	split->pos = atomic_load_explicit(&g_recorder.bytes_recorded, memory_order_relaxed);
+	snprintf(split->title, sizeof(split->title), "%s", title);
+
+	atomic_store_explicit(&g_recorder.split_head, head+1, memory_order_release);
+}
+
+/** The writer thread finishes the last file in the background. */
+static void recorder_join(void)
+{
+	if (!g_recorder.is_running) return;
+
+	pthread_join(g_recorder.thread, NULL);
+	g_recorder.is_running = false;
+}
+
+Result recorder_start(const char *station, const char *title)
+{
+	recorder_stop();
+
+	// the ring is shared, but joining a writer which still flushes up to
+	// RECORDER_RING_SIZE to a slow card would stall the render thread
+	if (g_recorder.is_running && !atomic_load(&g_recorder.is_finished)) {
+		return result_make(false, "the last recording is still being written");
+	}
+	recorder_join();
+
+	Result r = config_get_recordings_path(g_recorder.dir, sizeof(g_recorder.dir));
+	if (!r.success) return r;
+
+	if (g_recorder.ring.data == NULL) {
+		r = spsc_ring_init(&g_recorder.ring, RECORDER_RING_SIZE);
+		if (!r.success) return r;
+	}
+
+	// no writer is inside while is_active is false
+	spsc_ring_reset(&g_recorder.ring);
+	snprintf(g_recorder.station, sizeof(g_recorder.station), "%s", station);
+	atomic_store(&g_recorder.quit, false);
+	atomic_store(&g_recorder.bytes_recorded, 0);
+	atomic_store(&g_recorder.bytes_dropped, 0);
+	atomic_store(&g_recorder.titles_dropped, 0);
+	atomic_store(&g_recorder.split_head, 0);
+	atomic_store(&g_recorder.split_tail, 0);
+	recorder_queue_split(title);
+
+	atomic_store(&g_recorder.is_finished, false);
+	if (pthread_create(&g_recorder.thread, NULL, recorder_thread, NULL) != 0) {
+		return result_make(false, "unable to start the recorder thread");
+	}
+	g_recorder.is_running = true;
+	atomic_store(&g_recorder.is_active, true);
+	return result_make_success();
+}
+
+void recorder_stop(void)
+{
+	if (!atomic_exchange(&g_recorder.is_active, false)) return;
+
+	// a writer which saw is_active is in the middle of a memcpy at most
+	while (atomic_load(&g_recorder.writers) > 0) {
+		SDL_Delay(RECORDER_WAIT_MS);
+	}
+
+	// the writer empties the ring and closes the file by itself
+	atomic_store(&g_recorder.quit, true);
+}
+
+void recorder_finish(void)
+{
+	recorder_stop();
+	recorder_join();
+}
+
+bool recorder_is_active(void)
+{
+	return atomic_load(&g_recorder.is_active);
+}
+
+/** Enters as a writer, returns false if the recording is not active. */
+static bool recorder_enter(void)
+{
+	atomic_fetch_add(&g_recorder.writers, 1);
+	if (atomic_load(&g_recorder.is_active)) return true;
+
+	atomic_fetch_sub(&g_recorder.writers, 1);
+	return false;
+}
+
+static void recorder_leave(void)
+{
+	atomic_fetch_sub(&g_recorder.writers, 1);
+}
+
+void recorder_write(const uint8_t *frames, size_t size)
+{
+	if (!atomic_load_explicit(&g_recorder.is_active, memory_order_relaxed) || size == 0) return;
+	if (!recorder_enter()) return;
+
+	// all or nothing, so the file never contains a cut frame
+	if (spsc_ring_bytes_free(&g_recorder.ring) >= size) {
+		spsc_ring_write(&g_recorder.ring, frames, size);
+		atomic_fetch_add_explicit(&g_recorder.bytes_recorded, size, memory_order_relaxed);
+	}
+	else {
+		if (atomic_fetch_add(&g_recorder.bytes_dropped, size) == 0) rtlog_warning("recorder: disk too slow, dropping audio\n");
+	}
+	recorder_leave();
+}
+
+void recorder_split(const char *title)
+{
+	if (!atomic_load_explicit(&g_recorder.is_active, memory_order_relaxed)) return;
+	if (!recorder_enter()) return;
+
+	recorder_queue_split(title);
+	recorder_leave();
+}
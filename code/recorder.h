@@ -0,0 +1,38 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Records the playing radio stream to mp3 files, as received and without
+ * re-encoding.
+ *
+ * The download thread copies the frames it already has into a lock-free
+ * ring and never takes a lock, a writer thread empties it with large writes
+ * straight from the ring memory. A slow disk only fills the ring, if it
+ * overflows frames are dropped from the recording instead of stalling the
+ * download.
+ *
+ * Files are named after the station and split on every title change.
+ */
+/** Fails while the writer still flushes the previous recording. */
+Result recorder_start(const char *station, const char *title);
+
+/** Returns right away, the writer thread flushes the rest in the background. */
+void   recorder_stop(void);
+
+/** Stops and waits until the last file is written, for the shutdown. */
+void   recorder_finish(void);
+bool   recorder_is_active(void);
+
+/** Called by the download thread with whole frames. Never blocks on IO. */
+void   recorder_write(const uint8_t *frames, size_t size);
+
+/** Starts a new file at the current position of the recording. */
+void   recorder_split(const char *title);
+
+#endif // RECORDER_H
@@ -0,0 +1,420 @@
+#include "relay.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "rtlog.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+// about a minute at 128 kbit/s
+#define RELAY_RING_SIZE          (1024*1024)
+// clients stay this far away from the writer, no single write is larger
+#define RELAY_GUARD_SIZE         (256*1024)
+#define RELAY_BURST_SIZE         (64*1024)
+#define RELAY_MAX_MARKS          64
+#define RELAY_MAX_CLIENTS        16
+#define RELAY_MAX_REQUEST_SIZE   4096
+#define RELAY_MAX_SEND_SIZE      (64*1024)
+#define RELAY_POLL_MS            500
+
+#define RELAY_RESPONSE_HEADER \
+	"HTTP/1.0 200 OK\r\n" \
+	"Content-Type: audio/mpeg\r\n" \
+	"Cache-Control: no-cache\r\n" \
+	"icy-name: ShardOS relay\r\n" \
+	"\r\n"
+
+#define RELAY_RESPONSE_BAD_REQUEST \
+	"HTTP/1.0 400 Bad Request\r\n" \
+	"Content-Length: 0\r\n" \
+	"\r\n"
+
+enum Relay_Client_State {
+	RELAY_CLIENT_FREE,
+	RELAY_CLIENT_READING_REQUEST,
+	RELAY_CLIENT_SENDING_HEADER,
+	RELAY_CLIENT_STREAMING,
+};
+
+struct Relay_Client {
+	enum Relay_Client_State state;
+	int fd;
+	bool is_blocked;           // until the socket is writable again
+	char request[RELAY_MAX_REQUEST_SIZE];
+	size_t request_used;
+	const char *header;
+	size_t header_sent;
+	bool close_after_header;
+	uint64_t pos;              // in the stream, of the next byte to send
+};
+
+static struct {
+	uint8_t *data;
+	_Atomic uint64_t reserved;    // end of the write in progress
+	_Atomic uint64_t head;        // end of the completed writes
+	_Atomic uint64_t marks[RELAY_MAX_MARKS];  // start of recent writes, frame aligned
+	_Atomic uint64_t mark_count;
+
+	pthread_t thread;
+	_Atomic bool is_running;
+	_Atomic bool quit;
+	int listen_fd;
+	int wake_fd;
+	int epoll_fd;
+
+	// only touched by the relay thread
+	struct Relay_Client clients[RELAY_MAX_CLIENTS];
+} g_relay = {
+	.listen_fd = -1,
+	.wake_fd   = -1,
+	.epoll_fd  = -1,
+};
+
+/**
+ * The position a new client starts at: the start of a write about a burst
+ * back, so its player has something to buffer right away.
+ */
+static uint64_t relay_get_start_pos(void)
+{
+	const uint64_t head  = atomic_load(&g_relay.head);
+	const uint64_t count = atomic_load(&g_relay.mark_count);
+	uint64_t pos = head;
+
+	for (uint64_t i = 0; i < MIN(count, (uint64_t) RELAY_MAX_MARKS); ++i) {
+		const uint64_t mark = atomic_load(&g_relay.marks[(count-1-i) % RELAY_MAX_MARKS]);
+		if (mark + RELAY_BURST_SIZE < head) break;
+		if (mark < pos && head - mark <= RELAY_RING_SIZE - RELAY_GUARD_SIZE) pos = mark;
+	}
+	return pos;
+}
+
+static void relay_close_client(struct Relay_Client *client)
+{
+	epoll_ctl(g_relay.epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	client->state = RELAY_CLIENT_FREE;
+	client->fd    = -1;
+	log_info("relay: client disconnected\n");
+}
+
+static void relay_accept(void)
+{
+	for (;;) {
+		const int fd = accept(g_relay.listen_fd, NULL, NULL);
+		if (fd < 0) return;
+
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		struct Relay_Client *client = NULL;
+		for (size_t i = 0; i < ARRAY_SIZE(g_relay.clients) && client == NULL; ++i) {
+			if (g_relay.clients[i].state == RELAY_CLIENT_FREE) client = &g_relay.clients[i];
+		}
+
+		if (client == NULL) {
+			log_warning("relay: more than %d clients, refusing\n", RELAY_MAX_CLIENTS);
+			close(fd);
+			continue;
+		}
+
+		memset(client, 0, sizeof(*client));
+		client->fd    = fd;
+		client->state = RELAY_CLIENT_READING_REQUEST;
+
+		struct epoll_event event = {
+			.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+			.data.ptr = client,
+		};
+		if (epoll_ctl(g_relay.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			log_error("relay: unable to watch client: %s\n", strerror(errno));
+			close(fd);
+			client->state = RELAY_CLIENT_FREE;
+			continue;
+		}
+		log_info("relay: client connected\n");
+	}
+}
+
+static void relay_read_request(struct Relay_Client *client)
+{
+	for (;;) {
+		char *dst        = client->request + client->request_used;
+		const size_t max = sizeof(client->request) - client->request_used - 1;
+
+		const ssize_t received = recv(client->fd, dst, max, 0);
+		if (received < 0 && errno == EAGAIN) return;
+		if (received <= 0 || (size_t) received == max) {
+			relay_close_client(client);
+			return;
+		}
+
+		client->request_used += (size_t) received;
+		client->request[client->request_used] = '\0';
+
+		if (strstr(client->request, "\r\n\r\n") != NULL) break;
+	}
+
+	const bool is_get = (strncmp(client->request, "GET ", 4) == 0);
+
+	client->header             = is_get ? RELAY_RESPONSE_HEADER : RELAY_RESPONSE_BAD_REQUEST;
+	client->header_sent        = 0;
+	client->close_after_header = !is_get;
+	client->pos                = relay_get_start_pos();
+	client->state              = RELAY_CLIENT_SENDING_HEADER;
+}
+
+/** Returns false if the client was closed. */
+static bool relay_send_header(struct Relay_Client *client)
+{
+	const size_t size = strlen(client->header);
+
+	while (client->header_sent < size) {
+		const ssize_t sent = send(client->fd, client->header+client->header_sent, size-client->header_sent, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EAGAIN) {
+			client->is_blocked = true;
+			return true;
+		}
+		if (sent < 0) {
+			relay_close_client(client);
+			return false;
+		}
+		client->header_sent += (size_t) sent;
+	}
+
+	if (client->close_after_header) {
+		relay_close_client(client);
+		return false;
+	}
+	client->state = RELAY_CLIENT_STREAMING;
+	return true;
+}
+
+static void relay_send_stream(struct Relay_Client *client)
+{
+	for (;;) {
+		const uint64_t head = atomic_load(&g_relay.head);
+
+		// a client this far behind would be overtaken by the writer
+		if (head - client->pos > RELAY_RING_SIZE - RELAY_GUARD_SIZE) {
+			log_debug("relay: client too slow, skipping %llu bytes\n", (unsigned long long)(head - client->pos));
+			client->pos = head;
+		}
+		if (client->pos == head) return;
+
+		const size_t offset = (size_t)(client->pos % RELAY_RING_SIZE);
+		const size_t size   = (size_t) MIN(head - client->pos, (uint64_t) MIN(RELAY_RING_SIZE - offset, RELAY_MAX_SEND_SIZE));
+
+		const ssize_t sent = send(client->fd, g_relay.data+offset, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EAGAIN) {
+			client->is_blocked = true;
+			return;
+		}
+		if (sent <= 0) {
+			relay_close_client(client);
+			return;
+		}
+
+		// the guard makes this impossible unless the thread was stalled for
+		// most of the ring, the data sent might be torn then
+		atomic_thread_fence(memory_order_seq_cst);
+		if (atomic_load(&g_relay.reserved) > client->pos + RELAY_RING_SIZE) {
+			log_warning("relay: client overtaken by the stream, closing\n");
+			relay_close_client(client);
+			return;
+		}
+		client->pos += (uint64_t) sent;
+	}
+}
+
+static void relay_serve(struct Relay_Client *client)
+{
+	if (client->state == RELAY_CLIENT_FREE || client->is_blocked) return;
+
+	if (client->state == RELAY_CLIENT_SENDING_HEADER && !relay_send_header(client)) return;
+	if (client->state == RELAY_CLIENT_STREAMING) relay_send_stream(client);
+}
+
+static void *relay_thread(void *arg)
+{
+	UNUSED(arg);
+	struct epoll_event events[RELAY_MAX_CLIENTS+2];
+
+	while (!atomic_load(&g_relay.quit)) {
+		const int count = epoll_wait(g_relay.epoll_fd, events, (int) ARRAY_SIZE(events), RELAY_POLL_MS);
+
+		for (int i = 0; i < count; ++i) {
+			if (events[i].data.ptr == &g_relay.listen_fd) {
+				relay_accept();
+				continue;
+			}
+			if (events[i].data.ptr == &g_relay.wake_fd) {
+				uint64_t value;
+				if (read(g_relay.wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+					log_debug("relay: unable to read the wake up: %s\n", strerror(errno));
+				}
+				continue;
+			}
+
+			struct Relay_Client *client = events[i].data.ptr;
+			if (client->state == RELAY_CLIENT_FREE) continue;
+
+			if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+				relay_close_client(client);
+				continue;
+			}
+			if (events[i].events & EPOLLOUT) client->is_blocked = false;
+			if ((events[i].events & EPOLLIN) && client->state == RELAY_CLIENT_READING_REQUEST) {
+				relay_read_request(client);
+			}
+		}
+
+		// new data or writable sockets, every client is served from the ring
+		for (size_t i = 0; i < ARRAY_SIZE(g_relay.clients); ++i) {
+			relay_serve(&g_relay.clients[i]);
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_relay.clients); ++i) {
+		if (g_relay.clients[i].state != RELAY_CLIENT_FREE) relay_close_client(&g_relay.clients[i]);
+	}
+	return NULL;
+}
+
+static void relay_close_fds(void)
+{
+	if (g_relay.epoll_fd >= 0) close(g_relay.epoll_fd);
+	if (g_relay.listen_fd >= 0) close(g_relay.listen_fd);
+
+	g_relay.epoll_fd  = -1;
+	g_relay.listen_fd = -1;
+}
+
+static Result relay_open_fds(int port)
+{
+	g_relay.listen_fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (g_relay.listen_fd < 0) {
+		return result_make(false, "unable to create socket: %s", strerror(errno));
+	}
+
+	// dual stack, v4 clients arrive as mapped addresses
+	const int off = 0;
+	const int on  = 1;
+	setsockopt(g_relay.listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+	setsockopt(g_relay.listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in6 addr = {
+		.sin6_family = AF_INET6,
+		.sin6_port   = htons((uint16_t) port),
+		.sin6_addr   = IN6ADDR_ANY_INIT,
+	};
+	if (bind(g_relay.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(g_relay.listen_fd, 8) != 0) {
+		return result_make(false, "unable to listen on port %d: %s", port, strerror(errno));
+	}
+
+	// kept open for good, the download thread may still be about to use it
+	if (g_relay.wake_fd < 0) g_relay.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	g_relay.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (g_relay.wake_fd < 0 || g_relay.epoll_fd < 0) {
+		return result_make(false, "unable to create the event loop: %s", strerror(errno));
+	}
+
+	struct epoll_event listen_event = { .events = EPOLLIN, .data.ptr = &g_relay.listen_fd };
+	struct epoll_event wake_event   = { .events = EPOLLIN, .data.ptr = &g_relay.wake_fd };
+
+	if (epoll_ctl(g_relay.epoll_fd, EPOLL_CTL_ADD, g_relay.listen_fd, &listen_event) != 0 ||
+	    epoll_ctl(g_relay.epoll_fd, EPOLL_CTL_ADD, g_relay.wake_fd, &wake_event) != 0) {
+		return result_make(false, "unable to watch the sockets: %s", strerror(errno));
+	}
+	return result_make_success();
+}
+
+Result relay_start(int port)
+{
+	if (atomic_load(&g_relay.is_running)) return result_make_success();
+
+	if (g_relay.data == NULL) {
+		g_relay.data = malloc(RELAY_RING_SIZE);
+		if (g_relay.data == NULL) {
+			return result_make(false, "unable to allocate relay ring of %d bytes", RELAY_RING_SIZE);
+		}
+	}
+
+	Result r = relay_open_fds(port);
+	if (!r.success) {
+		relay_close_fds();
+		return r;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_relay.clients); ++i) {
+		g_relay.clients[i].state = RELAY_CLIENT_FREE;
+		g_relay.clients[i].fd    = -1;
+	}
+	atomic_store(&g_relay.quit, false);
+
+	if (pthread_create(&g_relay.thread, NULL, relay_thread, NULL) != 0) {
+		relay_close_fds();
+		return result_make(false, "unable to start the relay thread");
+	}
+	atomic_store(&g_relay.is_running, true);
+
+	log_info("relay: serving the radio stream on port %d\n", port);
+	return result_make_success();
+}
+
+void relay_stop(void)
+{
+	if (!atomic_load(&g_relay.is_running)) return;
+
+	atomic_store(&g_relay.quit, true);
+	const uint64_t wake = 1;
+	if (write(g_relay.wake_fd, &wake, sizeof(wake)) < 0) {
+		log_debug("relay: unable to wake the thread, waiting for its timeout\n");
+	}
+
+	pthread_join(g_relay.thread, NULL);
+	atomic_store(&g_relay.is_running, false);
+	relay_close_fds();
+}
+
+void relay_write(const uint8_t *frames, size_t size)
+{
+	if (!atomic_load(&g_relay.is_running) || size == 0) return;
+
+	// larger writes would reach into the data of clients inside the guard,
+	// the framer never hands out that much at once
+	if (size > RELAY_GUARD_SIZE) {
+		rtlog_warning("relay: dropping %zu bytes written at once\n", size);
+		return;
+	}
+
+	const uint64_t head = atomic_load_explicit(&g_relay.head, memory_order_relaxed);
+	atomic_store(&g_relay.reserved, head + size);
+
+	const size_t offset = (size_t)(head % RELAY_RING_SIZE);
+	const size_t first  = MIN(size, RELAY_RING_SIZE - offset);
+	memcpy(g_relay.data + offset, frames, first);
+	memcpy(g_relay.data, frames + first, size - first);
+
+	const uint64_t mark = atomic_load_explicit(&g_relay.mark_count, memory_order_relaxed);
+	atomic_store(&g_relay.marks[mark % RELAY_MAX_MARKS], head);
+	atomic_store(&g_relay.mark_count, mark + 1);
+	atomic_store_explicit(&g_relay.head, head + size, memory_order_release);
+
+	const uint64_t wake = 1;
+	if (write(g_relay.wake_fd, &wake, sizeof(wake)) < 0) {
+		rtlog_debug("relay: unable to wake the thread\n");
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Serves the playing radio stream over HTTP to other devices in the LAN,
+ * so any number of listeners share the one upstream connection.
+ *
+ * The download thread appends its frames to a single ring, every client is
+ * sent straight out of it from its own position by one epoll thread. A
+ * client too slow to keep up is moved ahead to the live end, new clients
+ * start a few seconds back to fill their buffers quickly.
+ *
+ * Disabled unless radio_relay_port is set in the config.
+ */
+Result relay_start(int port);
+void   relay_stop(void);
+
+/** Called by the download thread with whole frames. Never blocks. */
+void   relay_write(const uint8_t *frames, size_t size);
+
+#endif // RELAY_H
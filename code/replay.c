@@ -0,0 +1,429 @@
+#include "replay.h"
+
+#include <errno.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define REPLAY_HEADER        "shard-os-input 1\n"
+#define REPLAY_LINE_SIZE     256
+#define REPLAY_FLUSH_FRAMES  30    // about once a second, a device in the field may just lose power
+
+enum Replay_Mode {
+	REPLAY_MODE_LIVE,
+	REPLAY_MODE_RECORD,
+	REPLAY_MODE_PLAY,
+};
+
+struct Replay_Event_Name {
+	Uint32 type;
+	const char *name;
+};
+
+static const struct Replay_Event_Name g_event_names[] = {
+	{SDL_EVENT_QUIT             , "quit"},
+	{SDL_EVENT_KEY_DOWN         , "key_down"},
+	{SDL_EVENT_MOUSE_BUTTON_DOWN, "button_down"},
+	{SDL_EVENT_MOUSE_BUTTON_UP  , "button_up"},
+	{SDL_EVENT_MOUSE_MOTION     , "motion"},
+	{SDL_EVENT_FINGER_DOWN      , "finger_down"},
+	{SDL_EVENT_FINGER_MOTION    , "finger_motion"},
+	{SDL_EVENT_FINGER_UP        , "finger_up"},
+};
+
+static struct {
+	enum Replay_Mode mode;
+	FILE *file;
+	char path[PATH_MAX];
+
+	// the UI clock, only moved by replay_frame_begin()
+	bool has_frame;
+	uint64_t now_ns;
+	time_t now;
+	float mouse_x;
+	float mouse_y;
+
+	// replay, the next line is read ahead to know where a frame ends
+	char line[REPLAY_LINE_SIZE];
+	size_t line_number;
+	bool is_finished;
+	bool is_quit_sent;
+
+	size_t frame_count;
+	size_t frame_capacity;
+	uint64_t *frame_cpu_ns;
+	uint64_t start_ns;
+	uint64_t start_cpu_ns;
+} g_replay;
+
+static uint64_t replay_process_cpu_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static const char *replay_event_name(Uint32 type)
+{
+	for (size_t i=0; i < ARRAY_SIZE(g_event_names); ++i) {
+		if (g_event_names[i].type == type) return g_event_names[i].name;
+	}
+	return NULL;
+}
+
+static bool replay_event_type(const char *name, Uint32 *type)
+{
+	for (size_t i=0; i < ARRAY_SIZE(g_event_names); ++i) {
+		if (strcmp(g_event_names[i].name, name) == 0) {
+			*type = g_event_names[i].type;
+			return true;
+		}
+	}
+	return false;
+}
+
+/** %.9g brings a float back bit for bit. */
+static void replay_write_event(const SDL_Event *event)
+{
+	const char *name = replay_event_name(event->type);
+	if (name == NULL) return;
+
+	fprintf(g_replay.file, "%s %llu", name, (unsigned long long) event->common.timestamp);
+
+	switch (event->type) {
+		case SDL_EVENT_KEY_DOWN:
+			fprintf(g_replay.file, " %u", (unsigned) event->key.key);
+			break;
+
+		case SDL_EVENT_MOUSE_BUTTON_DOWN:
+		case SDL_EVENT_MOUSE_BUTTON_UP:
+			fprintf(g_replay.file, " %u %u %.9g %.9g", (unsigned) event->button.which, (unsigned) event->button.button,
+				(double) event->button.x, (double) event->button.y);
+			break;
+
+		case SDL_EVENT_MOUSE_MOTION:
+			fprintf(g_replay.file, " %u %.9g %.9g %.9g %.9g", (unsigned) event->motion.which,
+				(double) event->motion.x, (double) event->motion.y,
+				(double) event->motion.xrel, (double) event->motion.yrel);
+			break;
+
+		case SDL_EVENT_FINGER_DOWN:
+		case SDL_EVENT_FINGER_MOTION:
+		case SDL_EVENT_FINGER_UP:
+			fprintf(g_replay.file, " %llu %llu %.9g %.9g %.9g %.9g",
+				(unsigned long long) event->tfinger.touchID, (unsigned long long) event->tfinger.fingerID,
+				(double) event->tfinger.x, (double) event->tfinger.y,
+				(double) event->tfinger.dx, (double) event->tfinger.dy);
+			break;
+	}
+	fputc('\n', g_replay.file);
+}
+
+static bool replay_parse_event(const char *line, SDL_Event *event)
+{
+	char name[32];
+	unsigned long long timestamp = 0;
+	int used = 0;
+
+	if (sscanf(line, "%31s %llu%n", name, &timestamp, &used) != 2) return false;
+	const char *args = line+used;
+
+	memset(event, 0, sizeof(*event));
+	if (!replay_event_type(name, &event->type)) return false;
+	event->common.timestamp = timestamp;
+
+	switch (event->type) {
+		case SDL_EVENT_QUIT:
+			return true;
+
+		case SDL_EVENT_KEY_DOWN: {
+			unsigned key = 0;
+			if (sscanf(args, "%u", &key) != 1) return false;
+			event->key.key  = (SDL_Keycode) key;
+			event->key.down = true;
+			return true;
+		}
+
+		case SDL_EVENT_MOUSE_BUTTON_DOWN:
+		case SDL_EVENT_MOUSE_BUTTON_UP: {
+			unsigned which = 0, button = 0;
+			if (sscanf(args, "%u %u %f %f", &which, &button, &event->button.x, &event->button.y) != 4) return false;
+			event->button.which  = (SDL_MouseID) which;
+			event->button.button = (Uint8) button;
+			event->button.down   = (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN);
+			return true;
+		}
+
+		case SDL_EVENT_MOUSE_MOTION: {
+			unsigned which = 0;
+			if (sscanf(args, "%u %f %f %f %f", &which,
+				&event->motion.x, &event->motion.y, &event->motion.xrel, &event->motion.yrel) != 5) return false;
+			event->motion.which = (SDL_MouseID) which;
+			return true;
+		}
+
+		case SDL_EVENT_FINGER_DOWN:
+		case SDL_EVENT_FINGER_MOTION:
+		case SDL_EVENT_FINGER_UP: {
+			unsigned long long touch_id = 0, finger_id = 0;
+			if (sscanf(args, "%llu %llu %f %f %f %f", &touch_id, &finger_id,
+				&event->tfinger.x, &event->tfinger.y, &event->tfinger.dx, &event->tfinger.dy) != 6) return false;
+			event->tfinger.touchID  = (SDL_TouchID) touch_id;
+			event->tfinger.fingerID = (SDL_FingerID) finger_id;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void replay_read_line(void)
+{
+	if (fgets(g_replay.line, sizeof(g_replay.line), g_replay.file) == NULL) {
+		g_replay.line[0] = '\0';
+		return;
+	}
+	g_replay.line_number++;
+}
+
+static bool replay_is_frame_line(void)
+{
+	return strncmp(g_replay.line, "frame ", 6) == 0;
+}
+
+/** Takes the clock and mouse position of the frame line read ahead. */
+static bool replay_parse_frame(void)
+{
+	unsigned long long now_ns = 0;
+	long long now = 0;
+
+	if (sscanf(g_replay.line, "frame %llu %lld %f %f", &now_ns, &now, &g_replay.mouse_x, &g_replay.mouse_y) != 4) {
+		return false;
+	}
+	g_replay.now_ns    = now_ns;
+	g_replay.now       = (time_t) now;
+	g_replay.has_frame = true;
+	return true;
+}
+
+static void replay_finish(const char *reason)
+{
+	if (g_replay.is_finished) return;
+
+	if (reason != NULL) log_error("replay stopped at %s:%zu: %s\n", g_replay.path, g_replay.line_number, reason);
+	g_replay.is_finished = true;
+}
+
+Result replay_record(const char *path)
+{
+	if (g_replay.mode != REPLAY_MODE_LIVE) return result_make(false, "already recording or replaying");
+
+	g_replay.file = fopen(path, "w");
+	if (g_replay.file == NULL) {
+		return result_make(false, "unable to write %s: %s", path, strerror(errno));
+	}
+	fputs(REPLAY_HEADER, g_replay.file);
+
+	snprintf(g_replay.path, sizeof(g_replay.path), "%s", path);
+	g_replay.frame_count = 0;
+	g_replay.mode        = REPLAY_MODE_RECORD;
+	log_info("recording input to %s\n", path);
+	return result_make_success();
+}
+
+Result replay_play(const char *path)
+{
+	if (g_replay.mode != REPLAY_MODE_LIVE) return result_make(false, "already recording or replaying");
+
+	g_replay.file = fopen(path, "r");
+	if (g_replay.file == NULL) {
+		return result_make(false, "unable to read %s: %s", path, strerror(errno));
+	}
+	snprintf(g_replay.path, sizeof(g_replay.path), "%s", path);
+	g_replay.line_number = 0;
+
+	replay_read_line();
+	if (strcmp(g_replay.line, REPLAY_HEADER) != 0) {
+		fclose(g_replay.file);
+		return result_make(false, "%s is no input recording", path);
+	}
+
+	// the clock starts at the first frame already, for everything set up before it
+	replay_read_line();
+	if (!replay_is_frame_line() || !replay_parse_frame()) {
+		fclose(g_replay.file);
+		return result_make(false, "%s has no frames", path);
+	}
+
+	g_replay.is_finished  = false;
+	g_replay.is_quit_sent = false;
+	g_replay.frame_count  = 0;
+	g_replay.start_ns     = SDL_GetTicksNS();
+	g_replay.start_cpu_ns = replay_process_cpu_ns();
+	g_replay.mode         = REPLAY_MODE_PLAY;
+	log_info("replaying input from %s\n", path);
+	return result_make_success();
+}
+
+static int compare_u64(const void *lhs, const void *rhs)
+{
+	const uint64_t a = *(const uint64_t *) lhs;
+	const uint64_t b = *(const uint64_t *) rhs;
+	return (a > b) - (a < b);
+}
+
+static double replay_percentile_ms(const uint64_t *sorted, size_t count, int percent)
+{
+	if (count == 0) return 0.0;
+
+	size_t rank = (count * (size_t) percent + 99) / 100;
+	if (rank > 0) rank--;
+	return (double) sorted[MIN(rank, count-1)] / 1e6;
+}
+
+static void replay_log_summary(void)
+{
+	const uint64_t wall_ns = SDL_GetTicksNS() - g_replay.start_ns;
+	const uint64_t cpu_ns  = replay_process_cpu_ns() - g_replay.start_cpu_ns;
+	const size_t count     = g_replay.frame_count;
+
+	if (count > 0) qsort(g_replay.frame_cpu_ns, count, sizeof(g_replay.frame_cpu_ns[0]), compare_u64);
+
+	log_info("replayed %zu frames in %.1f ms, %.1f ms CPU, frame p50 %.3f ms p90 %.3f ms p99 %.3f ms max %.3f ms\n",
+		count, (double) wall_ns / 1e6, (double) cpu_ns / 1e6,
+		replay_percentile_ms(g_replay.frame_cpu_ns, count, 50),
+		replay_percentile_ms(g_replay.frame_cpu_ns, count, 90),
+		replay_percentile_ms(g_replay.frame_cpu_ns, count, 99),
+		replay_percentile_ms(g_replay.frame_cpu_ns, count, 100));
+}
+
+void replay_stop(void)
+{
+	switch (g_replay.mode) {
+		case REPLAY_MODE_LIVE:
+			return;
+
+		case REPLAY_MODE_RECORD:
+			log_info("recorded %zu frames to %s\n", g_replay.frame_count, g_replay.path);
+			break;
+
+		case REPLAY_MODE_PLAY:
+			replay_log_summary();
+			free(g_replay.frame_cpu_ns);
+			g_replay.frame_cpu_ns   = NULL;
+			g_replay.frame_capacity = 0;
+			break;
+	}
+
+	fclose(g_replay.file);
+	g_replay.file = NULL;
+	g_replay.mode = REPLAY_MODE_LIVE;
+}
+
+bool replay_is_playing(void)
+{
+	return g_replay.mode == REPLAY_MODE_PLAY;
+}
+
+void replay_frame_begin(float *mouse_x, float *mouse_y)
+{
+	if (g_replay.mode != REPLAY_MODE_PLAY) {
+		g_replay.now_ns    = SDL_GetTicksNS();
+		g_replay.now       = time(NULL);
+		g_replay.has_frame = true;
+		SDL_GetMouseState(mouse_x, mouse_y);
+
+		if (g_replay.mode == REPLAY_MODE_RECORD) {
+			fprintf(g_replay.file, "frame %llu %lld %.9g %.9g\n",
+				(unsigned long long) g_replay.now_ns, (long long) g_replay.now, (double) *mouse_x, (double) *mouse_y);
+
+			if (++g_replay.frame_count % REPLAY_FLUSH_FRAMES == 0) fflush(g_replay.file);
+		}
+		return;
+	}
+
+	// the window stays responsive, only closing it is taken from the real input
+	SDL_Event event;
+	while (SDL_PollEvent(&event)) {
+		if (event.type == SDL_EVENT_QUIT) replay_finish(NULL);
+	}
+
+	if (!g_replay.is_finished) {
+		if (g_replay.line[0] == '\0') {
+			replay_finish(NULL);
+		}
+		else if (!replay_is_frame_line() || !replay_parse_frame()) {
+			replay_finish("expected a frame");
+		}
+		else {
+			replay_read_line();
+		}
+	}
+
+	*mouse_x = g_replay.mouse_x;
+	*mouse_y = g_replay.mouse_y;
+}
+
+bool replay_poll_event(SDL_Event *event)
+{
+	switch (g_replay.mode) {
+		case REPLAY_MODE_LIVE:
+			return SDL_PollEvent(event);
+
+		case REPLAY_MODE_RECORD:
+			if (!SDL_PollEvent(event)) return false;
+			replay_write_event(event);
+			return true;
+
+		case REPLAY_MODE_PLAY:
+			break;
+	}
+
+	if (!g_replay.is_finished) {
+		// the events of this frame end with the next frame line
+		if (g_replay.line[0] == '\0' || replay_is_frame_line()) return false;
+
+		if (replay_parse_event(g_replay.line, event)) {
+			replay_read_line();
+			return true;
+		}
+		replay_finish("unknown event");
+	}
+
+	if (g_replay.is_quit_sent) return false;
+
+	memset(event, 0, sizeof(*event));
+	event->type             = SDL_EVENT_QUIT;
+	event->common.timestamp = g_replay.now_ns;
+	g_replay.is_quit_sent   = true;
+	return true;
+}
+
+void replay_frame_end(uint64_t cpu_ns)
+{
+	// the frame after the end only handles the quit event
+	if (g_replay.mode != REPLAY_MODE_PLAY || g_replay.is_finished) return;
+
+	if (g_replay.frame_count >= g_replay.frame_capacity) {
+		const size_t new_capacity = MAX((size_t) 1024, g_replay.frame_capacity*2);
+		uint64_t *new_frames = realloc(g_replay.frame_cpu_ns, new_capacity*sizeof(new_frames[0]));
+
+		if (new_frames == NULL) return;
+		g_replay.frame_cpu_ns   = new_frames;
+		g_replay.frame_capacity = new_capacity;
+	}
+	g_replay.frame_cpu_ns[g_replay.frame_count++] = cpu_ns;
+}
+
+uint64_t replay_ticks_ns(void)
+{
+	return g_replay.has_frame ? g_replay.now_ns : SDL_GetTicksNS();
+}
+
+time_t replay_time(void)
+{
+	return g_replay.has_frame ? g_replay.now : time(NULL);
+}
@@ -0,0 +1,42 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <SDL3/SDL.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Input recording and replay for the render thread. Every frame writes the
+ * UI clock, the wall clock, the mouse position and the mouse, finger and key
+ * events of the frame to a text file. A replay hands the same events to the
+ * same frames again and stops the UI clock at the recorded values, so a
+ * session from the field renders the same way in every build.
+ *
+ * The UI clock only moves at the start of a frame, the UI reads it instead
+ * of SDL_GetTicksNS(), time() and CLOCK_MONOTONIC.
+ */
+
+Result replay_record(const char *path);
+Result replay_play(const char *path);
+
+/** Closes the file, a replay logs its frame times and the CPU time used. */
+void replay_stop(void);
+
+bool replay_is_playing(void);
+
+/** Advances the UI clock and gets the mouse position, like SDL_GetMouseState(). */
+void replay_frame_begin(float *mouse_x, float *mouse_y);
+
+/** Like SDL_PollEvent(), returns SDL_EVENT_QUIT at the end of a replay. */
+bool replay_poll_event(SDL_Event *event);
+
+void replay_frame_end(uint64_t cpu_ns);
+
+uint64_t replay_ticks_ns(void);
+time_t   replay_time(void);
+
+#endif // REPLAY_H
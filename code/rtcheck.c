@@ -0,0 +1,336 @@
+// RTLD_NEXT, only needed by this debug build file
+#define _GNU_SOURCE
+
+#include "rtcheck.h"
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libcutils/logger.h"
+
+#define RTCHECK_MAX_VIOLATIONS  64    // distinct call sites
+#define RTCHECK_MAX_FRAMES      12
+
+struct Rtcheck_Violation {
+	_Atomic uintptr_t caller;      // 0 while the slot is free
+	const char *function;
+	void *backtrace[RTCHECK_MAX_FRAMES];
+	int backtrace_size;
+	_Atomic uint32_t count;
+	_Atomic bool is_ready;         // set once the backtrace is complete
+	bool is_reported;              // only touched by rtcheck_report()
+};
+
+static struct {
+	struct Rtcheck_Violation violations[RTCHECK_MAX_VIOLATIONS];
+	_Atomic uint32_t overflow;
+	bool is_abort;
+} g_rtcheck;
+
+static _Thread_local int t_depth          = 0;
+static _Thread_local bool t_is_recording  = false;
+static _Thread_local int t_excluded       = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+static int     (*real_pthread_mutex_lock)(pthread_mutex_t *mutex);
+static int     (*real_pthread_cond_wait)(pthread_cond_t *cond, pthread_mutex_t *mutex);
+static ssize_t (*real_read)(int fd, void *buf, size_t count);
+static ssize_t (*real_write)(int fd, const void *buf, size_t count);
+static int     (*real_nanosleep)(const struct timespec *duration, struct timespec *rem);
+static int     (*real_usleep)(useconds_t usec);
+static int     (*real_poll)(struct pollfd *fds, nfds_t nfds, int timeout);
+static int     (*real_fsync)(int fd);
+static int     (*real_vfprintf)(FILE *stream, const char *format, va_list args);
+static int     (*real_fputs)(const char *s, FILE *stream);
+static int     (*real_puts)(const char *s);
+static size_t  (*real_fwrite)(const void *ptr, size_t size, size_t count, FILE *stream);
+static int     (*real_fflush)(FILE *stream);
+
+// the POSIX way to turn the object pointer of dlsym() into a function pointer
+#define RTCHECK_RESOLVE(name) \
+	do { if (real_##name == NULL) *(void **)(&real_##name) = dlsym(RTLD_NEXT, #name); } while (0)
+
+static void rtcheck_print(const struct Rtcheck_Violation *violation)
+{
+	dprintf(STDERR_FILENO, "rtcheck: %s() in a real-time section, %u times so far:\n",
+		violation->function, (unsigned) atomic_load(&violation->count));
+	backtrace_symbols_fd(violation->backtrace, violation->backtrace_size, STDERR_FILENO);
+}
+
+static void rtcheck_violation(const char *function, void *caller)
+{
+	if (t_depth == 0 || t_excluded > 0 || t_is_recording) return;
+	t_is_recording = true;
+
+	const uintptr_t key = (uintptr_t) caller;
+	size_t index = (key >> 4) % RTCHECK_MAX_VIOLATIONS;
+	size_t probes = 0;
+
+	for (; probes < RTCHECK_MAX_VIOLATIONS; ++probes, index = (index+1) % RTCHECK_MAX_VIOLATIONS) {
+		struct Rtcheck_Violation *violation = &g_rtcheck.violations[index];
+		uintptr_t expected = 0;
+
+		if (atomic_compare_exchange_strong(&violation->caller, &expected, key)) {
+			violation->function       = function;
+			violation->backtrace_size = backtrace(violation->backtrace, RTCHECK_MAX_FRAMES);
+			atomic_store(&violation->count, 1);
+			atomic_store(&violation->is_ready, true);
+
+			if (g_rtcheck.is_abort) {
+				rtcheck_print(violation);
+				abort();
+			}
+			break;
+		}
+		if (expected == key) {
+			atomic_fetch_add(&violation->count, 1);
+			break;
+		}
+	}
+	if (probes == RTCHECK_MAX_VIOLATIONS) atomic_fetch_add(&g_rtcheck.overflow, 1);
+
+	t_is_recording = false;
+}
+
+void rtcheck_enter(void)
+{
+	t_depth++;
+}
+
+void rtcheck_leave(void)
+{
+	if (t_depth > 0) t_depth--;
+}
+
+void rtcheck_exclude_begin(void)
+{
+	t_excluded++;
+}
+
+void rtcheck_exclude_end(void)
+{
+	if (t_excluded > 0) t_excluded--;
+}
+
+void rtcheck_report(void)
+{
+	for (size_t i = 0; i < RTCHECK_MAX_VIOLATIONS; ++i) {
+		struct Rtcheck_Violation *violation = &g_rtcheck.violations[i];
+		if (!atomic_load(&violation->is_ready) || violation->is_reported) continue;
+
+		log_error("rtcheck: %s() called in the audio callback\n", violation->function);
+		rtcheck_print(violation);
+		violation->is_reported = true;
+	}
+}
+
+static void rtcheck_summary(void)
+{
+	rtcheck_report();
+
+	uint32_t total = 0;
+	for (size_t i = 0; i < RTCHECK_MAX_VIOLATIONS; ++i) {
+		const struct Rtcheck_Violation *violation = &g_rtcheck.violations[i];
+		if (!atomic_load(&violation->is_ready)) continue;
+
+		total += atomic_load(&violation->count);
+		dprintf(STDERR_FILENO, "rtcheck: %6u x %s() from %p\n",
+			(unsigned) atomic_load(&violation->count), violation->function, (void*) atomic_load(&violation->caller));
+	}
+
+	const uint32_t overflow = atomic_load(&g_rtcheck.overflow);
+	dprintf(STDERR_FILENO, "rtcheck: %u violations%s\n", (unsigned)(total + overflow),
+		(overflow > 0) ? ", some from call sites beyond the table" : "");
+}
+
+__attribute__((constructor))
+static void rtcheck_init(void)
+{
+	RTCHECK_RESOLVE(pthread_mutex_lock);
+	RTCHECK_RESOLVE(pthread_cond_wait);
+	RTCHECK_RESOLVE(read);
+	RTCHECK_RESOLVE(write);
+	RTCHECK_RESOLVE(nanosleep);
+	RTCHECK_RESOLVE(usleep);
+	RTCHECK_RESOLVE(poll);
+	RTCHECK_RESOLVE(fsync);
+	RTCHECK_RESOLVE(vfprintf);
+	RTCHECK_RESOLVE(fputs);
+	RTCHECK_RESOLVE(puts);
+	RTCHECK_RESOLVE(fwrite);
+	RTCHECK_RESOLVE(fflush);
+
+	g_rtcheck.is_abort = (getenv("SHARDOS_RTCHECK_ABORT") != NULL);
+
+	// the first backtrace() loads libgcc, better here than in a violation
+	void *warmup[1];
+	backtrace(warmup, 1);
+
+	atexit(rtcheck_summary);
+}
+
+// -- interposed functions, they only differ from libc while t_depth > 0 --
+
+void *malloc(size_t size)
+{
+	rtcheck_violation("malloc", __builtin_return_address(0));
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	rtcheck_violation("calloc", __builtin_return_address(0));
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	rtcheck_violation("realloc", __builtin_return_address(0));
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if (ptr != NULL) rtcheck_violation("free", __builtin_return_address(0));
+	__libc_free(ptr);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	rtcheck_violation("pthread_mutex_lock", __builtin_return_address(0));
+	RTCHECK_RESOLVE(pthread_mutex_lock);
+	return real_pthread_mutex_lock(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	rtcheck_violation("pthread_cond_wait", __builtin_return_address(0));
+	RTCHECK_RESOLVE(pthread_cond_wait);
+	return real_pthread_cond_wait(cond, mutex);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	rtcheck_violation("read", __builtin_return_address(0));
+	RTCHECK_RESOLVE(read);
+	return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	rtcheck_violation("write", __builtin_return_address(0));
+	RTCHECK_RESOLVE(write);
+	return real_write(fd, buf, count);
+}
+
+int nanosleep(const struct timespec *duration, struct timespec *rem)
+{
+	rtcheck_violation("nanosleep", __builtin_return_address(0));
+	RTCHECK_RESOLVE(nanosleep);
+	return real_nanosleep(duration, rem);
+}
+
+int usleep(useconds_t usec)
+{
+	rtcheck_violation("usleep", __builtin_return_address(0));
+	RTCHECK_RESOLVE(usleep);
+	return real_usleep(usec);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	rtcheck_violation("poll", __builtin_return_address(0));
+	RTCHECK_RESOLVE(poll);
+	return real_poll(fds, nfds, timeout);
+}
+
+int fsync(int fd)
+{
+	rtcheck_violation("fsync", __builtin_return_address(0));
+	RTCHECK_RESOLVE(fsync);
+	return real_fsync(fd);
+}
+
+__attribute__((format(printf, 2, 0)))
+int vfprintf(FILE *stream, const char *format, va_list args)
+{
+	rtcheck_violation("vfprintf", __builtin_return_address(0));
+	RTCHECK_RESOLVE(vfprintf);
+	return real_vfprintf(stream, format, args);
+}
+
+__attribute__((format(printf, 1, 0)))
+int vprintf(const char *format, va_list args)
+{
+	rtcheck_violation("vprintf", __builtin_return_address(0));
+	RTCHECK_RESOLVE(vfprintf);
+	return real_vfprintf(stdout, format, args);
+}
+
+__attribute__((format(printf, 2, 3)))
+int fprintf(FILE *stream, const char *format, ...)
+{
+	rtcheck_violation("fprintf", __builtin_return_address(0));
+	RTCHECK_RESOLVE(vfprintf);
+
+	va_list args;
+	va_start(args, format);
+	const int result = real_vfprintf(stream, format, args);
+	va_end(args);
+	return result;
+}
+
+__attribute__((format(printf, 1, 2)))
+int printf(const char *format, ...)
+{
+	rtcheck_violation("printf", __builtin_return_address(0));
+	RTCHECK_RESOLVE(vfprintf);
+
+	va_list args;
+	va_start(args, format);
+	const int result = real_vfprintf(stdout, format, args);
+	va_end(args);
+	return result;
+}
+
+int fputs(const char *s, FILE *stream)
+{
+	rtcheck_violation("fputs", __builtin_return_address(0));
+	RTCHECK_RESOLVE(fputs);
+	return real_fputs(s, stream);
+}
+
+int puts(const char *s)
+{
+	rtcheck_violation("puts", __builtin_return_address(0));
+	RTCHECK_RESOLVE(puts);
+	return real_puts(s);
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t count, FILE *stream)
+{
+	rtcheck_violation("fwrite", __builtin_return_address(0));
+	RTCHECK_RESOLVE(fwrite);
+	return real_fwrite(ptr, size, count, stream);
+}
+
+int fflush(FILE *stream)
+{
+	rtcheck_violation("fflush", __builtin_return_address(0));
+	RTCHECK_RESOLVE(fflush);
+	return real_fflush(stream);
+}
@@ -0,0 +1,41 @@
+#ifndef RTCHECK_H
+#define RTCHECK_H
+
+/**
+ * Debug builds with -Drtcheck=true interpose malloc and friends, mutex
+ * locks, blocking syscalls and stdio. Calls made by a thread between
+ * RTCHECK_ENTER() and RTCHECK_LEAVE() are recorded with a backtrace and
+ * logged by RTCHECK_REPORT() from the main loop, once per call site.
+ *
+ * RTCHECK_EXCLUDE_BEGIN() and RTCHECK_EXCLUDE_END() go around single calls
+ * into SDL only, which takes the stream lock it already holds for the
+ * callback. They work on any thread, inside a real-time section or not.
+ *
+ * With SHARDOS_RTCHECK_ABORT set the first violation aborts instead, to
+ * fail a test run. In regular builds the macros are empty.
+ */
+#ifdef SHARDOS_RTCHECK
+
+void rtcheck_enter(void);
+void rtcheck_leave(void);
+void rtcheck_exclude_begin(void);
+void rtcheck_exclude_end(void);
+void rtcheck_report(void);
+
+#define RTCHECK_ENTER()          rtcheck_enter()
+#define RTCHECK_LEAVE()          rtcheck_leave()
+#define RTCHECK_EXCLUDE_BEGIN()  rtcheck_exclude_begin()
+#define RTCHECK_EXCLUDE_END()    rtcheck_exclude_end()
+#define RTCHECK_REPORT()         rtcheck_report()
+
+#else
+
+#define RTCHECK_ENTER()          do {} while (0)
+#define RTCHECK_LEAVE()          do {} while (0)
+#define RTCHECK_EXCLUDE_BEGIN()  do {} while (0)
+#define RTCHECK_EXCLUDE_END()    do {} while (0)
+#define RTCHECK_REPORT()         do {} while (0)
+
+#endif // SHARDOS_RTCHECK
+
+#endif // RTCHECK_H
@@ -0,0 +1,151 @@
+#define UTIL_STRINGS_IMPLEMENTATION
+#include "libcutils/util_strings.h"
+
+#define RESULT_IMPLEMENTATION
+#include "libcutils/result.h"
+
+#define LOGGER_IMPLEMENTATION
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#include "audio.h"
+#include "config.h"
+#include "fixture.h"
+#include "netcache.h"
+#include "rtcheck.h"
+#include "rtlog.h"
+
+#include <linux/limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL3/SDL.h>
+
+/**
+ * Real-time test of the audio callback for builds with -Drtcheck=true.
+ * A generated mp3 is streamed over file:// through curl, the jitterbuffer
+ * and the decoder into SDL's dummy audio driver. With SHARDOS_RTCHECK_ABORT
+ * set, the first allocation, lock or blocking call in fill_sdl_stream_callback
+ * aborts and fails the test.
+ *
+ * Local files are not covered, mpg123 reads them from within the callback.
+ *
+ *   shard-os-rtcheck-test [resources_dir]
+ */
+
+// MPEG-1 layer III, 128 kbit/s, 44.1 kHz, stereo, 1152 samples per frame
+#define RTCHECK_TEST_FRAME_HEADER  {0xFF, 0xFB, 0x90, 0x00}
+#define RTCHECK_TEST_FRAME_SIZE    417
+#define RTCHECK_TEST_FRAMES        350     // ~9 s
+#define RTCHECK_TEST_PLAY_SECS     5
+#define RTCHECK_TEST_TIMEOUT_MS    30000
+#define RTCHECK_TEST_POLL_MS       50
+
+/**
+ * The fixture config and a stream of frames with empty side info and main
+ * data, mpg123 decodes them as silence.
+ */
+static Result rtcheck_test_create_fixture(const char *resources_dir, char *fixture_dir, size_t fixture_dir_size)
+{
+	Result r = fixture_create(resources_dir, fixture_dir, fixture_dir_size);
+	if (!r.success) return r;
+
+	static uint8_t stream[RTCHECK_TEST_FRAMES*RTCHECK_TEST_FRAME_SIZE];
+	const uint8_t header[] = RTCHECK_TEST_FRAME_HEADER;
+
+	for (size_t i=0; i < RTCHECK_TEST_FRAMES; ++i) {
+		memcpy(&stream[i*RTCHECK_TEST_FRAME_SIZE], header, sizeof(header));
+	}
+	return fixture_write_file(fixture_dir, "stream.mp3", stream, sizeof(stream));
+}
+
+static int rtcheck_test_play(const char *fixture_dir)
+{
+	// the download thread keeps the url until audio_close()
+	char url[PATH_MAX+16];
+	snprintf(url, sizeof(url), "file://%s/stream.mp3", fixture_dir);
+
+	Result result = audio_play_url(url);
+	if (!result.success) {
+		log_error("failed to play %s: %s\n", url, result.msg);
+		audio_close();
+		return 1;
+	}
+
+	int pos_secs = 0;
+	for (int waited_ms=0; waited_ms < RTCHECK_TEST_TIMEOUT_MS; waited_ms += RTCHECK_TEST_POLL_MS) {
+		SDL_Delay(RTCHECK_TEST_POLL_MS);
+		RTCHECK_REPORT();
+
+		pos_secs = audio_get_current_pos_in_secs();
+		if (pos_secs >= RTCHECK_TEST_PLAY_SECS) break;
+	}
+	audio_close();
+
+	if (pos_secs < RTCHECK_TEST_PLAY_SECS) {
+		log_error("the audio callback played %d s of %s, expected %d s\n", pos_secs, url, RTCHECK_TEST_PLAY_SECS);
+		return 1;
+	}
+
+	log_info("the audio callback played %d s without a real-time violation\n", pos_secs);
+	return 0;
+}
+
+static int rtcheck_test_run(const char *fixture_dir)
+{
+	Result result = config_init(fixture_dir);
+	if (!result.success) {
+		log_error("Failed to load config: %s\n", result.msg);
+		return 1;
+	}
+
+	SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+	if (!SDL_Init(SDL_INIT_AUDIO)) {
+		log_error("failed to init SDL audio: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	result = netcache_init();
+	if (!result.success) {
+		log_error("failed to init network: %s\n", result.msg);
+		SDL_Quit();
+		return 1;
+	}
+
+	result = rtlog_start();
+	if (!result.success) log_error("failed to start the real-time log: %s\n", result.msg);
+
+	int exit_code = 1;
+
+	result = audio_open();
+	if (result.success) {
+		exit_code = rtcheck_test_play(fixture_dir);
+	}
+	else {
+		log_error("failed to open audio: %s\n", result.msg);
+	}
+
+	rtlog_stop();
+	netcache_destroy();
+	SDL_Quit();
+	return exit_code;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *resources_dir = (argc > 1) ? argv[1] : "../resources";
+
+	char fixture_dir[PATH_MAX];
+	int exit_code = 1;
+
+	Result result = rtcheck_test_create_fixture(resources_dir, fixture_dir, sizeof(fixture_dir));
+	if (result.success) {
+		exit_code = rtcheck_test_run(fixture_dir);
+	}
+	else {
+		log_error("failed to create the test data: %s\n", result.msg);
+	}
+
+	fixture_remove(fixture_dir);
+	return exit_code;
+}
@@ -0,0 +1,245 @@
+#include "rtlog.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <SDL3/SDL.h>
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define RTLOG_MAX_THREADS  16
+#define RTLOG_RING_SIZE    64      // records per thread, a power of two
+#define RTLOG_TEXT_SIZE    200
+#define RTLOG_WRITER_MS    20
+#define RTLOG_LATE_MS      100
+#define RTLOG_WINDOW_MS    1000
+
+struct Rtlog_Record {
+	uint64_t time_ms;
+	const char *file;
+	int line;
+	enum Rtlog_Level level;
+	uint32_t suppressed;
+	char text[RTLOG_TEXT_SIZE];
+};
+
+struct Rtlog_Ring {
+	struct Rtlog_Record records[RTLOG_RING_SIZE];
+	_Atomic uint32_t head;        // written by the owner only
+	_Atomic uint32_t tail;        // written by the writer thread only
+	_Atomic uint32_t dropped;
+	_Atomic bool is_owned;
+};
+
+static struct {
+	struct Rtlog_Ring rings[RTLOG_MAX_THREADS];
+	_Atomic uint32_t dropped_without_ring;
+
+	pthread_t thread;
+	_Atomic bool is_running;
+	_Atomic bool quit;
+	_Atomic int queuing;          // threads between the is_running check and the publish
+
+	pthread_once_t key_once;
+	pthread_key_t owner_key;
+} g_rtlog = {
+	.key_once = PTHREAD_ONCE_INIT,
+};
+
+static _Thread_local struct Rtlog_Ring *t_ring = NULL;
+
+static uint64_t rtlog_now_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000ull + (uint64_t) now.tv_nsec / 1000000ull;
+}
+
+static bool rtlog_site_allows(struct Rtlog_Site *site, uint64_t now_ms)
+{
+	uint64_t window_start = atomic_load_explicit(&site->window_start_ms, memory_order_relaxed);
+
+	// only one thread opens the next window, the counts may be off by a few
+	if (now_ms - window_start >= RTLOG_WINDOW_MS &&
+	    atomic_compare_exchange_strong(&site->window_start_ms, &window_start, now_ms)) {
+		atomic_store_explicit(&site->window_count, 0, memory_order_relaxed);
+	}
+
+	if (atomic_fetch_add_explicit(&site->window_count, 1, memory_order_relaxed) < RTLOG_SITE_BURST) return true;
+
+	atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+	return false;
+}
+
+static void rtlog_emit(const struct Rtlog_Record *record, uint64_t now_ms)
+{
+	const char *file = strrchr(record->file, '/');
+	file = (file != NULL) ? file+1 : record->file;
+
+	// the format strings end with a newline, the notes go before it
+	const size_t length = strcspn(record->text, "\n");
+
+	char notes[96] = "";
+	size_t used = 0;
+	if (record->suppressed > 0) {
+		used += (size_t) snprintf(notes, sizeof(notes), " (%u similar suppressed)", record->suppressed);
+	}
+	if (now_ms - record->time_ms >= RTLOG_LATE_MS) {
+		snprintf(notes+used, sizeof(notes)-used, " (%llu ms ago)", (unsigned long long)(now_ms - record->time_ms));
+	}
+
+	switch (record->level) {
+		case RTLOG_LEVEL_DEBUG  : log_debug  ("%s:%d: %.*s%s\n", file, record->line, (int) length, record->text, notes); break;
+		case RTLOG_LEVEL_INFO   : log_info   ("%s:%d: %.*s%s\n", file, record->line, (int) length, record->text, notes); break;
+		case RTLOG_LEVEL_WARNING: log_warning("%s:%d: %.*s%s\n", file, record->line, (int) length, record->text, notes); break;
+		case RTLOG_LEVEL_ERROR  : log_error  ("%s:%d: %.*s%s\n", file, record->line, (int) length, record->text, notes); break;
+	}
+}
+
+/** Thread exit, records still in the ring are logged by the writer anyway. */
+static void rtlog_release_ring(void *arg)
+{
+	struct Rtlog_Ring *ring = arg;
+	atomic_store(&ring->is_owned, false);
+}
+
+static void rtlog_create_key(void)
+{
+	pthread_key_create(&g_rtlog.owner_key, rtlog_release_ring);
+}
+
+static struct Rtlog_Ring *rtlog_claim_ring(void)
+{
+	pthread_once(&g_rtlog.key_once, rtlog_create_key);
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_rtlog.rings); ++i) {
+		struct Rtlog_Ring *ring = &g_rtlog.rings[i];
+		bool is_owned = false;
+
+		if (atomic_compare_exchange_strong(&ring->is_owned, &is_owned, true)) {
+			pthread_setspecific(g_rtlog.owner_key, ring);
+			return ring;
+		}
+	}
+	return NULL;
+}
+
+void rtlog_write(struct Rtlog_Site *site, enum Rtlog_Level level, const char *fmt, ...)
+{
+	const uint64_t now_ms = rtlog_now_ms();
+	if (!rtlog_site_allows(site, now_ms)) return;
+
+	struct Rtlog_Record direct;
+	struct Rtlog_Record *record = &direct;
+	// rtlog_stop() waits for every thread which saw is_running before its
+	// last drain, so a record published late is not lost
+	atomic_fetch_add(&g_rtlog.queuing, 1);
+	const bool is_queued = atomic_load(&g_rtlog.is_running);
+	if (!is_queued) atomic_fetch_sub(&g_rtlog.queuing, 1);
+
+	if (is_queued) {
+		if (t_ring == NULL) t_ring = rtlog_claim_ring();
+		if (t_ring == NULL) {
+			atomic_fetch_add_explicit(&g_rtlog.dropped_without_ring, 1, memory_order_relaxed);
+			atomic_fetch_sub(&g_rtlog.queuing, 1);
+			return;
+		}
+
+		const uint32_t head = atomic_load_explicit(&t_ring->head, memory_order_relaxed);
+		const uint32_t tail = atomic_load_explicit(&t_ring->tail, memory_order_acquire);
+		if (head - tail >= RTLOG_RING_SIZE) {
+			atomic_fetch_add_explicit(&t_ring->dropped, 1, memory_order_relaxed);
+			atomic_fetch_sub(&g_rtlog.queuing, 1);
+			return;
+		}
+		record = &t_ring->records[head & (RTLOG_RING_SIZE-1)];
+	}
+
+	record->time_ms    = now_ms;
+	record->file       = site->file;
+	record->line       = site->line;
+	record->level      = level;
+	record->suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(record->text, sizeof(record->text), fmt, args);
+	va_end(args);
+
+	if (is_queued) {
+		const uint32_t head = atomic_load_explicit(&t_ring->head, memory_order_relaxed);
+		atomic_store_explicit(&t_ring->head, head+1, memory_order_release);
+		atomic_fetch_sub(&g_rtlog.queuing, 1);
+	}
+	else {
+		rtlog_emit(record, now_ms);
+	}
+}
+
+static void rtlog_drain(void)
+{
+	const uint64_t now_ms = rtlog_now_ms();
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_rtlog.rings); ++i) {
+		struct Rtlog_Ring *ring = &g_rtlog.rings[i];
+
+		uint32_t tail       = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		const uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		while (tail != head) {
+			rtlog_emit(&ring->records[tail & (RTLOG_RING_SIZE-1)], now_ms);
+			tail++;
+			atomic_store_explicit(&ring->tail, tail, memory_order_release);
+		}
+
+		const uint32_t dropped = atomic_exchange(&ring->dropped, 0);
+		if (dropped > 0) log_warning("rtlog: %u records dropped, the ring was full\n", dropped);
+	}
+
+	const uint32_t dropped = atomic_exchange(&g_rtlog.dropped_without_ring, 0);
+	if (dropped > 0) log_warning("rtlog: %u records dropped, more than %d threads\n", dropped, RTLOG_MAX_THREADS);
+}
+
+static void *rtlog_thread(void *arg)
+{
+	while (!atomic_load(&g_rtlog.quit)) {
+		SDL_Delay(RTLOG_WRITER_MS);
+		rtlog_drain();
+	}
+
+	(void) arg;
+	return NULL;
+}
+
+Result rtlog_start(void)
+{
+	if (atomic_load(&g_rtlog.is_running)) return result_make_success();
+
+	atomic_store(&g_rtlog.quit, false);
+	if (pthread_create(&g_rtlog.thread, NULL, rtlog_thread, NULL) != 0) {
+		return result_make(false, "unable to start the log writer thread");
+	}
+	atomic_store(&g_rtlog.is_running, true);
+	return result_make_success();
+}
+
+void rtlog_stop(void)
+{
+	if (!atomic_load(&g_rtlog.is_running)) return;
+
+	// late records are logged directly from here on
+	atomic_store(&g_rtlog.is_running, false);
+	atomic_store(&g_rtlog.quit, true);
+	pthread_join(g_rtlog.thread, NULL);
+
+	// a thread which saw is_running may still be formatting its record
+	while (atomic_load(&g_rtlog.queuing) > 0) {
+		SDL_Delay(1);
+	}
+	rtlog_drain();
+}
@@ -0,0 +1,54 @@
+#ifndef RTLOG_H
+#define RTLOG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Logging for the audio callback and the download write path, which must
+ * not wait for stdout. A record is formatted into a ring of the calling
+ * thread without locks or allocations, a writer thread hands it to the
+ * regular logger later. A full ring drops the record and counts it.
+ *
+ * Every call site allows RTLOG_SITE_BURST records per second, the rest is
+ * only counted and reported with the next record that passes. Until
+ * rtlog_start() the records are logged right away.
+ */
+#define RTLOG_SITE_BURST  5
+
+enum Rtlog_Level {
+	RTLOG_LEVEL_DEBUG,
+	RTLOG_LEVEL_INFO,
+	RTLOG_LEVEL_WARNING,
+	RTLOG_LEVEL_ERROR,
+};
+
+struct Rtlog_Site {
+	const char *file;
+	int line;
+	_Atomic uint64_t window_start_ms;
+	_Atomic uint32_t window_count;
+	_Atomic uint32_t suppressed;
+};
+
+#define RTLOG(level, fmt, ...) do { \
+	static struct Rtlog_Site rtlog_site_ = { .file = __FILE__, .line = __LINE__ }; \
+	rtlog_write(&rtlog_site_, level, fmt, ##__VA_ARGS__); \
+} while (0)
+
+#define rtlog_debug(fmt, ...)   RTLOG(RTLOG_LEVEL_DEBUG  , fmt, ##__VA_ARGS__)
+#define rtlog_info(fmt, ...)    RTLOG(RTLOG_LEVEL_INFO   , fmt, ##__VA_ARGS__)
+#define rtlog_warning(fmt, ...) RTLOG(RTLOG_LEVEL_WARNING, fmt, ##__VA_ARGS__)
+#define rtlog_error(fmt, ...)   RTLOG(RTLOG_LEVEL_ERROR  , fmt, ##__VA_ARGS__)
+
+__attribute__((format(printf, 3, 4)))
+void   rtlog_write(struct Rtlog_Site *site, enum Rtlog_Level level, const char *fmt, ...);
+
+Result rtlog_start(void);
+
+/** Stops the writer thread after it logged what is left. */
+void   rtlog_stop(void);
+
+#endif // RTLOG_H
@@ -1,11 +1,16 @@
 #include "screen.h"
 
 #include "config.h"
+#include "metrics.h"
+#include "replay.h"
+#include "trace.h"
 
+#include <linux/limits.h>
 #include <unistd.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <SDL3/SDL.h>
 #include <SDL3_image/SDL_image.h>
@@ -120,6 +125,7 @@ struct Screen_Dimension screen_get_text_dimension(struct Screen *screen, int fon
 
 	SDL_Color font_color = {0};
 
+	screen->frame.text_rasterizations++;
 	SDL_Surface *tmp_surface = TTF_RenderText_Blended(
 		screen->font,
 		buffer,
@@ -151,6 +157,7 @@ void screen_draw_icon(struct Screen *screen, int x, int y, int width, int height
 		return;
 	}
 
+	screen->frame.texture_uploads++;
 	SDL_Texture *svg_tex = SDL_CreateTextureFromSurface(screen->renderer, svg_surface);
 	SDL_DestroySurface(svg_surface);
 	if (!svg_tex) {
@@ -167,6 +174,7 @@ void screen_draw_icon(struct Screen *screen, int x, int y, int width, int height
 		.w = (float)width,
 		.h = (float)height
 	};
+	screen->frame.draw_calls++;
 	SDL_RenderTexture(screen->renderer, svg_tex, NULL, &text_rect);
 	SDL_DestroyTexture(svg_tex);
 
@@ -178,6 +186,7 @@ void screen_draw_icon(struct Screen *screen, int x, int y, int width, int height
 	}
 
 
+	screen->frame.texture_uploads++;
 	SDL_Texture *texture = SDL_CreateTextureFromSurface(
 			screen->renderer,
 			tmp_surface);
@@ -194,6 +203,7 @@ void screen_draw_icon(struct Screen *screen, int x, int y, int width, int height
 	};
 
 	SDL_DestroySurface(tmp_surface);
+	screen->frame.draw_calls++;
 	SDL_RenderTexture(screen->renderer, texture, NULL, &text_rect);
 	SDL_DestroyTexture(texture);
 #endif
@@ -221,12 +231,14 @@ void screen_draw_text(struct Screen *screen, int x, int y, int font_size, const
 	TTF_SetFontSize(screen->font, (float)font_size);
 
 	SDL_Color primary_color = screen_get_color(SCREEN_COLOR_PRIMARY);
+	screen->frame.text_rasterizations++;
 	SDL_Surface *tmp_surface = TTF_RenderText_Blended(
 		screen->font,
 		buffer,
 		0,
 		primary_color);
 
+	screen->frame.texture_uploads++;
 	SDL_Texture *texture = SDL_CreateTextureFromSurface(
 			screen->renderer,
 			tmp_surface);
@@ -239,13 +251,77 @@ void screen_draw_text(struct Screen *screen, int x, int y, int font_size, const
 	};
 
 	SDL_DestroySurface(tmp_surface);
+	screen->frame.draw_calls++;
 	SDL_RenderTexture(screen->renderer, texture, NULL, &text_rect);
 	SDL_DestroyTexture(texture);
 }
 
+SDL_Texture *screen_create_text_texture(struct Screen *screen, int font_size, const char *text)
+{
+	// quickfix, draw anything to avoid tmp_surface is null
+	if (text == NULL || strlen(text) == 0) {
+		text = " ";
+	}
+
+	TTF_SetFontSize(screen->font, (float)font_size);
+
+	SDL_Color primary_color = screen_get_color(SCREEN_COLOR_PRIMARY);
+	screen->frame.text_rasterizations++;
+	SDL_Surface *tmp_surface = TTF_RenderText_Blended(
+		screen->font,
+		text,
+		0,
+		primary_color);
+
+	if (tmp_surface == NULL) {
+		log_error("failed to render text '%s': %s\n", text, SDL_GetError());
+		return NULL;
+	}
+
+	screen->frame.texture_uploads++;
+	SDL_Texture *texture = SDL_CreateTextureFromSurface(
+			screen->renderer,
+			tmp_surface);
+
+	SDL_DestroySurface(tmp_surface);
+	return texture;
+}
+
+void screen_draw_texture(struct Screen *screen, SDL_Texture *texture, int x, int y)
+{
+	if (texture == NULL) return;
+
+	float w, h;
+	SDL_GetTextureSize(texture, &w, &h);
+
+	SDL_FRect rect = {
+		.x = (float)x,
+		.y = (float)y,
+		.w = w,
+		.h = h
+	};
+	screen->frame.draw_calls++;
+	SDL_RenderTexture(screen->renderer, texture, NULL, &rect);
+}
+
+void screen_draw_texture_region(struct Screen *screen, SDL_Texture *texture, const SDL_FRect *src, int x, int y)
+{
+	if (texture == NULL) return;
+
+	SDL_FRect rect = {
+		.x = (float)x,
+		.y = (float)y,
+		.w = src->w,
+		.h = src->h
+	};
+	screen->frame.draw_calls++;
+	SDL_RenderTexture(screen->renderer, texture, src, &rect);
+}
+
 void screen_draw_line(struct Screen *screen, int x0, int y0, int x1, int y1)
 {
 	screen_set_color(screen, SCREEN_COLOR_PRIMARY);
+	screen->frame.draw_calls++;
 	SDL_RenderLine(screen->renderer, (float)x0, (float)y0, (float)x1, (float)y1);
 }
 
@@ -294,6 +370,7 @@ void screen_draw_box_filled(struct Screen *screen, int x, int y, int width, int
 			vertexes[i].color.a = fcolor.a;
 		}
 
+		screen->frame.draw_calls++;
 		SDL_RenderGeometry(
 			screen->renderer,
 			NULL,
@@ -303,6 +380,7 @@ void screen_draw_box_filled(struct Screen *screen, int x, int y, int width, int
 
 	if (fg_color != SCREEN_COLOR_NONE) {
 		screen_set_color(screen, fg_color);
+		screen->frame.draw_calls++;
 		SDL_RenderLines(screen->renderer, points, ARRAY_SIZE(points));
 	}
 }
@@ -329,12 +407,14 @@ void screen_draw_text_boxed(struct Screen *screen, int x, int y, int font_size,
 	TTF_SetFontSize(screen->font, (float)font_size);
 
 	SDL_Color primary_color = screen_get_color(SCREEN_COLOR_PRIMARY);
+	screen->frame.text_rasterizations++;
 	SDL_Surface *tmp_surface = TTF_RenderText_Blended(
 		screen->font,
 		buffer,
 		0,
 		primary_color);
 
+	screen->frame.texture_uploads++;
 	SDL_Texture *texture = SDL_CreateTextureFromSurface(
 			screen->renderer,
 			tmp_surface);
@@ -358,6 +438,7 @@ void screen_draw_text_boxed(struct Screen *screen, int x, int y, int font_size,
 	);
 
 	SDL_DestroySurface(tmp_surface);
+	screen->frame.draw_calls++;
 	SDL_RenderTexture(screen->renderer, texture, NULL, &text_rect);
 	SDL_DestroyTexture(texture);
 }
@@ -421,6 +502,7 @@ void screen_draw_window(struct Screen *screen, int x, int y, int width, int heig
 		vertexes[i].color.a = fcolor.a;
 	}
 
+	screen->frame.draw_calls++;
 	SDL_RenderGeometry(
 			screen->renderer,
 			NULL,
@@ -428,15 +510,28 @@ void screen_draw_window(struct Screen *screen, int x, int y, int width, int heig
 			vertices_indexes, ARRAY_SIZE(vertices_indexes));
 
 	screen_set_color(screen, SCREEN_COLOR_PRIMARY);
+	screen->frame.draw_calls++;
 	SDL_RenderLines(screen->renderer, points, ARRAY_SIZE(points));
 	screen_draw_text(screen, x_left+CORNER_CUT+10, y_top+CORNER_CUT+10, g_config.screen_font_size_l, name);
 }
 
+static void screen_toggle_trace(void)
+{
+	char path[PATH_MAX];
+	Result r = TRACE_IS_ENABLED() ? trace_stop(path, sizeof(path)) : trace_start();
+
+	if (!r.success) {
+		log_error("trace: %s\n", r.msg);
+	}
+}
+
 static void screen_handle_keypress(struct Screen *screen, SDL_Keycode *key)
 {
 	switch(*key) {
 		case SDLK_Q      : screen->quit = true; break;
 		case SDLK_ESCAPE : screen->quit = true; break;
+		case SDLK_T      : screen_toggle_trace(); break;
+		case SDLK_P      : screen->show_perf_hud = !screen->show_perf_hud; break;
 	}
 }
 
@@ -473,6 +568,12 @@ void screen_draw_option(
 
 Result screen_init(struct Screen *screen, int width, int height)
 {
+	if (screen->is_headless) {
+		// no display, no GPU and no sound card, as on a CI runner
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER , "offscreen,dummy");
+		SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+		SDL_SetHint(SDL_HINT_AUDIO_DRIVER , "dummy");
+	}
 
 	if(!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
 	{
@@ -530,7 +631,8 @@ Result screen_init(struct Screen *screen, int width, int height)
 		return r;
 	}
 
-	screen->quit = false;
+	screen->quit          = false;
+	screen->show_perf_hud = g_config.screen_perf_hud;
 	return result_make(true, "");
 }
 
@@ -542,16 +644,64 @@ void screen_destroy(struct Screen *screen)
 	SDL_Quit();
 }
 
+static void screen_pointer_press(struct Screen *screen, uint64_t timestamp_ns)
+{
+	struct Screen_Pointer *pointer = &screen->pointer;
+
+	pointer->is_down      = true;
+	pointer->pressed      = true;
+	pointer->start_x      = screen->mouse_x;
+	pointer->start_y      = screen->mouse_y;
+	pointer->travel       = 0.0f;
+	pointer->timestamp_ns = timestamp_ns;
+}
+
+static void screen_pointer_move(struct Screen *screen, float x, float y, float dy, uint64_t timestamp_ns)
+{
+	struct Screen_Pointer *pointer = &screen->pointer;
+
+	if (!pointer->is_down) return;
+
+	pointer->delta_y     += dy;
+	pointer->timestamp_ns = timestamp_ns;
+	pointer->travel       = MAX(pointer->travel,
+		SDL_fabsf(x-pointer->start_x) + SDL_fabsf(y-pointer->start_y));
+}
+
+static void screen_pointer_release(struct Screen *screen, uint64_t timestamp_ns)
+{
+	struct Screen_Pointer *pointer = &screen->pointer;
+
+	if (!pointer->is_down) return;
+
+	pointer->is_down      = false;
+	pointer->released     = true;
+	pointer->timestamp_ns = timestamp_ns;
+}
+
+static void screen_set_finger_position(struct Screen *screen, const SDL_TouchFingerEvent *finger)
+{
+	int w,h;
+	SDL_GetCurrentRenderOutputSize(screen->renderer, &w, &h);
+	screen->mouse_x = (int)((float)w*finger->x);
+	screen->mouse_y = (int)((float)h*finger->y);
+}
+
 void screen_rendering_start(struct Screen *screen)
 {
-	screen->ticks = SDL_GetTicks();
+	screen->ticks          = SDL_GetTicks();
+	screen->frame_start_ns = SDL_GetTicksNS();
 
 	SDL_Event event;
 
-	SDL_GetMouseState(&screen->mouse_x, &screen->mouse_y);
-	screen->mouse_clicked = false;
+	// the mouse position and the events may come from an input recording
+	replay_frame_begin(&screen->mouse_x, &screen->mouse_y);
+	screen->mouse_clicked    = false;
+	screen->pointer.pressed  = false;
+	screen->pointer.released = false;
+	screen->pointer.delta_y  = 0.0f;
 
-	while (SDL_PollEvent(&event)) {
+	while (replay_poll_event(&event)) {
 
 		switch (event.type) {
 
@@ -567,15 +717,42 @@ void screen_rendering_start(struct Screen *screen)
 			// we dont' care which mouse button was clicked
 			log_debug("mouse clicked: x=%04f y=%04f\n", (double)screen->mouse_x, (double)screen->mouse_y);
 			screen->mouse_clicked = true;
+			// touches are handled by the finger events, ignore the synthesized mouse events
+			if (event.button.which != SDL_TOUCH_MOUSEID) {
+				screen_pointer_press(screen, event.button.timestamp);
+			}
+			break;
+
+		case SDL_EVENT_MOUSE_MOTION:
+			if (event.motion.which != SDL_TOUCH_MOUSEID) {
+				screen_pointer_move(screen, event.motion.x, event.motion.y, event.motion.yrel, event.motion.timestamp);
+			}
+			break;
+
+		case SDL_EVENT_MOUSE_BUTTON_UP:
+			if (event.button.which != SDL_TOUCH_MOUSEID) {
+				screen_pointer_release(screen, event.button.timestamp);
+			}
 			break;
 
 		case SDL_EVENT_FINGER_DOWN:
 			screen->mouse_clicked = true;
+			screen_set_finger_position(screen, &event.tfinger);
+			screen_pointer_press(screen, event.tfinger.timestamp);
+			log_debug("finger down: x=%04f y=%04f\n", (double)screen->mouse_x, (double)screen->mouse_y);
+			break;
+
+		case SDL_EVENT_FINGER_MOTION: {
 			int w,h;
 			SDL_GetCurrentRenderOutputSize(screen->renderer, &w, &h);
-			screen->mouse_x = (int)((float)w*event.tfinger.x);
-			screen->mouse_y = (int)((float)h*event.tfinger.y);
-			log_debug("finger down: x=%04f y=%04f\n", (double)screen->mouse_x, (double)screen->mouse_y);
+			screen_set_finger_position(screen, &event.tfinger);
+			screen_pointer_move(screen, screen->mouse_x, screen->mouse_y, (float)h*event.tfinger.dy, event.tfinger.timestamp);
+			break;
+		}
+
+		case SDL_EVENT_FINGER_UP:
+			screen_set_finger_position(screen, &event.tfinger);
+			screen_pointer_release(screen, event.tfinger.timestamp);
 			break;
 		}
 	}
@@ -590,14 +767,24 @@ void screen_rendering_start(struct Screen *screen)
 
 void screen_rendering_stop(struct Screen *screen)
 {
+	screen->frame.cpu_ns = SDL_GetTicksNS() - screen->frame_start_ns;
+	screen->last_frame   = screen->frame;
+	memset(&screen->frame, 0, sizeof(screen->frame));
+	metrics_record_frame(screen->last_frame.cpu_ns);
+	replay_frame_end(screen->last_frame.cpu_ns);
+
 	SDL_RenderPresent(screen->renderer);
 
+	// the benchmark renders as fast as it can
+	if (screen->is_headless) return;
+
 	const uint64_t ticks_used = SDL_GetTicks() - screen->ticks;
 
 	int64_t delta_ms = (1000/SCREEN_FPS)-ticks_used;
 
 	if (delta_ms < 0) return;
 
-	SDL_Delay((uint32_t)delta_ms);
+	// metric requests are answered while waiting for the next frame
+	metrics_wait((uint32_t)delta_ms);
 }
 
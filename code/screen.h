@@ -16,6 +16,29 @@
 #define MAX_OPTION_VALUE_LEN    255
 
 
+/**
+ * Drag state of the finger or the pressed mouse button, used for gestures
+ * like kinetic scrolling.
+ */
+struct Screen_Pointer {
+	bool     is_down;
+	bool     pressed;       // true for the frame in which the pointer was pressed
+	bool     released;      // true for the frame in which the pointer was released
+	float    start_x;       // press position
+	float    start_y;
+	float    delta_y;       // movement since the last frame
+	float    travel;        // max distance from the start position since pressed
+	uint64_t timestamp_ns;  // timestamp of the latest pointer event
+};
+
+/** Work of one frame, for the performance HUD. */
+struct Screen_Frame_Stats {
+	int draw_calls;
+	int texture_uploads;
+	int text_rasterizations;
+	uint64_t cpu_ns;        // from rendering start to present, without the frame delay
+};
+
 struct Screen {
 	SDL_Window     *window;
 	SDL_Renderer   *renderer;
@@ -23,8 +46,14 @@ struct Screen {
 	float          mouse_x;
 	float          mouse_y;
 	bool           mouse_clicked;
+	struct Screen_Pointer pointer;
 	uint64_t       ticks;
 	bool           quit;
+	bool           show_perf_hud;
+	bool           is_headless;    // set before screen_init(), offscreen and unpaced for the benchmark
+	uint64_t       frame_start_ns;
+	struct Screen_Frame_Stats frame;       // counted while the frame is drawn
+	struct Screen_Frame_Stats last_frame;  // the previous, completed frame
 };
 
 struct Screen_Dimension {
@@ -53,6 +82,9 @@ void screen_set_color(struct Screen *screen, enum Screen_Color color);
 void screen_draw_icon(struct Screen *screen, int x, int y, int width, int height, const char *name);
 void screen_draw_window(struct Screen *screen, int x, int y, int width, int height, const char *name);
 void screen_draw_text(struct Screen *screen, int x, int y, int font_size, const char *fmt, ...);
+SDL_Texture *screen_create_text_texture(struct Screen *screen, int font_size, const char *text);
+void screen_draw_texture(struct Screen *screen, SDL_Texture *texture, int x, int y);
+void screen_draw_texture_region(struct Screen *screen, SDL_Texture *texture, const SDL_FRect *src, int x, int y);
 void screen_draw_text_boxed(struct Screen *screen, int x, int y, int font_size, int min_width, bool is_selected, const char *fmt, ...);
 void screen_draw_box(struct Screen *screen, int x, int y, int width, int height, bool is_selected);
 void screen_draw_box_filled(struct Screen *screen, int x, int y, int width, int height, enum Screen_Color fg_color, enum Screen_Color bg_color);
@@ -1,14 +1,9 @@
 #include "screensaver.h"
 
-#include <time.h>
-#include <errno.h>
-#include <limits.h>
-
 #include "config.h"
+#include "replay.h"
 
-#include "libcutils/logger.h"
-
-static struct timespec g_tp_last_reset = {0};
+static uint64_t g_last_reset_ns = 0;
 
 void screensaver_reset(void)
 {
@@ -16,25 +11,18 @@ void screensaver_reset(void)
 		return;
 	}
 
-
-	if (clock_gettime(CLOCK_MONOTONIC, &g_tp_last_reset) != 0) {
-		log_error("deactivating screensaver, failed to get monotonic clock timepoint: %s\n", strerror(errno));
-		g_config.screensaver_delay_min = 0;
-	}
+	// the UI clock, a replayed session runs into the screensaver at the recorded time
+	g_last_reset_ns = replay_ticks_ns();
 }
 
 bool screensaver_active(void)
 {
 	if (g_config.screensaver_delay_min == 0) { return false;}
 
-	struct timespec tp_current = {0};
-	if (clock_gettime(CLOCK_MONOTONIC, &tp_current) != 0) {
-		log_error("deactivating screensaver, failed to get monotonic clock timepoint: %s\n", strerror(errno));
-		g_config.screensaver_delay_min = 0;
-		return false;
-	}
+	const uint64_t now_ns = replay_ticks_ns();
+	if (now_ns < g_last_reset_ns) return false;
 
-	const time_t diff_sec = (tp_current.tv_sec-g_tp_last_reset.tv_sec);
+	const uint64_t diff_sec = (now_ns-g_last_reset_ns) / 1000000000ull;
 
-	return (diff_sec >= g_config.screensaver_delay_min*60) ? true : false;
+	return (diff_sec >= (uint64_t) g_config.screensaver_delay_min*60) ? true : false;
 }
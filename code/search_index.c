@@ -0,0 +1,229 @@
+#include "search_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcutils/util_makros.h"
+
+#define SEARCH_INDEX_BUCKET_BITS 16
+#define SEARCH_INDEX_BUCKETS     (1u << SEARCH_INDEX_BUCKET_BITS)
+#define SEARCH_INDEX_MIN_ENTRIES 256
+
+static char to_lower_ascii(char c)
+{
+	// bytes of multibyte utf-8 sequences are kept as they are
+	return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static uint32_t trigram_bucket(const char *p)
+{
+	const uint32_t trigram = ((uint32_t)(uint8_t)p[0] << 16) |
+	                         ((uint32_t)(uint8_t)p[1] << 8)  |
+	                          (uint32_t)(uint8_t)p[2];
+
+	return (trigram * 2654435761u) >> (32 - SEARCH_INDEX_BUCKET_BITS);
+}
+
+/** Keeps the ids in ascending order, an id already listed is skipped. */
+static bool search_posting_insert(struct Search_Posting *posting, uint32_t id)
+{
+	// entries are added in ascending order, so this is almost always the end
+	uint32_t pos = posting->count;
+	if (pos > 0 && posting->ids[pos-1] >= id) {
+		uint32_t low = 0;
+		uint32_t high = posting->count;
+		while (low < high) {
+			const uint32_t mid = low + (high-low)/2;
+			if (posting->ids[mid] < id) low = mid+1;
+			else high = mid;
+		}
+		if (low < posting->count && posting->ids[low] == id) return true;
+		pos = low;
+	}
+
+	if (posting->count >= posting->capacity) {
+		const uint32_t new_capacity = MAX(posting->capacity*2, 4u);
+
+		uint32_t *ids = realloc(posting->ids, new_capacity*sizeof(posting->ids[0]));
+		if (ids == NULL) return false;
+
+		posting->ids      = ids;
+		posting->capacity = new_capacity;
+	}
+
+	memmove(&posting->ids[pos+1], &posting->ids[pos], (posting->count-pos)*sizeof(posting->ids[0]));
+	posting->ids[pos] = id;
+	posting->count++;
+	return true;
+}
+
+static Result search_index_grow(struct Search_Index *index)
+{
+	if (index->count < index->capacity) return result_make_success();
+
+	const uint32_t new_capacity = MAX(index->capacity*2, SEARCH_INDEX_MIN_ENTRIES);
+
+	size_t *offsets = realloc(index->text_offsets, new_capacity*sizeof(index->text_offsets[0]));
+	if (offsets == NULL) return result_make(false, "unable to grow search index to %u entries", new_capacity);
+	index->text_offsets = offsets;
+
+	uint32_t *results = realloc(index->results, new_capacity*sizeof(index->results[0]));
+	if (results == NULL) return result_make(false, "unable to grow search results to %u entries", new_capacity);
+	index->results = results;
+
+	index->capacity = new_capacity;
+	return result_make_success();
+}
+
+void search_index_init(struct Search_Index *index)
+{
+	memset(index, 0, sizeof(*index));
+}
+
+void search_index_free(struct Search_Index *index)
+{
+	if (index->buckets != NULL) {
+		for (size_t i=0; i < SEARCH_INDEX_BUCKETS; ++i) {
+			free(index->buckets[i].ids);
+		}
+	}
+	free(index->buckets);
+	free(index->text_data);
+	free(index->text_offsets);
+	free(index->results);
+	search_index_init(index);
+}
+
+void search_index_clear(struct Search_Index *index)
+{
+	// keep all allocations, the next build is most likely of similar size
+	if (index->buckets != NULL) {
+		for (size_t i=0; i < SEARCH_INDEX_BUCKETS; ++i) {
+			index->buckets[i].count = 0;
+		}
+	}
+	index->text_used      = 0;
+	index->count          = 0;
+	index->result_count   = 0;
+	index->has_last_query = false;
+}
+
+/** Appends the lowercased text and indexes its trigrams for the entry id. */
+static Result search_index_store(struct Search_Index *index, uint32_t id, const char *text)
+{
+	const size_t len = strlen(text);
+	if (index->text_used + len + 1 > index->text_capacity) {
+		size_t new_capacity = MAX(index->text_capacity*2, (size_t)4096);
+		while (new_capacity < index->text_used + len + 1) new_capacity *= 2;
+
+		char *data = realloc(index->text_data, new_capacity);
+		if (data == NULL) return result_make(false, "unable to grow search index text to %zu bytes", new_capacity);
+
+		index->text_data     = data;
+		index->text_capacity = new_capacity;
+	}
+
+	char *dst = index->text_data + index->text_used;
+
+	for (size_t i=0; i < len; ++i) {
+		dst[i] = to_lower_ascii(text[i]);
+	}
+	dst[len] = '\0';
+
+	index->text_offsets[id] = index->text_used;
+	index->text_used       += len + 1;
+
+	for (size_t i=0; i+3 <= len; ++i) {
+		if (!search_posting_insert(&index->buckets[trigram_bucket(dst+i)], id)) {
+			return result_make(false, "unable to grow search posting list");
+		}
+	}
+
+	index->has_last_query = false;
+	return result_make_success();
+}
+
+Result search_index_add(struct Search_Index *index, const char *text)
+{
+	if (index->buckets == NULL) {
+		index->buckets = calloc(SEARCH_INDEX_BUCKETS, sizeof(index->buckets[0]));
+		if (index->buckets == NULL) return result_make(false, "unable to allocate search index buckets");
+	}
+
+	Result r = search_index_grow(index);
+	if (!r.success) return r;
+
+	r = search_index_store(index, index->count, text);
+	if (r.success) index->count++;
+	return r;
+}
+
+Result search_index_update(struct Search_Index *index, uint32_t id, const char *text)
+{
+	if (id >= index->count) return result_make(false, "no search index entry %u", id);
+
+	return search_index_store(index, id, text);
+}
+
+static bool search_index_matches(const struct Search_Index *index, uint32_t id, const char *query)
+{
+	return strstr(index->text_data + index->text_offsets[id], query) != NULL;
+}
+
+uint32_t search_index_query(struct Search_Index *index, const char *query)
+{
+	char needle[SEARCH_INDEX_MAX_QUERY_LEN];
+	size_t len = 0;
+
+	for (; query[len] != '\0' && len+1 < sizeof(needle); ++len) {
+		needle[len] = to_lower_ascii(query[len]);
+	}
+	needle[len] = '\0';
+
+	uint32_t result_count = 0;
+
+	if (len == 0) {
+		for (uint32_t id=0; id < index->count; ++id) {
+			index->results[result_count++] = id;
+		}
+	}
+	else if (index->has_last_query && strncmp(needle, index->last_query, strlen(index->last_query)) == 0) {
+		// query got longer, every match has to be in the previous results
+		for (uint32_t i=0; i < index->result_count; ++i) {
+			const uint32_t id = index->results[i];
+			if (search_index_matches(index, id, needle)) {
+				index->results[result_count++] = id;
+			}
+		}
+	}
+	else if (len >= 3 && index->buckets != NULL) {
+		// verify the candidates of the rarest trigram of the query
+		const struct Search_Posting *rarest = NULL;
+		for (size_t i=0; i+3 <= len; ++i) {
+			const struct Search_Posting *posting = &index->buckets[trigram_bucket(needle+i)];
+			if (rarest == NULL || posting->count < rarest->count) {
+				rarest = posting;
+			}
+		}
+
+		for (uint32_t i=0; i < rarest->count; ++i) {
+			const uint32_t id = rarest->ids[i];
+			if (search_index_matches(index, id, needle)) {
+				index->results[result_count++] = id;
+			}
+		}
+	}
+	else {
+		for (uint32_t id=0; id < index->count; ++id) {
+			if (search_index_matches(index, id, needle)) {
+				index->results[result_count++] = id;
+			}
+		}
+	}
+
+	index->result_count = result_count;
+	memcpy(index->last_query, needle, len+1);
+	index->has_last_query = true;
+
+	return result_count;
+}
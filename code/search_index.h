@@ -0,0 +1,58 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+#define SEARCH_INDEX_MAX_QUERY_LEN 64
+
+struct Search_Posting {
+	uint32_t *ids;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+/**
+ * Case insensitive substring search over a list of strings, backed by a
+ * trigram index. Entries are identified by the order they were added.
+ *
+ * A query which extends the previous one only narrows down the previous
+ * results, so typing a search term costs one pass over the (shrinking)
+ * result set per keystroke.
+ */
+struct Search_Index {
+	char *text_data;          // lowercased texts, NUL separated
+	size_t text_used;
+	size_t text_capacity;
+	size_t *text_offsets;
+	uint32_t count;
+	uint32_t capacity;
+	struct Search_Posting *buckets;
+
+	uint32_t *results;
+	uint32_t result_count;
+	char last_query[SEARCH_INDEX_MAX_QUERY_LEN];
+	bool has_last_query;
+};
+
+void   search_index_init(struct Search_Index *index);
+void   search_index_free(struct Search_Index *index);
+void   search_index_clear(struct Search_Index *index);
+Result search_index_add(struct Search_Index *index, const char *text);
+
+/**
+ * Replaces the text of an entry without a rebuild, e.g. once the tags of a
+ * file arrived. The old text and its trigrams stay until the next clear,
+ * they only add candidates which fail the verification.
+ */
+Result search_index_update(struct Search_Index *index, uint32_t id, const char *text);
+
+/**
+ * Returns the number of matches, the matching entry ids are in
+ * index->results afterwards. An empty query matches everything.
+ */
+uint32_t search_index_query(struct Search_Index *index, const char *query);
+
+#endif // SEARCH_INDEX_H
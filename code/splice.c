@@ -0,0 +1,74 @@
+#include "splice.h"
+
+#include <string.h>
+
+#include "mpegframe.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+static void splice_find_overlap(struct Splice *splice, const uint8_t *frame, size_t frame_size)
+{
+	if (frame_size > splice->history_used) return;
+
+	// the newest match is the right one, older ones are most likely
+	// repeated silence
+	for (size_t pos = splice->history_used - frame_size + 1; pos-- > 0; ) {
+		if (memcmp(splice->history+pos, frame, frame_size) == 0) {
+			splice->duplicate_bytes = splice->history_used - pos;
+			log_debug("splice: skipping %zu duplicate bytes\n", splice->duplicate_bytes);
+			return;
+		}
+	}
+}
+
+void splice_reset(struct Splice *splice)
+{
+	splice->history_used    = 0;
+	splice->is_pending      = false;
+	splice->duplicate_bytes = 0;
+}
+
+void splice_begin(struct Splice *splice)
+{
+	splice->is_pending      = (splice->history_used > 0);
+	splice->duplicate_bytes = 0;
+}
+
+size_t splice_take_duplicates(struct Splice *splice, const uint8_t *frames, size_t size)
+{
+	struct Mpeg_Frame_Header header;
+
+	if (splice->is_pending && size >= MPEG_FRAME_HEADER_SIZE) {
+		if (!mpegframe_parse_header(frames, &header)) {
+			// not frame aligned, nothing to compare
+			splice->is_pending = false;
+		}
+		else if (size >= header.frame_size) {
+			splice->is_pending = false;
+			splice_find_overlap(splice, frames, header.frame_size);
+		}
+	}
+
+	const size_t duplicates = MIN(splice->duplicate_bytes, size);
+	splice->duplicate_bytes -= duplicates;
+	return duplicates;
+}
+
+void splice_record(struct Splice *splice, const uint8_t *data, size_t size)
+{
+	if (size >= sizeof(splice->history)) {
+		memcpy(splice->history, data + size - sizeof(splice->history), sizeof(splice->history));
+		splice->history_used = sizeof(splice->history);
+		return;
+	}
+
+	const size_t overflow = (splice->history_used + size > sizeof(splice->history))
+		? splice->history_used + size - sizeof(splice->history) : 0;
+
+	memmove(splice->history, splice->history+overflow, splice->history_used-overflow);
+	splice->history_used -= overflow;
+
+	memcpy(splice->history+splice->history_used, data, size);
+	splice->history_used += size;
+}
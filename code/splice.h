@@ -0,0 +1,43 @@
+#ifndef SPLICE_H
+#define SPLICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPLICE_HISTORY_SIZE (64*1024)
+
+/**
+ * Removes the overlap when a stream is continued on a new connection.
+ *
+ * Most radio servers start every connection with a burst of audio that was
+ * already sent before. The last bytes handed to the decoder are kept, the
+ * first frame of a new connection is searched in them and everything up to
+ * the end of the history is dropped as duplicate.
+ *
+ * All data passed in has to be frame aligned, see Mpeg_Framer.
+ */
+struct Splice {
+	uint8_t history[SPLICE_HISTORY_SIZE];
+	size_t history_used;
+	bool is_pending;
+	size_t duplicate_bytes;
+};
+
+/** Forgets the history, for a different stream. */
+void   splice_reset(struct Splice *splice);
+
+/** A new connection of the same stream starts. */
+void   splice_begin(struct Splice *splice);
+
+/**
+ * Returns how many bytes at the start of frames are duplicates, the caller
+ * has to drop them. Returns 0 while undecided, i.e. less than one frame was
+ * passed.
+ */
+size_t splice_take_duplicates(struct Splice *splice, const uint8_t *frames, size_t size);
+
+/** Adds data that went to the decoder to the history. */
+void   splice_record(struct Splice *splice, const uint8_t *data, size_t size);
+
+#endif // SPLICE_H
@@ -0,0 +1,100 @@
+#include "spsc_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcutils/util_makros.h"
+
+Result spsc_ring_init(struct Spsc_Ring *ring, size_t capacity)
+{
+	if (capacity == 0 || (capacity & (capacity-1)) != 0) {
+		return result_make(false, "ring capacity %zu is not a power of two", capacity);
+	}
+
+	ring->data = malloc(capacity);
+	if (ring->data == NULL) {
+		return result_make(false, "unable to allocate ring of %zu bytes", capacity);
+	}
+
+	ring->capacity = capacity;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return result_make_success();
+}
+
+void spsc_ring_free(struct Spsc_Ring *ring)
+{
+	free(ring->data);
+	ring->data     = NULL;
+	ring->capacity = 0;
+}
+
+void spsc_ring_reset(struct Spsc_Ring *ring)
+{
+	atomic_store(&ring->head, 0);
+	atomic_store(&ring->tail, 0);
+}
+
+size_t spsc_ring_bytes_used(const struct Spsc_Ring *ring)
+{
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	return head - tail;
+}
+
+size_t spsc_ring_bytes_free(const struct Spsc_Ring *ring)
+{
+	return ring->capacity - spsc_ring_bytes_used(ring);
+}
+
+size_t spsc_ring_write(struct Spsc_Ring *ring, const void *data, size_t size)
+{
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	size = MIN(size, ring->capacity - (head - tail));
+	if (size == 0) return 0;
+
+	const size_t offset = head & (ring->capacity-1);
+	const size_t first  = MIN(size, ring->capacity - offset);
+
+	memcpy(ring->data + offset, data, first);
+	memcpy(ring->data, (const uint8_t *)data + first, size - first);
+
+	atomic_store_explicit(&ring->head, head + size, memory_order_release);
+	return size;
+}
+
+size_t spsc_ring_read(struct Spsc_Ring *ring, void *dst, size_t size)
+{
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	size = MIN(size, head - tail);
+	if (size == 0) return 0;
+
+	const size_t offset = tail & (ring->capacity-1);
+	const size_t first  = MIN(size, ring->capacity - offset);
+
+	memcpy(dst, ring->data + offset, first);
+	memcpy((uint8_t *)dst + first, ring->data, size - first);
+
+	atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+	return size;
+}
+
+const uint8_t *spsc_ring_peek(const struct Spsc_Ring *ring, size_t *size)
+{
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	const size_t offset = tail & (ring->capacity-1);
+	*size = MIN(head - tail, ring->capacity - offset);
+	return ring->data + offset;
+}
+
+void spsc_ring_consume(struct Spsc_Ring *ring, size_t size)
+{
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+}
@@ -0,0 +1,43 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Lock-free byte ring for exactly one producer and one consumer thread.
+ *
+ * head and tail are free running counters, the capacity is a power of two so
+ * the index is a simple mask. Only spsc_ring_reset() requires both sides to
+ * be stopped.
+ */
+struct Spsc_Ring {
+	uint8_t *data;
+	size_t capacity;
+	_Atomic size_t head; // written by the producer
+	_Atomic size_t tail; // written by the consumer
+};
+
+Result spsc_ring_init(struct Spsc_Ring *ring, size_t capacity);
+void   spsc_ring_free(struct Spsc_Ring *ring);
+void   spsc_ring_reset(struct Spsc_Ring *ring);
+size_t spsc_ring_bytes_used(const struct Spsc_Ring *ring);
+size_t spsc_ring_bytes_free(const struct Spsc_Ring *ring);
+
+/** Returns the number of bytes actually written, never blocks. */
+size_t spsc_ring_write(struct Spsc_Ring *ring, const void *data, size_t size);
+
+/** Returns the number of bytes actually read, never blocks. */
+size_t spsc_ring_read(struct Spsc_Ring *ring, void *dst, size_t size);
+
+/**
+ * Returns the readable bytes in place, size is limited to the end of the
+ * ring. The consumer advances with spsc_ring_consume() once done with them.
+ */
+const uint8_t *spsc_ring_peek(const struct Spsc_Ring *ring, size_t *size);
+void   spsc_ring_consume(struct Spsc_Ring *ring, size_t size);
+
+#endif // SPSC_RING_H
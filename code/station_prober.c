@@ -0,0 +1,414 @@
+#include "station_prober.h"
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <curl/curl.h>
+#include <SDL3/SDL.h>
+
+#include "config.h"
+#include "mpegframe.h"
+#include "netcache.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define PROBER_MAX_URL_LEN           2048
+#define PROBER_SAMPLE_SIZE           (8*1024)
+#define PROBER_CONNECT_TIMEOUT_MS    4000L
+#define PROBER_TIMEOUT_MS            8000L
+#define PROBER_SLOW_TTFB_MS          1500
+#define PROBER_POLL_TIMEOUT_MS       100
+#define PROBER_MAX_PARALLEL          8     // leaves the bandwidth to the playing station
+#define PROBER_CACHE_FILE            "probes.txt"
+
+struct Prober_Station {
+	char url[PROBER_MAX_URL_LEN];
+
+	// guarded by g_prober.lock
+	struct Station_Probe result;
+	time_t probed_at;
+
+	// only touched by the prober thread
+	CURL *curl;
+	uint8_t sample[PROBER_SAMPLE_SIZE];
+	size_t sample_used;
+	int header_kbps;
+	int frame_kbps;
+};
+
+static struct {
+	struct Prober_Station *stations;
+	size_t count;
+
+	pthread_t thread;
+	bool is_running;
+
+	pthread_mutex_t lock;
+	bool is_lock_initialized;
+	bool quit;
+	CURLM *multi;
+} g_prober;
+
+static bool prober_should_quit(void)
+{
+	pthread_mutex_lock(&g_prober.lock);
+	const bool quit = g_prober.quit;
+	pthread_mutex_unlock(&g_prober.lock);
+	return quit;
+}
+
+static bool prober_get_cache_file(char *path, size_t path_size)
+{
+	char dir[PATH_MAX];
+
+	Result r = config_get_cache_path("radio", dir, sizeof(dir));
+	if (!r.success) {
+		log_warning("prober: no cache: %s\n", r.msg);
+		return false;
+	}
+
+	snprintf(path, path_size, "%s/%s", dir, PROBER_CACHE_FILE);
+	return true;
+}
+
+static struct Prober_Station *prober_find(const char *url)
+{
+	for (size_t i=0; i < g_prober.count; ++i) {
+		if (strcmp(g_prober.stations[i].url, url) == 0) return &g_prober.stations[i];
+	}
+	return NULL;
+}
+
+/**
+ * Every line is "<probed_at> <state> <ttfb_ms> <bitrate_kbps> <url>",
+ * the fields are separated by tabs.
+ */
+static void prober_load_cache(void)
+{
+	char path[PATH_MAX+32];
+	if (g_config.radio_probe_ttl_min <= 0 || !prober_get_cache_file(path, sizeof(path))) return;
+
+	FILE *file = fopen(path, "r");
+	if (file == NULL) return;
+
+	const time_t now = time(NULL);
+	const time_t ttl = (time_t) g_config.radio_probe_ttl_min * 60;
+	size_t loaded    = 0;
+
+	char line[PROBER_MAX_URL_LEN+64];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		long long probed_at = 0;
+		int state = 0, ttfb_ms = 0, bitrate_kbps = 0, url_pos = 0;
+
+		if (sscanf(line, "%lld\t%d\t%d\t%d\t%n", &probed_at, &state, &ttfb_ms, &bitrate_kbps, &url_pos) != 4) continue;
+		if (url_pos == 0 || state < STATION_PROBE_OK || state > STATION_PROBE_DEAD) continue;
+		if (now - (time_t)probed_at >= ttl || (time_t)probed_at > now) continue;
+
+		char *url = line + url_pos;
+		url[strcspn(url, "\r\n")] = '\0';
+
+		struct Prober_Station *station = prober_find(url);
+		if (station == NULL) continue;
+
+		station->probed_at           = (time_t) probed_at;
+		station->result.state        = (enum Station_Probe_State) state;
+		station->result.ttfb_ms      = ttfb_ms;
+		station->result.bitrate_kbps = bitrate_kbps;
+		++loaded;
+	}
+
+	fclose(file);
+	log_debug("prober: %zu of %zu stations taken from cache\n", loaded, g_prober.count);
+}
+
+static void prober_save_cache(void)
+{
+	char path[PATH_MAX+32];
+	if (g_config.radio_probe_ttl_min <= 0 || !prober_get_cache_file(path, sizeof(path))) return;
+
+	char tmp_path[PATH_MAX+40];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	FILE *file = fopen(tmp_path, "w");
+	if (file == NULL) {
+		log_warning("prober: unable to write %s\n", tmp_path);
+		return;
+	}
+
+	pthread_mutex_lock(&g_prober.lock);
+	for (size_t i=0; i < g_prober.count; ++i) {
+		const struct Prober_Station *station = &g_prober.stations[i];
+		if (station->result.state == STATION_PROBE_UNKNOWN) continue;
+
+		fprintf(file, "%lld\t%d\t%d\t%d\t%s\n", (long long) station->probed_at,
+			station->result.state, station->result.ttfb_ms, station->result.bitrate_kbps, station->url);
+	}
+	pthread_mutex_unlock(&g_prober.lock);
+
+	const bool is_written = (fclose(file) == 0);
+	if (!is_written || rename(tmp_path, path) != 0) {
+		log_warning("prober: unable to write %s\n", path);
+		remove(tmp_path);
+	}
+}
+
+/**
+ * Looks for two consecutive frame headers, a single match is too likely to
+ * be random data.
+ */
+static int prober_find_frame_bitrate(const uint8_t *data, size_t size)
+{
+	for (size_t i=0; i+MPEG_FRAME_HEADER_SIZE <= size; ++i) {
+		struct Mpeg_Frame_Header first, second;
+
+		if (!mpegframe_parse_header(data+i, &first)) continue;
+
+		const size_t next = i + first.frame_size;
+		if (next+MPEG_FRAME_HEADER_SIZE > size) return 0;
+
+		if (mpegframe_parse_header(data+next, &second) &&
+		    second.version == first.version && second.layer == first.layer &&
+		    second.samplerate_hz == first.samplerate_hz) {
+			return first.bitrate_kbps;
+		}
+	}
+	return 0;
+}
+
+static size_t prober_write_callback(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	struct Prober_Station *station = userdata;
+	const size_t bytes_total = size * nmemb;
+
+	const size_t bytes_taken = MIN(bytes_total, sizeof(station->sample) - station->sample_used);
+	memcpy(station->sample+station->sample_used, ptr, bytes_taken);
+	station->sample_used += bytes_taken;
+
+	station->frame_kbps = prober_find_frame_bitrate(station->sample, station->sample_used);
+
+	// enough seen, aborting is the only way to end an endless stream
+	if (station->frame_kbps > 0 || station->sample_used == sizeof(station->sample)) {
+		return CURL_WRITEFUNC_ERROR;
+	}
+	return bytes_total;
+}
+
+static size_t prober_header_callback(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+	struct Prober_Station *station = userdata;
+	const size_t bytes_total = size * nitems;
+
+	// icecast and shoutcast announce the nominal bitrate, used for non mpeg streams
+	if (bytes_total > 7 && strncasecmp(buffer, "icy-br:", 7) == 0) {
+		char value[16] = {0};
+		memcpy(value, buffer+7, MIN(bytes_total-7, sizeof(value)-1));
+		station->header_kbps = atoi(value);
+	}
+	return bytes_total;
+}
+
+static bool prober_add(CURLM *multi, struct Prober_Station *station)
+{
+	CURL *curl = netcache_acquire();
+	if (curl == NULL) return false;
+
+	curl_easy_setopt(curl, CURLOPT_URL, station->url);
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, station);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, prober_write_callback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, station);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, prober_header_callback);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, station);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "DuckAI/1.0");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, PROBER_CONNECT_TIMEOUT_MS);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, PROBER_TIMEOUT_MS);
+
+	if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+		netcache_release(curl);
+		return false;
+	}
+
+	station->curl        = curl;
+	station->sample_used = 0;
+	station->header_kbps = 0;
+	station->frame_kbps  = 0;
+	return true;
+}
+
+static void prober_finish(CURLM *multi, struct Prober_Station *station, CURLcode code)
+{
+	curl_off_t first_byte_us = 0;
+	curl_easy_getinfo(station->curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us);
+
+	struct Station_Probe result = {0};
+	result.ttfb_ms      = (int)(first_byte_us / 1000);
+	result.bitrate_kbps = (station->frame_kbps > 0) ? station->frame_kbps : station->header_kbps;
+
+	// failonerror is set, so any body data means the stream is there
+	if (station->sample_used == 0) {
+		result.state = STATION_PROBE_DEAD;
+	}
+	else if (result.ttfb_ms > PROBER_SLOW_TTFB_MS) {
+		result.state = STATION_PROBE_SLOW;
+	}
+	else {
+		result.state = STATION_PROBE_OK;
+	}
+
+	if (result.state == STATION_PROBE_DEAD) {
+		log_debug("prober: %s is dead: %s\n", station->url, curl_easy_strerror(code));
+	}
+
+	pthread_mutex_lock(&g_prober.lock);
+	station->result    = result;
+	station->probed_at = time(NULL);
+	pthread_mutex_unlock(&g_prober.lock);
+
+	curl_multi_remove_handle(multi, station->curl);
+	netcache_release(station->curl);
+	station->curl = NULL;
+}
+
+/** Starts the next stations until PROBER_MAX_PARALLEL probes are running. */
+static void prober_add_next(CURLM *multi, size_t *next, size_t *active, size_t *probed)
+{
+	for (; *next < g_prober.count && *active < PROBER_MAX_PARALLEL; ++(*next)) {
+		struct Prober_Station *station = &g_prober.stations[*next];
+		if (station->result.state != STATION_PROBE_UNKNOWN) continue;
+
+		if (!prober_add(multi, station)) {
+			log_warning("prober: unable to probe %s\n", station->url);
+			continue;
+		}
+		++(*active);
+		++(*probed);
+	}
+}
+
+static void *prober_thread(void *arg)
+{
+	UNUSED(arg);
+
+	CURLM *multi  = g_prober.multi;
+	size_t next   = 0;
+	size_t active = 0;
+	size_t probed = 0;
+
+	const uint64_t start_ms = SDL_GetTicks();
+	int running = 0;
+
+	while (!prober_should_quit()) {
+		prober_add_next(multi, &next, &active, &probed);
+		curl_multi_perform(multi, &running);
+
+		CURLMsg *msg = NULL;
+		int msgs_left = 0;
+		while ((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+			if (msg->msg != CURLMSG_DONE) continue;
+
+			struct Prober_Station *station = NULL;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**) &station);
+			prober_finish(multi, station, msg->data.result);
+			--active;
+		}
+
+		if (running == 0 && next == g_prober.count) break;
+		curl_multi_poll(multi, NULL, 0, PROBER_POLL_TIMEOUT_MS, NULL);
+	}
+
+	// stopped early, whatever is still running stays unknown
+	for (size_t i=0; i < g_prober.count; ++i) {
+		struct Prober_Station *station = &g_prober.stations[i];
+		if (station->curl == NULL) continue;
+
+		curl_multi_remove_handle(multi, station->curl);
+		netcache_release(station->curl);
+		station->curl = NULL;
+	}
+
+	if (probed > 0) {
+		log_info("prober: probed %zu stations in %llu ms\n", probed,
+			(unsigned long long)(SDL_GetTicks() - start_ms));
+		prober_save_cache();
+	}
+	return NULL;
+}
+
+void station_prober_start(const char *const *urls, size_t count)
+{
+	station_prober_stop();
+
+	if (!g_config.radio_probe || count == 0) return;
+
+	if (!g_prober.is_lock_initialized) {
+		pthread_mutex_init(&g_prober.lock, NULL);
+		g_prober.is_lock_initialized = true;
+	}
+
+	g_prober.stations = calloc(count, sizeof(g_prober.stations[0]));
+	if (g_prober.stations == NULL) {
+		log_error("prober: unable to allocate %zu stations\n", count);
+		return;
+	}
+	g_prober.count = count;
+
+	for (size_t i=0; i < count; ++i) {
+		snprintf(g_prober.stations[i].url, sizeof(g_prober.stations[i].url), "%s", urls[i]);
+	}
+
+	prober_load_cache();
+
+	g_prober.multi = curl_multi_init();
+	if (g_prober.multi == NULL) {
+		log_error("prober: curl multi init failed\n");
+		return;
+	}
+	curl_multi_setopt(g_prober.multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) PROBER_MAX_PARALLEL);
+
+	g_prober.quit = false;
+	if (pthread_create(&g_prober.thread, NULL, prober_thread, NULL) != 0) {
+		log_error("prober: failed to start thread\n");
+		return;
+	}
+	g_prober.is_running = true;
+}
+
+void station_prober_stop(void)
+{
+	if (g_prober.is_running) {
+		pthread_mutex_lock(&g_prober.lock);
+		g_prober.quit = true;
+		pthread_mutex_unlock(&g_prober.lock);
+
+		curl_multi_wakeup(g_prober.multi);
+		pthread_join(g_prober.thread, NULL);
+		g_prober.is_running = false;
+	}
+
+	if (g_prober.multi != NULL) {
+		curl_multi_cleanup(g_prober.multi);
+		g_prober.multi = NULL;
+	}
+
+	free(g_prober.stations);
+	g_prober.stations = NULL;
+	g_prober.count    = 0;
+}
+
+bool station_prober_get(size_t index, struct Station_Probe *probe)
+{
+	if (index >= g_prober.count) return false;
+
+	pthread_mutex_lock(&g_prober.lock);
+	*probe = g_prober.stations[index].result;
+	pthread_mutex_unlock(&g_prober.lock);
+
+	return probe->state != STATION_PROBE_UNKNOWN;
+}
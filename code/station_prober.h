@@ -0,0 +1,36 @@
+#ifndef STATION_PROBER_H
+#define STATION_PROBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum Station_Probe_State {
+	STATION_PROBE_UNKNOWN,
+	STATION_PROBE_OK,
+	STATION_PROBE_SLOW,
+	STATION_PROBE_DEAD,
+};
+
+struct Station_Probe {
+	enum Station_Probe_State state;
+	int ttfb_ms;
+	int bitrate_kbps;   // 0 if neither the frames nor the headers tell
+};
+
+/**
+ * Checks all radio stations in the background for reachability, time to
+ * first byte and bitrate.
+ *
+ * A single thread drives every probe through one curl_multi handle, so all
+ * stations are checked concurrently. A probe ends as soon as the first two
+ * MPEG frame headers arrived. Results are cached in <cache_dir>/radio for
+ * radio_probe_ttl_minutes, stations with a fresh entry are not probed again.
+ *
+ * The urls are copied, results are looked up by the index into urls.
+ */
+void station_prober_start(const char *const *urls, size_t count);
+void station_prober_stop(void);
+
+bool station_prober_get(size_t index, struct Station_Probe *probe);
+
+#endif // STATION_PROBER_H
@@ -0,0 +1,620 @@
+#include "tagreader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define ID3V2_HEADER_SIZE       10
+#define ID3V2_MAX_FRAME_HEADER  10
+#define ID3V1_TAG_SIZE          128
+#define ID3_MAX_TEXT_FRAME_SIZE 1024
+#define ID3_MAX_PICTURE_HEADER  512
+#define ID3_MAX_PICTURE_SIZE    (16*1024*1024)
+#define ID3_PICTURE_FRONT_COVER 3
+#define TAGREADER_MAX_WORKERS   16
+
+enum Id3_Text_Encoding {
+	ID3_ENCODING_LATIN1   = 0,
+	ID3_ENCODING_UTF16    = 1,
+	ID3_ENCODING_UTF16_BE = 2,
+	ID3_ENCODING_UTF8     = 3
+};
+
+static uint32_t read_syncsafe32(const uint8_t *p)
+{
+	return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) |
+	       ((uint32_t)(p[2] & 0x7F) << 7)  |  (uint32_t)(p[3] & 0x7F);
+}
+
+static uint32_t read_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint32_t read_be24(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+}
+
+static bool append_utf8(char *dst, size_t dst_size, size_t *len, uint32_t codepoint)
+{
+	uint8_t encoded[4];
+	size_t  n = 0;
+
+	if (codepoint < 0x80) {
+		encoded[n++] = (uint8_t) codepoint;
+	}
+	else if (codepoint < 0x800) {
+		encoded[n++] = (uint8_t)(0xC0 | (codepoint >> 6));
+		encoded[n++] = (uint8_t)(0x80 | (codepoint & 0x3F));
+	}
+	else if (codepoint < 0x10000) {
+		encoded[n++] = (uint8_t)(0xE0 | (codepoint >> 12));
+		encoded[n++] = (uint8_t)(0x80 | ((codepoint >> 6) & 0x3F));
+		encoded[n++] = (uint8_t)(0x80 | (codepoint & 0x3F));
+	}
+	else {
+		encoded[n++] = (uint8_t)(0xF0 | (codepoint >> 18));
+		encoded[n++] = (uint8_t)(0x80 | ((codepoint >> 12) & 0x3F));
+		encoded[n++] = (uint8_t)(0x80 | ((codepoint >> 6) & 0x3F));
+		encoded[n++] = (uint8_t)(0x80 | (codepoint & 0x3F));
+	}
+
+	// never cut a multibyte sequence in half
+	if (*len + n >= dst_size) return false;
+
+	memcpy(dst + *len, encoded, n);
+	*len += n;
+	return true;
+}
+
+/** Drops a multibyte sequence which was cut off at the end of s[0..len). */
+static size_t trim_incomplete_utf8(const char *s, size_t len)
+{
+	// walk back over continuation bytes to the lead byte of the last sequence
+	size_t start = len;
+	while (start > 0 && len-start < 4 && ((uint8_t)s[start-1] & 0xC0) == 0x80) {
+		--start;
+	}
+	if (start == 0) return len;
+
+	const uint8_t lead = (uint8_t) s[start-1];
+	size_t expected = 1;
+	if      ((lead & 0xE0) == 0xC0) expected = 2;
+	else if ((lead & 0xF0) == 0xE0) expected = 3;
+	else if ((lead & 0xF8) == 0xF0) expected = 4;
+
+	return (len-(start-1) < expected) ? start-1 : len;
+}
+
+static void trim_trailing_spaces(char *s)
+{
+	size_t len = strlen(s);
+	while (len > 0 && (s[len-1] == ' ' || s[len-1] == '\t')) {
+		s[--len] = '\0';
+	}
+}
+
+static void decode_latin1(const uint8_t *data, size_t size, char *dst, size_t dst_size)
+{
+	size_t len = 0;
+
+	for (size_t i=0; i < size && data[i] != '\0'; ++i) {
+		if (!append_utf8(dst, dst_size, &len, data[i])) break;
+	}
+	dst[len] = '\0';
+}
+
+static void decode_utf16(const uint8_t *data, size_t size, bool big_endian, char *dst, size_t dst_size)
+{
+	size_t len = 0;
+
+	for (size_t i=0; i+1 < size; i += 2) {
+		uint32_t unit = big_endian ? ((uint32_t)data[i] << 8 | data[i+1])
+		                           : ((uint32_t)data[i+1] << 8 | data[i]);
+		if (unit == 0) break;
+
+		uint32_t codepoint = unit;
+
+		if (IN_RANGE(unit, 0xD800, 0xDBFF) && i+3 < size) {
+			uint32_t low = big_endian ? ((uint32_t)data[i+2] << 8 | data[i+3])
+			                          : ((uint32_t)data[i+3] << 8 | data[i+2]);
+			if (IN_RANGE(low, 0xDC00, 0xDFFF)) {
+				codepoint = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+				i += 2;
+			}
+			else {
+				codepoint = 0xFFFD;
+			}
+		}
+		else if (IN_RANGE(unit, 0xD800, 0xDFFF)) {
+			codepoint = 0xFFFD;
+		}
+
+		if (!append_utf8(dst, dst_size, &len, codepoint)) break;
+	}
+	dst[len] = '\0';
+}
+
+static void id3_decode_text_frame(const uint8_t *data, size_t size, char *dst, size_t dst_size)
+{
+	dst[0] = '\0';
+	if (size < 2) return;
+
+	const uint8_t encoding = data[0];
+	++data;
+	--size;
+
+	switch (encoding) {
+	case ID3_ENCODING_LATIN1:
+		decode_latin1(data, size, dst, dst_size);
+		break;
+
+	case ID3_ENCODING_UTF16: {
+		bool big_endian = false;
+		if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+			big_endian = true;
+		}
+		if (size >= 2 && (data[0] == 0xFE || data[0] == 0xFF)) {
+			data += 2;
+			size -= 2;
+		}
+		decode_utf16(data, size, big_endian, dst, dst_size);
+		break;
+	}
+
+	case ID3_ENCODING_UTF16_BE:
+		decode_utf16(data, size, true, dst, dst_size);
+		break;
+
+	case ID3_ENCODING_UTF8: {
+		// v2.4 allows several NUL separated strings, only the first is used
+		size_t len = strnlen((const char *)data, MIN(size, dst_size-1));
+		len = trim_incomplete_utf8((const char *)data, len);
+		memcpy(dst, data, len);
+		dst[len] = '\0';
+		break;
+	}
+
+	default:
+		log_debug("unknown id3 text encoding %u\n", encoding);
+		break;
+	}
+
+	trim_trailing_spaces(dst);
+}
+
+struct Id3_Frame {
+	char id[5];
+	uint8_t version;
+	off_t data_pos;
+	uint32_t data_size;
+	bool is_plain; // neither compressed, encrypted nor unsynchronised
+};
+
+/**
+ * Calls visit() for every frame of the id3v2 tag until it returns false.
+ * Flags, grouping ids and data length indicators are already stripped from
+ * data_pos/data_size.
+ */
+static void id3v2_for_each_frame(int fd, bool (*visit)(int fd, const struct Id3_Frame *frame, void *userdata), void *userdata)
+{
+	uint8_t header[ID3V2_HEADER_SIZE];
+
+	if (pread(fd, header, sizeof(header), 0) != (ssize_t) sizeof(header)) return;
+	if (memcmp(header, "ID3", 3) != 0) return;
+
+	const uint8_t version = header[3];
+	const uint8_t flags   = header[5];
+
+	if (!IN_RANGE(version, 2, 4)) {
+		log_debug("unsupported id3v2 version 2.%u\n", version);
+		return;
+	}
+
+	// whole-tag unsynchronisation would require reading the full tag,
+	// leave these rare files to the id3v1 fallback
+	if ((flags & 0x80) != 0 && version < 4) {
+		log_debug("skipping unsynchronised id3v2.%u tag\n", version);
+		return;
+	}
+
+	const off_t tag_end = ID3V2_HEADER_SIZE + (off_t) read_syncsafe32(header+6);
+	off_t pos = ID3V2_HEADER_SIZE;
+
+	if ((flags & 0x40) != 0 && version >= 3) {
+		uint8_t ext_size[4];
+		if (pread(fd, ext_size, sizeof(ext_size), pos) != (ssize_t) sizeof(ext_size)) return;
+
+		// v2.3 excludes the size field itself, v2.4 includes it
+		pos += (version == 3) ? 4 + (off_t) read_be32(ext_size) : (off_t) read_syncsafe32(ext_size);
+	}
+
+	const size_t frame_header_size = (version == 2) ? 6 : 10;
+	const size_t frame_id_len      = (version == 2) ? 3 : 4;
+
+	while (pos + (off_t) frame_header_size <= tag_end) {
+
+		uint8_t frame_header[ID3V2_MAX_FRAME_HEADER];
+		if (pread(fd, frame_header, frame_header_size, pos) != (ssize_t) frame_header_size) break;
+
+		// reached the padding area
+		if (frame_header[0] == '\0') break;
+
+		uint32_t frame_size = 0;
+		switch (version) {
+			case 2 : frame_size = read_be24(frame_header+3); break;
+			case 3 : frame_size = read_be32(frame_header+4); break;
+			default: frame_size = read_syncsafe32(frame_header+4); break;
+		}
+
+		pos += (off_t) frame_header_size;
+		if (frame_size == 0 || pos + (off_t) frame_size > tag_end) break;
+
+		struct Id3_Frame frame = {
+			.version  = version,
+			.is_plain = true
+		};
+		memcpy(frame.id, frame_header, frame_id_len);
+		frame.id[frame_id_len] = '\0';
+
+		off_t data_offset = 0;
+		if (version == 3) {
+			if ((frame_header[9] & 0xC0) != 0) frame.is_plain = false; // compressed or encrypted
+			if ((frame_header[9] & 0x20) != 0) data_offset = 1;         // grouping id
+		}
+		else if (version == 4) {
+			if ((frame_header[9] & 0x0E) != 0) frame.is_plain = false; // compressed, encrypted or unsynchronised
+			if ((frame_header[9] & 0x40) != 0) data_offset += 1;        // grouping id
+			if ((frame_header[9] & 0x01) != 0) data_offset += 4;        // data length indicator
+		}
+
+		if ((off_t) frame_size > data_offset) {
+			frame.data_pos  = pos + data_offset;
+			frame.data_size = frame_size - (uint32_t) data_offset;
+
+			if (!visit(fd, &frame, userdata)) break;
+		}
+
+		pos += (off_t) frame_size;
+	}
+}
+
+static bool visit_text_frame(int fd, const struct Id3_Frame *frame, void *userdata)
+{
+	struct Audio_Metadata *metadata = userdata;
+
+	const bool is_v22   = (frame->version == 2);
+	char      *dst      = NULL;
+	size_t     dst_size = 0;
+
+	if (strcmp(frame->id, is_v22 ? "TP1" : "TPE1") == 0) {
+		dst      = metadata->artist;
+		dst_size = sizeof(metadata->artist);
+	}
+	else if (strcmp(frame->id, is_v22 ? "TT2" : "TIT2") == 0) {
+		dst      = metadata->title;
+		dst_size = sizeof(metadata->title);
+	}
+
+	if (dst != NULL && dst[0] == '\0' && frame->is_plain) {
+		uint8_t buffer[ID3_MAX_TEXT_FRAME_SIZE];
+		const size_t bytes = MIN((size_t) frame->data_size, sizeof(buffer));
+
+		if (pread(fd, buffer, bytes, frame->data_pos) == (ssize_t) bytes) {
+			id3_decode_text_frame(buffer, bytes, dst, dst_size);
+		}
+	}
+
+	return (metadata->artist[0] == '\0' || metadata->title[0] == '\0');
+}
+
+static void read_id3v2(int fd, struct Audio_Metadata *metadata)
+{
+	id3v2_for_each_frame(fd, visit_text_frame, metadata);
+}
+
+static void read_id3v1(int fd, struct Audio_Metadata *metadata)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < ID3V1_TAG_SIZE) return;
+
+	uint8_t tag[ID3V1_TAG_SIZE];
+	if (pread(fd, tag, sizeof(tag), st.st_size - ID3V1_TAG_SIZE) != (ssize_t) sizeof(tag)) return;
+	if (memcmp(tag, "TAG", 3) != 0) return;
+
+	if (metadata->title[0] == '\0') {
+		decode_latin1(tag+3, 30, metadata->title, sizeof(metadata->title));
+		trim_trailing_spaces(metadata->title);
+	}
+	if (metadata->artist[0] == '\0') {
+		decode_latin1(tag+33, 30, metadata->artist, sizeof(metadata->artist));
+		trim_trailing_spaces(metadata->artist);
+	}
+}
+
+Result tagreader_read(const char *filepath, struct Audio_Metadata *metadata)
+{
+	memset(metadata, 0, sizeof(*metadata));
+
+	int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return result_make(false, "unable to open %s: %s", filepath, strerror(errno));
+	}
+
+	read_id3v2(fd, metadata);
+
+	if (metadata->artist[0] == '\0' || metadata->title[0] == '\0') {
+		read_id3v1(fd, metadata);
+	}
+	close(fd);
+
+	if (metadata->artist[0] == '\0' && metadata->title[0] == '\0') {
+		return result_make(false, "no id3 tags contained!");
+	}
+	return result_make_success();
+}
+
+struct Picture_Candidate {
+	off_t data_pos;
+	size_t data_size;
+	bool is_front_cover;
+};
+
+static size_t id3_skip_string(const uint8_t *data, size_t size, size_t pos, uint8_t encoding)
+{
+	const bool is_utf16 = (encoding == ID3_ENCODING_UTF16 || encoding == ID3_ENCODING_UTF16_BE);
+
+	if (is_utf16) {
+		for (; pos+1 < size; pos += 2) {
+			if (data[pos] == '\0' && data[pos+1] == '\0') return pos+2;
+		}
+	}
+	else {
+		for (; pos < size; ++pos) {
+			if (data[pos] == '\0') return pos+1;
+		}
+	}
+	return size;
+}
+
+static bool visit_picture_frame(int fd, const struct Id3_Frame *frame, void *userdata)
+{
+	struct Picture_Candidate *candidate = userdata;
+
+	const bool is_v22 = (frame->version == 2);
+	if (strcmp(frame->id, is_v22 ? "PIC" : "APIC") != 0 || !frame->is_plain) return true;
+
+	uint8_t header[ID3_MAX_PICTURE_HEADER];
+	const size_t bytes = MIN((size_t) frame->data_size, sizeof(header));
+	if (pread(fd, header, bytes, frame->data_pos) != (ssize_t) bytes) return true;
+
+	// <encoding> <mime type or 3 byte format> <picture type> <description> <data>
+	const uint8_t encoding = header[0];
+	size_t pos = is_v22 ? 4 : id3_skip_string(header, bytes, 1, ID3_ENCODING_LATIN1);
+	if (pos >= bytes) return true;
+
+	const uint8_t picture_type = header[pos++];
+	pos = id3_skip_string(header, bytes, pos, encoding);
+
+	// a description longer than the header buffer is not worth supporting
+	if (pos >= bytes) return true;
+
+	const bool is_front_cover = (picture_type == ID3_PICTURE_FRONT_COVER);
+
+	if (candidate->data_size == 0 || is_front_cover) {
+		candidate->data_pos       = frame->data_pos + (off_t) pos;
+		candidate->data_size      = frame->data_size - pos;
+		candidate->is_front_cover = is_front_cover;
+	}
+
+	return !is_front_cover;
+}
+
+Result tagreader_read_picture(const char *filepath, void **data, size_t *size)
+{
+	*data = NULL;
+	*size = 0;
+
+	int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return result_make(false, "unable to open %s: %s", filepath, strerror(errno));
+	}
+
+	struct Picture_Candidate candidate = {0};
+	id3v2_for_each_frame(fd, visit_picture_frame, &candidate);
+
+	if (candidate.data_size == 0) {
+		close(fd);
+		return result_make(false, "no id3 picture contained!");
+	}
+	if (candidate.data_size > ID3_MAX_PICTURE_SIZE) {
+		close(fd);
+		return result_make(false, "id3 picture too large (%zu bytes)", candidate.data_size);
+	}
+
+	void *buffer = malloc(candidate.data_size);
+	if (buffer == NULL) {
+		close(fd);
+		return result_make(false, "unable to allocate %zu bytes for id3 picture", candidate.data_size);
+	}
+
+	if (pread(fd, buffer, candidate.data_size, candidate.data_pos) != (ssize_t) candidate.data_size) {
+		free(buffer);
+		close(fd);
+		return result_make(false, "unable to read id3 picture of %s", filepath);
+	}
+	close(fd);
+
+	*data = buffer;
+	*size = candidate.data_size;
+	return result_make_success();
+}
+
+struct Tagreader_Job {
+	struct Tagreader_Job *next;
+	size_t id;
+	unsigned generation;
+	char filepath[];
+};
+
+struct Tagreader_Done {
+	struct Tagreader_Done *next;
+	struct Tagreader_Result result;
+};
+
+static struct Tagreader_Pool {
+	pthread_t workers[TAGREADER_MAX_WORKERS];
+	size_t worker_count;
+	pthread_mutex_t lock;
+	pthread_cond_t has_jobs;
+	struct Tagreader_Job  *jobs_head;
+	struct Tagreader_Job  *jobs_tail;
+	struct Tagreader_Done *done_head;
+	struct Tagreader_Done *done_tail;
+	unsigned generation;
+	bool is_initialized;
+} g_pool;
+
+static void *tagreader_worker(void *arg)
+{
+	UNUSED(arg);
+
+	while (true) {
+		pthread_mutex_lock(&g_pool.lock);
+		while (g_pool.jobs_head == NULL) {
+			pthread_cond_wait(&g_pool.has_jobs, &g_pool.lock);
+		}
+
+		struct Tagreader_Job *job = g_pool.jobs_head;
+		g_pool.jobs_head = job->next;
+		if (g_pool.jobs_head == NULL) g_pool.jobs_tail = NULL;
+		pthread_mutex_unlock(&g_pool.lock);
+
+		struct Tagreader_Done *done = malloc(sizeof(*done));
+		if (done == NULL) {
+			free(job);
+			continue;
+		}
+
+		done->next      = NULL;
+		done->result.id = job->id;
+		Result r = tagreader_read(job->filepath, &done->result.metadata);
+
+		pthread_mutex_lock(&g_pool.lock);
+		if (r.success && job->generation == g_pool.generation) {
+			if (g_pool.done_tail != NULL) g_pool.done_tail->next = done;
+			else                          g_pool.done_head       = done;
+			g_pool.done_tail = done;
+			done = NULL;
+		}
+		pthread_mutex_unlock(&g_pool.lock);
+
+		free(done);
+		free(job);
+	}
+	return NULL;
+}
+
+void tagreader_pool_init(void)
+{
+	if (g_pool.is_initialized) return;
+
+	pthread_mutex_init(&g_pool.lock, NULL);
+	pthread_cond_init(&g_pool.has_jobs, NULL);
+
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores < 1) cores = 1;
+
+	const size_t worker_count = MIN((size_t) cores, ARRAY_SIZE(g_pool.workers));
+
+	for (size_t i=0; i < worker_count; ++i) {
+		if (pthread_create(&g_pool.workers[i], NULL, tagreader_worker, NULL) != 0) {
+			log_error("failed to start tagreader worker %zu\n", i);
+			break;
+		}
+		pthread_detach(g_pool.workers[i]);
+		++g_pool.worker_count;
+	}
+
+	g_pool.is_initialized = true;
+	log_info("tagreader pool started with %zu workers\n", g_pool.worker_count);
+}
+
+void tagreader_pool_submit(const char *filepath, size_t id)
+{
+	PRECONDITION(g_pool.is_initialized);
+
+	const size_t path_len = strlen(filepath);
+	struct Tagreader_Job *job = malloc(sizeof(*job) + path_len + 1);
+	if (job == NULL) {
+		log_error("failed to allocate tagreader job for %s\n", filepath);
+		return;
+	}
+
+	job->next = NULL;
+	job->id   = id;
+	memcpy(job->filepath, filepath, path_len+1);
+
+	pthread_mutex_lock(&g_pool.lock);
+	job->generation = g_pool.generation;
+	if (g_pool.jobs_tail != NULL) g_pool.jobs_tail->next = job;
+	else                          g_pool.jobs_head       = job;
+	g_pool.jobs_tail = job;
+	pthread_cond_signal(&g_pool.has_jobs);
+	pthread_mutex_unlock(&g_pool.lock);
+}
+
+void tagreader_pool_cancel(void)
+{
+	if (!g_pool.is_initialized) return;
+
+	pthread_mutex_lock(&g_pool.lock);
+	struct Tagreader_Job  *job  = g_pool.jobs_head;
+	struct Tagreader_Done *done = g_pool.done_head;
+
+	g_pool.jobs_head = NULL;
+	g_pool.jobs_tail = NULL;
+	g_pool.done_head = NULL;
+	g_pool.done_tail = NULL;
+	++g_pool.generation;
+	pthread_mutex_unlock(&g_pool.lock);
+
+	while (job != NULL) {
+		struct Tagreader_Job *next = job->next;
+		free(job);
+		job = next;
+	}
+	while (done != NULL) {
+		struct Tagreader_Done *next = done->next;
+		free(done);
+		done = next;
+	}
+}
+
+bool tagreader_pool_poll(struct Tagreader_Result *result)
+{
+	if (!g_pool.is_initialized) return false;
+
+	pthread_mutex_lock(&g_pool.lock);
+	struct Tagreader_Done *done = g_pool.done_head;
+	if (done != NULL) {
+		g_pool.done_head = done->next;
+		if (g_pool.done_head == NULL) g_pool.done_tail = NULL;
+	}
+	pthread_mutex_unlock(&g_pool.lock);
+
+	if (done == NULL) return false;
+
+	memcpy(result, &done->result, sizeof(*result));
+	free(done);
+	return true;
+}
@@ -0,0 +1,40 @@
+#ifndef TAGREADER_H
+#define TAGREADER_H
+
+#include <stddef.h>
+
+#include "libcutils/result.h"
+#include "audio.h"
+
+/**
+ * Lightweight ID3 reader which only pread()s the ID3v2 header/frames and the
+ * ID3v1 trailer of a file. No decoder is involved, so it is cheap enough to
+ * run over whole directories.
+ */
+Result tagreader_read(const char *filepath, struct Audio_Metadata *metadata);
+
+/**
+ * Reads the embedded APIC/PIC picture of a file, preferring the front cover.
+ * On success, data holds the still encoded image and has to be freed by the
+ * caller.
+ */
+Result tagreader_read_picture(const char *filepath, void **data, size_t *size);
+
+struct Tagreader_Result {
+	size_t id;
+	struct Audio_Metadata metadata;
+};
+
+/**
+ * Worker pool running tagreader_read() in the background, one worker per
+ * core. Results are fetched from the render thread with
+ * tagreader_pool_poll(), the id passed on submit is handed back unchanged.
+ * tagreader_pool_cancel() drops all pending jobs and results that were
+ * submitted before.
+ */
+void tagreader_pool_init(void);
+void tagreader_pool_submit(const char *filepath, size_t id);
+void tagreader_pool_cancel(void);
+bool tagreader_pool_poll(struct Tagreader_Result *result);
+
+#endif // TAGREADER_H
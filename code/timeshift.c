@@ -0,0 +1,230 @@
+#include "timeshift.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mpegframe.h"
+#include "rtlog.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+// sized for the highest mp3 bitrate, lower ones fit more time into the ring
+// and the index covers that down to 80 kbit/s
+#define TIMESHIFT_MAX_BYTE_RATE  (320*1000/8)
+#define TIMESHIFT_INDEX_FACTOR   4
+#define TIMESHIFT_BLOCK_SIZE     (1024*1024)
+
+Result timeshift_init(struct Timeshift *ts, const char *path, int minutes)
+{
+	memset(ts, 0, sizeof(*ts));
+	ts->fd = -1;
+
+	const size_t seconds = (size_t) MAX(1, minutes) * 60;
+	const size_t blocks  = (seconds*TIMESHIFT_MAX_BYTE_RATE + TIMESHIFT_BLOCK_SIZE-1) / TIMESHIFT_BLOCK_SIZE;
+
+	// the ring starts the mapping and is a multiple of the block size, so
+	// every block is page aligned for madvise()
+	ts->capacity   = blocks * TIMESHIFT_BLOCK_SIZE;
+	ts->index_size = seconds * TIMESHIFT_INDEX_FACTOR;
+	ts->map_size   = ts->capacity + ts->index_size*sizeof(ts->index[0]);
+
+	ts->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (ts->fd < 0) {
+		return result_make(false, "unable to open %s: %s", path, strerror(errno));
+	}
+
+	if (ftruncate(ts->fd, (off_t) ts->map_size) != 0) {
+		Result r = result_make(false, "unable to resize %s: %s", path, strerror(errno));
+		timeshift_free(ts);
+		return r;
+	}
+
+	void *map = mmap(NULL, ts->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ts->fd, 0);
+	if (map == MAP_FAILED) {
+		Result r = result_make(false, "unable to map %s: %s", path, strerror(errno));
+		timeshift_free(ts);
+		return r;
+	}
+
+	ts->map   = map;
+	ts->data  = ts->map;
+	ts->index = (uint64_t*)(void*)(ts->map + ts->capacity);
+
+	log_info("timeshift: %d minutes in %zu MB at %s\n", minutes, ts->map_size/(1024*1024), path);
+	timeshift_reset(ts);
+	return result_make_success();
+}
+
+void timeshift_free(struct Timeshift *ts)
+{
+	if (ts->map != NULL) munmap(ts->map, ts->map_size);
+	if (ts->fd >= 0) close(ts->fd);
+
+	memset(ts, 0, sizeof(*ts));
+	ts->fd = -1;
+}
+
+void timeshift_reset(struct Timeshift *ts)
+{
+	ts->write_pos       = 0;
+	ts->feed_pos        = 0;
+	ts->indexed_seconds = 0;
+	ts->written_ms      = 0.0;
+}
+
+/**
+ * Drops the blocks completed between from and to from the mapping. The data
+ * stays in the file and the page cache, it is only faulted in again when
+ * the other side still needs it.
+ */
+static void timeshift_drop_blocks(struct Timeshift *ts, uint64_t from, uint64_t to)
+{
+	for (uint64_t block = from/TIMESHIFT_BLOCK_SIZE + 1; block <= to/TIMESHIFT_BLOCK_SIZE; ++block) {
+		const size_t offset = (size_t)((block-1)*TIMESHIFT_BLOCK_SIZE % ts->capacity);
+		madvise(ts->data+offset, TIMESHIFT_BLOCK_SIZE, MADV_DONTNEED);
+	}
+}
+
+static uint64_t timeshift_index_at(const struct Timeshift *ts, uint64_t second)
+{
+	return ts->index[second % ts->index_size];
+}
+
+static uint64_t timeshift_first_pos(const struct Timeshift *ts, uint64_t end)
+{
+	return (end > ts->capacity) ? end - ts->capacity : 0;
+}
+
+static uint64_t timeshift_oldest_second(const struct Timeshift *ts, uint64_t first_pos)
+{
+	uint64_t lo = (ts->indexed_seconds > ts->index_size) ? ts->indexed_seconds - ts->index_size : 0;
+	uint64_t hi = ts->indexed_seconds;
+
+	// first second whose data was not overwritten yet
+	while (lo < hi) {
+		const uint64_t mid = lo + (hi-lo)/2;
+		if (timeshift_index_at(ts, mid) < first_pos) lo = mid+1;
+		else                                         hi = mid;
+	}
+	return lo;
+}
+
+/** The last indexed second starting at or before pos. */
+static uint64_t timeshift_find_second(const struct Timeshift *ts, uint64_t pos)
+{
+	uint64_t lo = timeshift_oldest_second(ts, timeshift_first_pos(ts, ts->write_pos));
+	uint64_t hi = ts->indexed_seconds;
+
+	while (lo+1 < hi) {
+		const uint64_t mid = lo + (hi-lo)/2;
+		if (timeshift_index_at(ts, mid) <= pos) lo = mid;
+		else                                    hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * A paused feed position is pushed out of the range which is about to be
+ * overwritten or dropped from the index, to the start of the oldest second
+ * left, so it stays on a frame border.
+ */
+static void timeshift_keep_feed_in_window(struct Timeshift *ts, uint64_t end)
+{
+	const uint64_t first_pos = timeshift_first_pos(ts, end);
+	uint64_t oldest_pos = first_pos;
+
+	if (ts->indexed_seconds > 0) {
+		const uint64_t second = timeshift_oldest_second(ts, first_pos);
+		if (second < ts->indexed_seconds) oldest_pos = MAX(first_pos, timeshift_index_at(ts, second));
+	}
+
+	if (ts->feed_pos < oldest_pos) {
+		rtlog_debug("timeshift: window full, skipping %llu bytes\n", (unsigned long long)(oldest_pos - ts->feed_pos));
+		ts->feed_pos = oldest_pos;
+	}
+}
+
+static double frame_duration_ms(const struct Mpeg_Frame_Header *header)
+{
+	int samples = 1152;
+	if      (header->layer == 1)                        samples = 384;
+	else if (header->layer == 3 && header->version != 1) samples = 576;
+
+	return (double) samples * 1000.0 / (double) header->samplerate_hz;
+}
+
+void timeshift_write(struct Timeshift *ts, const uint8_t *frames, size_t size)
+{
+	if (size > ts->capacity) {
+		frames += size - ts->capacity;
+		size    = ts->capacity;
+	}
+
+	const uint64_t end = ts->write_pos + size;
+
+	// remember where every stream second starts
+	for (size_t offset = 0; offset+MPEG_FRAME_HEADER_SIZE <= size; ) {
+		struct Mpeg_Frame_Header header;
+		if (!mpegframe_parse_header(frames+offset, &header)) break;
+
+		if (ts->written_ms >= (double) ts->indexed_seconds * 1000.0) {
+			ts->index[ts->indexed_seconds % ts->index_size] = ts->write_pos + offset;
+			ts->indexed_seconds++;
+		}
+		ts->written_ms += frame_duration_ms(&header);
+		offset         += header.frame_size;
+	}
+
+	timeshift_keep_feed_in_window(ts, end);
+
+	const size_t offset     = (size_t)(ts->write_pos % ts->capacity);
+	const size_t first_part = MIN(size, ts->capacity - offset);
+
+	memcpy(ts->data+offset, frames, first_part);
+	memcpy(ts->data, frames+first_part, size-first_part);
+
+	timeshift_drop_blocks(ts, ts->write_pos, end);
+	ts->write_pos = end;
+}
+
+const uint8_t *timeshift_peek(const struct Timeshift *ts, size_t *size)
+{
+	const size_t offset = (size_t)(ts->feed_pos % ts->capacity);
+
+	*size = (size_t) MIN(ts->write_pos - ts->feed_pos, (uint64_t)(ts->capacity - offset));
+	return ts->data + offset;
+}
+
+void timeshift_consume(struct Timeshift *ts, size_t size)
+{
+	timeshift_drop_blocks(ts, ts->feed_pos, ts->feed_pos + size);
+	ts->feed_pos += size;
+}
+
+bool timeshift_seek(struct Timeshift *ts, int delta_secs, uint64_t play_pos)
+{
+	if (ts->indexed_seconds == 0) return false;
+
+	const int64_t oldest = (int64_t) timeshift_oldest_second(ts, timeshift_first_pos(ts, ts->write_pos));
+	const int64_t newest = (int64_t) ts->indexed_seconds - 1;
+	if (oldest > newest) return false;
+
+	const int64_t current = (int64_t) timeshift_find_second(ts, play_pos);
+	const int64_t target  = MAX(oldest, MIN(newest, current + delta_secs));
+
+	ts->feed_pos = timeshift_index_at(ts, (uint64_t) target);
+	log_debug("timeshift: seek from second %lld to %lld\n", (long long) current, (long long) target);
+	return true;
+}
+
+int timeshift_get_delay_ms(const struct Timeshift *ts, uint64_t play_pos)
+{
+	if (ts->indexed_seconds == 0) return 0;
+
+	const uint64_t second = timeshift_find_second(ts, play_pos);
+	return (int)(ts->written_ms - (double) second * 1000.0);
+}
@@ -0,0 +1,64 @@
+#ifndef TIMESHIFT_H
+#define TIMESHIFT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Time-shift window of a live stream, kept in a memory mapped ring file.
+ *
+ * The download writes whole frames at the write position, playback is fed
+ * from the feed position, so pausing only lets the two drift apart instead
+ * of blocking the download. Once the window is full, the oldest audio is
+ * overwritten and a paused feed position is moved along.
+ *
+ * For seeking, the position of the first frame of every stream second is
+ * kept in an index, which is part of the file as well. Pages are dropped
+ * from the mapping once written or fed, so the memory footprint does not
+ * depend on the window length.
+ *
+ * Positions are byte counts since timeshift_reset().
+ */
+struct Timeshift {
+	int fd;
+	uint8_t *map;
+	size_t map_size;
+
+	uint8_t *data;          // ring at the start of the file
+	size_t capacity;
+	uint64_t *index;        // index[second % index_size], after the ring
+	size_t index_size;
+
+	uint64_t write_pos;
+	uint64_t feed_pos;
+	uint64_t indexed_seconds;
+	double written_ms;
+};
+
+Result timeshift_init(struct Timeshift *ts, const char *path, int minutes);
+void   timeshift_free(struct Timeshift *ts);
+void   timeshift_reset(struct Timeshift *ts);
+
+void   timeshift_write(struct Timeshift *ts, const uint8_t *frames, size_t size);
+
+/**
+ * Returns the oldest data not fed yet, size is limited to the end of the
+ * ring. Advance with timeshift_consume().
+ */
+const uint8_t *timeshift_peek(const struct Timeshift *ts, size_t *size);
+void   timeshift_consume(struct Timeshift *ts, size_t size);
+
+/**
+ * Moves the feed position by delta_secs relative to play_pos, the position
+ * currently heard. Stays inside the window, returns false if there is
+ * nothing to seek in yet.
+ */
+bool   timeshift_seek(struct Timeshift *ts, int delta_secs, uint64_t play_pos);
+
+/** How far play_pos is behind the live end of the stream. */
+int    timeshift_get_delay_ms(const struct Timeshift *ts, uint64_t play_pos);
+
+#endif // TIMESHIFT_H
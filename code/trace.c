@@ -0,0 +1,234 @@
+#include "trace.h"
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define TRACE_MAX_THREADS  16
+#define TRACE_MAX_EVENTS   16384   // per thread, a power of two
+
+struct Trace_Event {
+	uint64_t ts_ns;
+	const char *name;
+	int32_t value;
+	char phase;
+};
+
+struct Trace_Buffer {
+	struct Trace_Event events[TRACE_MAX_EVENTS];
+	_Atomic uint64_t count;           // free running, written by the owner only
+	_Atomic uint32_t generation;      // tracing session the events belong to
+	const char *thread_name;
+
+	_Atomic bool is_owned;            // claimed with a CAS, the audio thread never locks
+};
+
+_Atomic bool g_trace_is_enabled = false;
+
+static struct {
+	struct Trace_Buffer *buffers[TRACE_MAX_THREADS];
+	_Atomic uint32_t generation;
+	uint64_t start_ns;
+
+	pthread_mutex_t lock;
+	pthread_key_t owner_key;
+	bool is_key_created;
+} g_trace = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static _Thread_local struct Trace_Buffer *t_buffer = NULL;
+static _Thread_local const char *t_thread_name    = NULL;
+_Thread_local const char *t_trace_spans[TRACE_MAX_SPAN_DEPTH];
+_Thread_local size_t t_trace_span_depth = 0;
+
+static uint64_t trace_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+/** Called on thread exit, the events stay until the next session. */
+static void trace_release_buffer(void *arg)
+{
+	struct Trace_Buffer *buffer = arg;
+	atomic_store(&buffer->is_owned, false);
+}
+
+/**
+ * The first event of a thread claims a buffer without a lock, like the
+ * rings of rtlog. Buffers of finished threads are reused once their
+ * session is over.
+ */
+static struct Trace_Buffer *trace_claim_buffer(void)
+{
+	// pairs with trace_start(), the buffers are allocated before the session
+	const uint32_t generation = atomic_load_explicit(&g_trace.generation, memory_order_acquire);
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_trace.buffers); ++i) {
+		struct Trace_Buffer *buffer = g_trace.buffers[i];
+		if (buffer == NULL || atomic_load(&buffer->generation) == generation) continue;
+
+		bool is_owned = false;
+		if (atomic_compare_exchange_strong(&buffer->is_owned, &is_owned, true)) {
+			buffer->thread_name = t_thread_name;
+			atomic_store(&buffer->count, 0);
+			atomic_store(&buffer->generation, generation);
+			pthread_setspecific(g_trace.owner_key, buffer);
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+void trace_record(char phase, const char *name, int64_t value)
+{
+	const uint32_t generation = atomic_load_explicit(&g_trace.generation, memory_order_relaxed);
+
+	if (t_buffer == NULL) {
+		t_buffer = trace_claim_buffer();
+		if (t_buffer == NULL) return;
+	}
+	else if (atomic_load_explicit(&t_buffer->generation, memory_order_relaxed) != generation) {
+		// a new session, the buffer stays with its thread
+		t_buffer->thread_name = t_thread_name;
+		atomic_store_explicit(&t_buffer->count, 0, memory_order_relaxed);
+		atomic_store_explicit(&t_buffer->generation, generation, memory_order_release);
+	}
+
+	const uint64_t count = atomic_load_explicit(&t_buffer->count, memory_order_relaxed);
+	struct Trace_Event *event = &t_buffer->events[count & (TRACE_MAX_EVENTS-1)];
+
+	event->ts_ns = trace_now_ns();
+	event->name  = name;
+	event->value = (int32_t) value;
+	event->phase = phase;
+
+	atomic_store_explicit(&t_buffer->count, count+1, memory_order_release);
+}
+
+size_t trace_get_span_stack(const char **names, size_t max_names)
+{
+	const size_t count = MIN(MIN(t_trace_span_depth, (size_t)TRACE_MAX_SPAN_DEPTH), max_names);
+	atomic_signal_fence(memory_order_acquire);
+
+	for (size_t i = 0; i < count; ++i) names[i] = t_trace_spans[i];
+	return count;
+}
+
+void trace_set_thread_name(const char *name)
+{
+	t_thread_name = name;
+	if (t_buffer != NULL) t_buffer->thread_name = name;
+}
+
+Result trace_start(void)
+{
+	if (atomic_load(&g_trace_is_enabled)) return result_make_success();
+
+	pthread_mutex_lock(&g_trace.lock);
+	if (!g_trace.is_key_created) {
+		pthread_key_create(&g_trace.owner_key, trace_release_buffer);
+		g_trace.is_key_created = true;
+	}
+
+	// allocated once and kept, so no thread ever allocates while recording
+	for (size_t i = 0; i < ARRAY_SIZE(g_trace.buffers); ++i) {
+		if (g_trace.buffers[i] != NULL) continue;
+
+		g_trace.buffers[i] = calloc(1, sizeof(*g_trace.buffers[i]));
+		if (g_trace.buffers[i] == NULL) {
+			pthread_mutex_unlock(&g_trace.lock);
+			return result_make(false, "unable to allocate %zu bytes of trace buffers", sizeof(struct Trace_Buffer));
+		}
+	}
+	pthread_mutex_unlock(&g_trace.lock);
+
+	g_trace.start_ns = trace_now_ns();
+	atomic_fetch_add(&g_trace.generation, 1);
+	atomic_store(&g_trace_is_enabled, true);
+
+	log_info("trace: started\n");
+	return result_make_success();
+}
+
+static void trace_write_buffer(FILE *file, const struct Trace_Buffer *buffer, int tid, bool *is_first)
+{
+	const uint64_t count = atomic_load_explicit(&buffer->count, memory_order_acquire);
+	const uint64_t first = (count > TRACE_MAX_EVENTS) ? count - TRACE_MAX_EVENTS : 0;
+
+	if (buffer->thread_name != NULL) {
+		fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			*is_first ? "" : ",", tid, buffer->thread_name);
+		*is_first = false;
+	}
+
+	for (uint64_t i = first; i < count; ++i) {
+		const struct Trace_Event *event = &buffer->events[i & (TRACE_MAX_EVENTS-1)];
+		const double ts_us = (double)(event->ts_ns - g_trace.start_ns) / 1000.0;
+
+		fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+			*is_first ? "" : ",", event->name, event->phase, ts_us, tid);
+
+		if (event->phase == 'C') {
+			fprintf(file, ",\"args\":{\"value\":%d}", (int) event->value);
+		}
+		fputc('}', file);
+		*is_first = false;
+	}
+}
+
+Result trace_stop(char *path, size_t path_size)
+{
+	if (!atomic_load(&g_trace_is_enabled)) {
+		return result_make(false, "tracing is not running");
+	}
+	atomic_store(&g_trace_is_enabled, false);
+
+	char dir[PATH_MAX];
+	Result r = config_get_cache_path("trace", dir, sizeof(dir));
+	if (!r.success) return r;
+
+	char stamp[32];
+	const time_t now = time(NULL);
+	struct tm local;
+	localtime_r(&now, &local);
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+	snprintf(path, path_size, "%s/trace-%s.json", dir, stamp);
+
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return result_make(false, "unable to create %s", path);
+	}
+
+	// a trace point racing with the stop may still finish its event, the
+	// few events it could tear are not worth a lock on every one of them
+	const uint32_t generation = atomic_load(&g_trace.generation);
+	bool is_first = true;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+	for (size_t i = 0; i < ARRAY_SIZE(g_trace.buffers); ++i) {
+		const struct Trace_Buffer *buffer = g_trace.buffers[i];
+
+		if (buffer != NULL && atomic_load(&buffer->generation) == generation) {
+			trace_write_buffer(file, buffer, (int) i+1, &is_first);
+		}
+	}
+	fputs("\n]}\n", file);
+
+	if (fclose(file) != 0) {
+		return result_make(false, "unable to write %s", path);
+	}
+
+	log_info("trace: written to %s\n", path);
+	return result_make_success();
+}
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libcutils/result.h"
+
+/**
+ * Spans and counters of the render loop, the audio callback and the
+ * downloads, exported as Chrome trace event JSON for chrome://tracing or
+ * ui.perfetto.dev.
+ *
+ * Every thread records into its own preallocated ring without locks, the
+ * newest events survive. While tracing is off, a trace point costs one load
+ * and a predictable branch, spans add two inlined thread-local stores.
+ * Names have to be string literals, only the pointer is kept.
+ *
+ * Toggled with the T key or started right away by setting SHARDOS_TRACE.
+ */
+extern _Atomic bool g_trace_is_enabled;
+
+#define TRACE_IS_ENABLED() \
+	__builtin_expect(atomic_load_explicit(&g_trace_is_enabled, memory_order_relaxed), 0)
+
+#define TRACE_MAX_SPAN_DEPTH  16
+
+#define TRACE_BEGIN(name)          do { trace_push_span(name); if (TRACE_IS_ENABLED()) trace_record('B', name, 0); } while (0)
+#define TRACE_END(name)            do { trace_pop_span(); if (TRACE_IS_ENABLED()) trace_record('E', name, 0); } while (0)
+#define TRACE_COUNTER(name, value) do { if (TRACE_IS_ENABLED()) trace_record('C', name, (int64_t)(value)); } while (0)
+
+void   trace_record(char phase, const char *name, int64_t value);
+
+/**
+ * Open spans of the calling thread, kept even while tracing is off so the
+ * watchdog can tell where a stalled thread is. Reading is async-signal-safe.
+ * Inline, the audio callback passes several spans per call.
+ */
+extern _Thread_local const char *t_trace_spans[TRACE_MAX_SPAN_DEPTH];
+extern _Thread_local size_t t_trace_span_depth;
+
+static inline void trace_push_span(const char *name)
+{
+	if (t_trace_span_depth < TRACE_MAX_SPAN_DEPTH) t_trace_spans[t_trace_span_depth] = name;
+
+	// a signal handler on this thread must not see the depth before the name
+	atomic_signal_fence(memory_order_release);
+	t_trace_span_depth++;
+}
+
+static inline void trace_pop_span(void)
+{
+	if (t_trace_span_depth > 0) t_trace_span_depth--;
+}
+
+size_t trace_get_span_stack(const char **names, size_t max_names);
+
+/** Names the calling thread in the trace, cheap enough to call every time. */
+void   trace_set_thread_name(const char *name);
+
+Result trace_start(void);
+
+/** Stops tracing and writes the events to a new file in the cache dir. */
+Result trace_stop(char *path, size_t path_size);
+
+#endif // TRACE_H
@@ -1,6 +1,7 @@
 #include "ui_elements.h"
 
 #include "config.h"
+#include "replay.h"
 #include <SDL3/SDL_render.h>
 
 #include <assert.h>
@@ -17,6 +18,11 @@
 #define UI_CLICKABLE_LIST_ENTRY_FACTOR (UI_BUTTON_FONT_SIZE+2*UI_BUTTON_BORDER_WIDTH+10)
 #define UI_MEDIA_PLAYER_CLEARANCE 10
 #define UI_CLICKABLE_LIST_PAGINATION_CLEARANCE 10
+#define UI_CLICKABLE_LIST_TAP_SLOP      10.0f  // px a tap may move before it becomes a drag
+#define UI_CLICKABLE_LIST_FLING_TAU     0.35f  // s until the fling velocity dropped to 1/e
+#define UI_CLICKABLE_LIST_MIN_VELOCITY  20.0f  // px/s below which a fling stops
+#define UI_CLICKABLE_LIST_MAX_VELOCITY  6000.0f
+#define UI_CLICKABLE_LIST_FLING_TIMEOUT_NS (100ull*1000*1000) // finger rested before release, no fling
 
 struct Audio_Len {
 	int h;
@@ -154,6 +160,11 @@ void ui_clickable_list_init(struct Screen *screen,
 	list->attr.border = UI_BORDER_NONE;
 	list->internal.count = 0;
 	list->internal.index_selected_item = -1;
+	list->internal.get_row  = NULL;
+	list->internal.userdata = NULL;
+
+	const struct Screen_Dimension row_text = screen_get_text_dimension(screen, UI_BUTTON_FONT_SIZE, "Ag");
+	list->internal.row_height = row_text.h+2*UI_BUTTON_BORDER_WIDTH;
 
 	const int x_center     = list->attr.x + (list->attr.w/2);
 	const int y_pagination = (list->attr.y+list->attr.h)-(UI_BUTTON_HEIGHT+UI_CLICKABLE_LIST_PAGINATION_CLEARANCE);
@@ -185,9 +196,28 @@ void ui_clickable_list_init(struct Screen *screen,
 	log_info("clickable list created, items_per_page: %zu\n", list->internal.items_per_page);
 }
 
+void ui_clickable_list_set_source(
+	struct Ui_Clickable_List *list,
+	size_t count,
+	Ui_List_Get_Row get_row,
+	void *userdata)
+{
+	list->internal.get_row  = get_row;
+	list->internal.userdata = userdata;
+	ui_clickable_list_set_count(list, count);
+}
+
+void ui_clickable_list_set_count(struct Ui_Clickable_List *list, size_t count)
+{
+	list->internal.count = count;
+	list->internal.scroll.offset   = 0.0f;
+	list->internal.scroll.velocity = 0.0f;
+}
+
 void ui_clickable_list_clear(struct Ui_Clickable_List *list)
 {
 	list->internal.count=0;
+	++list->internal.generation;
 }
 
 void ui_clickable_list_append(struct Ui_Clickable_List *list, const char *text)
@@ -211,61 +241,366 @@ bool ui_clickable_list_select(struct Ui_Clickable_List *list, int index)
 		return false;
 	}
 
+	const size_t page_index = (size_t)index / list->internal.items_per_page;
+
 	list->internal.index_selected_item = index;
-	list->internal.page_index = (size_t)index / list->internal.items_per_page;
+	list->internal.scroll.offset   = (float)(page_index*list->internal.items_per_page) * (float)UI_CLICKABLE_LIST_ENTRY_FACTOR;
+	list->internal.scroll.velocity = 0.0f;
+	return true;
+}
+
+static bool ui_clickable_list_get_static_row(size_t index, struct Ui_List_Row *row, void *userdata)
+{
+	const struct Ui_Clickable_List *list = userdata;
+
+	if (index >= list->internal.count) return false;
+
+	// a new generation starts with every clear, so ids of reused indexes differ
+	row->id = (list->internal.generation << 32) | index;
+	snprintf(row->text, sizeof(row->text), "%.*s", UI_LIST_MAX_ITEM_LEN, list->internal.items[index]);
 	return true;
 }
 
+static SDL_Texture *ui_clickable_list_get_row_texture(
+	struct Screen *screen,
+	struct Ui_Clickable_List *list,
+	const struct Ui_List_Row *row)
+{
+	struct Ui_List_Row_Cache *victim = NULL;
+
+	for (size_t i=0; i < ARRAY_SIZE(list->internal.row_cache); ++i) {
+		struct Ui_List_Row_Cache *entry = &list->internal.row_cache[i];
+
+		if (entry->texture != NULL && entry->id == row->id) {
+			entry->last_used = list->internal.frame;
+			return entry->texture;
+		}
+
+		// prefer empty slots, otherwise evict the least recently used row
+		if (victim == NULL) {
+			victim = entry;
+		}
+		else if (victim->texture != NULL &&
+		         (entry->texture == NULL || entry->last_used < victim->last_used)) {
+			victim = entry;
+		}
+	}
+
+	if (victim->texture != NULL) {
+		SDL_DestroyTexture(victim->texture);
+	}
+
+	victim->id        = row->id;
+	victim->last_used = list->internal.frame;
+	victim->texture   = screen_create_text_texture(screen, UI_BUTTON_FONT_SIZE, row->text);
+
+	return victim->texture;
+}
+
+static float ui_clickable_list_view_height(const struct Ui_Clickable_List *list)
+{
+	return (float)list->internal.items_per_page * (float)UI_CLICKABLE_LIST_ENTRY_FACTOR;
+}
+
+static float ui_clickable_list_max_offset(const struct Ui_Clickable_List *list)
+{
+	const float content_height = (float)list->internal.count * (float)UI_CLICKABLE_LIST_ENTRY_FACTOR;
+	return MAX(0.0f, content_height-ui_clickable_list_view_height(list));
+}
+
+/**
+ * Drag and fling handling. All motion is based on the event and frame
+ * timestamps, so the list scrolls at the same speed regardless of the frame
+ * rate.
+ */
+static void ui_clickable_list_update_scroll(struct Screen *screen, struct Ui_Clickable_List *list)
+{
+	const struct Screen_Pointer *pointer = &screen->pointer;
+	struct Ui_List_Scroll *scroll = &list->internal.scroll;
+
+	const struct Ui_Outline view = {
+		.x = list->attr.x,
+		.y = list->attr.y,
+		.w = list->attr.w,
+		.h = (int)ui_clickable_list_view_height(list)
+	};
+
+	const uint64_t now_ns = replay_ticks_ns();
+	float dt = (scroll->last_update_ns == 0) ? 0.0f : (float)(now_ns-scroll->last_update_ns)/1e9f;
+	scroll->last_update_ns = now_ns;
+	dt = MIN(dt, 0.1f); // e.g. after the app was not rendered for a while
+
+	scroll->is_tap = false;
+
+	// a press and its release may arrive in the same frame, e.g. a quick tap
+	// or after a stall, so the press is taken from the pointer, not is_down
+	const bool is_pressed_inside = pointer->pressed &&
+		IN_RANGE((int)pointer->start_x, view.x, view.x+view.w) &&
+		IN_RANGE((int)pointer->start_y, view.y, view.y+view.h);
+
+	if (is_pressed_inside) {
+		scroll->is_tracking   = true;
+		scroll->is_dragging   = false;
+		scroll->stopped_fling = (SDL_fabsf(scroll->velocity) > UI_CLICKABLE_LIST_MIN_VELOCITY);
+		scroll->velocity      = 0.0f;
+		scroll->last_event_ns = pointer->timestamp_ns;
+	}
+
+	if (scroll->is_tracking) {
+		if (pointer->travel > UI_CLICKABLE_LIST_TAP_SLOP) {
+			scroll->is_dragging = true;
+		}
+
+		if (pointer->delta_y != 0.0f) {
+			scroll->offset -= pointer->delta_y;
+
+			const uint64_t event_dt_ns = pointer->timestamp_ns-scroll->last_event_ns;
+			if (event_dt_ns > 0) {
+				const float instant_velocity = -pointer->delta_y/((float)event_dt_ns/1e9f);
+				// smooth out jittery touch samples
+				scroll->velocity = 0.7f*instant_velocity + 0.3f*scroll->velocity;
+			}
+			scroll->last_event_ns = pointer->timestamp_ns;
+		}
+
+		if (!pointer->is_down) {
+			scroll->is_tracking = false;
+			scroll->is_tap      = !scroll->is_dragging && !scroll->stopped_fling;
+
+			if (!scroll->is_dragging ||
+			    pointer->timestamp_ns-scroll->last_event_ns > UI_CLICKABLE_LIST_FLING_TIMEOUT_NS) {
+				scroll->velocity = 0.0f;
+			}
+			scroll->velocity = SDL_clamp(scroll->velocity,
+				-UI_CLICKABLE_LIST_MAX_VELOCITY, UI_CLICKABLE_LIST_MAX_VELOCITY);
+		}
+	}
+	else if (scroll->velocity != 0.0f) {
+		scroll->offset   += scroll->velocity*dt;
+		scroll->velocity *= SDL_expf(-dt/UI_CLICKABLE_LIST_FLING_TAU);
+
+		if (SDL_fabsf(scroll->velocity) < UI_CLICKABLE_LIST_MIN_VELOCITY) {
+			scroll->velocity = 0.0f;
+		}
+	}
+
+	const float max_offset = ui_clickable_list_max_offset(list);
+	if (scroll->offset < 0.0f || scroll->offset > max_offset) {
+		scroll->offset   = SDL_clamp(scroll->offset, 0.0f, max_offset);
+		scroll->velocity = 0.0f;
+	}
+}
+
+static void ui_clickable_list_scroll_pages(struct Ui_Clickable_List *list, int pages)
+{
+	const float page_height = ui_clickable_list_view_height(list);
+	const float page        = SDL_floorf(list->internal.scroll.offset/page_height + 0.5f) + (float)pages;
+
+	list->internal.scroll.offset   = SDL_clamp(page*page_height, 0.0f, ui_clickable_list_max_offset(list));
+	list->internal.scroll.velocity = 0.0f;
+}
+
 void ui_clickable_list_render(struct Screen *screen, struct Ui_Clickable_List *list)
 {
 	if (list->attr.border == UI_BORDER_NORMAL) {
 		screen_draw_box(screen, list->attr.x, list->attr.y, list->attr.w, list->attr.h, false);
 	}
 
-	size_t start = list->internal.page_index * list->internal.items_per_page;
-	size_t end   = MIN(start+list->internal.items_per_page, list->internal.count);
+	Ui_List_Get_Row get_row  = list->internal.get_row;
+	void           *userdata = list->internal.userdata;
+
+	if (get_row == NULL) {
+		get_row  = ui_clickable_list_get_static_row;
+		userdata = list;
+	}
+
+	++list->internal.frame;
+	ui_clickable_list_update_scroll(screen, list);
+
+	const int   view_height = (int)ui_clickable_list_view_height(list);
+	const int   scroll_px   = (int)list->internal.scroll.offset;
+	const size_t start      = (size_t)(scroll_px / UI_CLICKABLE_LIST_ENTRY_FACTOR);
+	const size_t end        = MIN(start+list->internal.items_per_page+1, list->internal.count);
 
-	if (start >= end) start=0;
+	// a row is clicked by tapping it, dragging the list or a press which
+	// started outside of it never selects a row
+	const bool is_tap = list->internal.scroll.is_tap;
 
-	// TODO: render relative positions depending on page_index instead of
-	// static ones assigned during ui_clickable_list_append
-	struct Ui_Button btn;
+	int index_clicked = -1;
+
+	const SDL_Rect clip = {
+		.x = list->attr.x,
+		.y = list->attr.y,
+		.w = list->attr.w+1,
+		.h = view_height
+	};
+	SDL_SetRenderClipRect(screen->renderer, &clip);
 
 	for (size_t i=start; i < end; ++i) {
-		ui_button_init(screen, &btn, list->internal.items[i],
-			list->attr.x,
-			list->attr.y + (int)(i-start) * UI_CLICKABLE_LIST_ENTRY_FACTOR);
+		struct Ui_List_Row row;
+		if (!get_row(i, &row, userdata)) continue;
+
+		struct Ui_Outline outline = {
+			.x = list->attr.x,
+			.y = list->attr.y + (int)i*UI_CLICKABLE_LIST_ENTRY_FACTOR - scroll_px,
+			.w = list->attr.w,
+			.h = list->internal.row_height,
+			.border = UI_BORDER_NORMAL
+		};
+
+		const bool is_visible  = IN_RANGE((int)screen->mouse_y, list->attr.y, list->attr.y+view_height);
+		const bool is_selected = is_visible && ui_outline_selected(screen, &outline) &&
+			!list->internal.scroll.is_dragging;
 
 		if ((int)i == list->internal.index_selected_item) {
-			screen_draw_box_filled(screen, btn.outline.x, btn.outline.y, list->attr.w, btn.outline.h, SCREEN_COLOR_HIGHLIGHT, SCREEN_COLOR_HIGHLIGHT);
+			screen_draw_box_filled(screen, outline.x, outline.y, outline.w, outline.h, SCREEN_COLOR_HIGHLIGHT, SCREEN_COLOR_HIGHLIGHT);
 		}
-		btn.outline.w = list->attr.w;
-		if (ui_button_render(screen, &btn) == UI_EVENT_CLICKED) {
-			list->on_click((int)i);
+		screen_draw_box(screen, outline.x, outline.y, outline.w, outline.h, is_selected);
+		screen_draw_texture(screen,
+			ui_clickable_list_get_row_texture(screen, list, &row),
+			outline.x+UI_BUTTON_BORDER_WIDTH,
+			outline.y+UI_BUTTON_BORDER_WIDTH);
+
+		if (is_selected && is_tap) {
+			index_clicked = (int)i;
 		}
 	}
 
+	SDL_SetRenderClipRect(screen->renderer, NULL);
+
+	if (screen->pointer.released) {
+		list->internal.scroll.is_dragging   = false;
+		list->internal.scroll.stopped_fling = false;
+	}
+
 	struct Ui_Button *btn_prev  = &list->internal.button_prev_page;
 	struct Ui_Button *btn_index = &list->internal.button_page_index;
 	struct Ui_Button *btn_next  = &list->internal.button_next_page;
 
-	snprintf(btn_index->text, sizeof(btn_index->text), "%zu", list->internal.page_index+1);
+	const size_t page_index = (size_t)((list->internal.scroll.offset + (float)view_height/2) / (float)view_height);
+	snprintf(btn_index->text, sizeof(btn_index->text), "%zu", page_index+1);
 
 	if (ui_button_render(screen, btn_prev) == UI_EVENT_CLICKED) {
-		log_debug("prev page: currently %zu\n", list->internal.page_index);
-		if (list->internal.page_index > 0) {
-			--list->internal.page_index;
-		}
-
+		log_debug("prev page: currently %zu\n", page_index);
+		ui_clickable_list_scroll_pages(list, -1);
 	}
 	if (ui_button_render(screen, btn_next) == UI_EVENT_CLICKED) {
-		size_t max_page_index = (list->internal.count-1)/list->internal.items_per_page;
-		log_debug("next page: currently %zu of %zu\n", list->internal.page_index, max_page_index);
-		if (list->internal.page_index < max_page_index) {
-			++list->internal.page_index;
-		}
+		log_debug("next page: currently %zu\n", page_index);
+		ui_clickable_list_scroll_pages(list, 1);
 	}
 	ui_button_render(screen, btn_index);
+
+	// the click handler might change the underlying data, so call it after
+	// all rows of this frame are rendered
+	if (index_clicked != -1 && list->on_click != NULL) {
+		list->on_click(index_clicked);
+	}
+}
+
+#define UI_KEYBOARD_KEY_CLEARANCE 6
+static void ui_keyboard_add_key(
+	struct Screen *screen,
+	struct Ui_Keyboard *keyboard,
+	const char *label,
+	char value,
+	int x, int y, int w)
+{
+	if (keyboard->key_count >= ARRAY_SIZE(keyboard->keys)) return;
+
+	struct Ui_Keyboard_Key *key = &keyboard->keys[keyboard->key_count++];
+	key->outline.x      = x;
+	key->outline.y      = y;
+	key->outline.w      = w;
+	key->outline.h      = UI_BUTTON_HEIGHT;
+	key->outline.border = UI_BORDER_NORMAL;
+	key->value          = value;
+	key->texture        = screen_create_text_texture(screen, UI_BUTTON_FONT_SIZE, label);
+}
+
+void ui_keyboard_init(struct Screen *screen, struct Ui_Keyboard *keyboard, int x, int y, int w)
+{
+	static const char *rows[] = {
+		"1234567890",
+		"qwertyuiop",
+		"asdfghjkl",
+		"zxcvbnm",
+	};
+
+	for (size_t i=0; i < keyboard->key_count; ++i) {
+		SDL_DestroyTexture(keyboard->keys[i].texture);
+	}
+	keyboard->key_count = 0;
+
+	const int key_w    = (w - 9*UI_KEYBOARD_KEY_CLEARANCE) / 10;
+	const int row_step = UI_BUTTON_HEIGHT + UI_KEYBOARD_KEY_CLEARANCE;
+	const int col_step = key_w + UI_KEYBOARD_KEY_CLEARANCE;
+
+	int y_row = y;
+	for (size_t r=0; r < ARRAY_SIZE(rows); ++r) {
+		const int len = (int)strlen(rows[r]);
+		// shorter rows are centered like on a real keyboard
+		const int x_row = x + (10-len)*col_step/2;
+
+		for (int c=0; c < len; ++c) {
+			const char label[2] = {rows[r][c], '\0'};
+			ui_keyboard_add_key(screen, keyboard, label, rows[r][c], x_row+c*col_step, y_row, key_w);
+		}
+		y_row += row_step;
+	}
+
+	ui_keyboard_add_key(screen, keyboard, "clear", UI_KEYBOARD_KEY_CLEAR    , x                , y_row, 2*key_w+UI_KEYBOARD_KEY_CLEARANCE);
+	ui_keyboard_add_key(screen, keyboard, "space", ' '                      , x+2*col_step     , y_row, 6*key_w+5*UI_KEYBOARD_KEY_CLEARANCE);
+	ui_keyboard_add_key(screen, keyboard, "<-"   , UI_KEYBOARD_KEY_BACKSPACE, x+8*col_step     , y_row, 2*key_w+UI_KEYBOARD_KEY_CLEARANCE);
+
+	keyboard->attr.x = x;
+	keyboard->attr.y = y;
+	keyboard->attr.w = w;
+	keyboard->attr.h = y_row + UI_BUTTON_HEIGHT - y;
+}
+
+enum Ui_Event ui_keyboard_render(struct Screen *screen, struct Ui_Keyboard *keyboard, char *text, size_t text_size)
+{
+	PRECONDITION(text_size > 0);
+
+	const struct Ui_Keyboard_Key *pressed = NULL;
+
+	for (size_t i=0; i < keyboard->key_count; ++i) {
+		const struct Ui_Keyboard_Key *key = &keyboard->keys[i];
+		const bool is_selected = ui_outline_selected(screen, &key->outline);
+
+		screen_draw_box(screen, key->outline.x, key->outline.y, key->outline.w, key->outline.h, is_selected);
+		screen_draw_texture(screen, key->texture,
+			key->outline.x+UI_BUTTON_BORDER_WIDTH,
+			key->outline.y+UI_BUTTON_BORDER_WIDTH);
+
+		if (is_selected && screen->mouse_clicked) {
+			pressed = key;
+		}
+	}
+
+	if (pressed == NULL) return UI_EVENT_NONE;
+
+	size_t len = strlen(text);
+
+	switch (pressed->value) {
+		case UI_KEYBOARD_KEY_BACKSPACE:
+			if (len == 0) return UI_EVENT_NONE;
+			text[len-1] = '\0';
+			break;
+
+		case UI_KEYBOARD_KEY_CLEAR:
+			if (len == 0) return UI_EVENT_NONE;
+			text[0] = '\0';
+			break;
+
+		default:
+			if (len+1 >= text_size) return UI_EVENT_NONE;
+			text[len++] = pressed->value;
+			text[len]   = '\0';
+			break;
+	}
+
+	return UI_EVENT_MODIFIED;
 }
 
 void ui_media_player_init(
@@ -327,14 +662,21 @@ void ui_media_player_render(struct Screen *screen, struct Ui_Media_Player *playe
 	const int font_size_second_line = g_config.screen_font_size_s;
 	const int font_size_last_line   = g_config.screen_font_size_xs;
 
+	int x_text = player->x + 40;
+
+	if (player->art_texture != NULL) {
+		screen_draw_texture_region(screen, player->art_texture, &player->art_rect, x_text, player->y + 30);
+		x_text += (int)player->art_rect.w + 20;
+	}
+
 	screen_draw_text(screen,
-			player->x + 40,
+			x_text,
 			player->y + 30,
 			font_size_first_line,
 			player->first_line);
 
 	screen_draw_text(screen,
-			player->x + 40,
+			x_text,
 			player->y + 30 + font_size_first_line + 10,
 			font_size_second_line,
 			player->second_line);
@@ -148,8 +148,21 @@ Result ui_chooser_str_append(struct Ui_Chooser *chooser, const char *s);
 void   ui_chooser_str_clear(struct Ui_Chooser *chooser);
 
 ////////////////////////////////////////////////////////////////////////////////
-#define UI_LIST_MAX_ITEMS    40
-#define UI_LIST_MAX_ITEM_LEN 40
+#define UI_LIST_MAX_ITEMS       40
+#define UI_LIST_MAX_ITEM_LEN    40
+#define UI_LIST_MAX_ROW_LEN     128
+#define UI_LIST_MAX_CACHED_ROWS 32
+
+struct Ui_List_Row {
+	uint64_t id; // must stay the same as long as the text does not change
+	char text[UI_LIST_MAX_ROW_LEN];
+};
+
+/**
+ * Returns false if there is no row for the given index (anymore).
+ */
+typedef bool (*Ui_List_Get_Row)(size_t index, struct Ui_List_Row *row, void *userdata);
+
 struct Ui_Clickable_List {
 	struct Ui_Outline attr;
 	void (*on_click)(int index);
@@ -157,8 +170,27 @@ struct Ui_Clickable_List {
 		char items[UI_LIST_MAX_ITEMS][UI_LIST_MAX_ITEM_LEN];
 		int index_selected_item;
 		size_t count;
-		size_t page_index;
 		size_t items_per_page;
+		int row_height;
+		struct Ui_List_Scroll {
+			float offset;          // px from the first row to the top of the list
+			float velocity;        // px per second, decays after a fling
+			bool is_tracking;      // pointer was pressed inside the list
+			bool is_dragging;      // pointer moved too far to be a tap
+			bool stopped_fling;    // press stopped a running fling, no tap
+			bool is_tap;           // released this frame after a tap inside the list
+			uint64_t last_event_ns;
+			uint64_t last_update_ns;
+		} scroll;
+		Ui_List_Get_Row get_row;
+		void *userdata;
+		uint64_t generation;
+		uint64_t frame;
+		struct Ui_List_Row_Cache {
+			uint64_t id;
+			uint64_t last_used;
+			SDL_Texture *texture;
+		} row_cache[UI_LIST_MAX_CACHED_ROWS];
 		struct Ui_Button button_prev_page;
 		struct Ui_Button button_page_index;
 		struct Ui_Button button_next_page;
@@ -169,12 +201,46 @@ void ui_clickable_list_init(
 	struct Ui_Clickable_List *list,
 	int x, int y, int w, int h);
 
+/**
+ * Virtualized mode: instead of copying every entry into the list, the list
+ * asks get_row() for the rows of the visible page only. The rendered rows are
+ * cached by their id.
+ */
+void ui_clickable_list_set_source(
+	struct Ui_Clickable_List *list,
+	size_t count,
+	Ui_List_Get_Row get_row,
+	void *userdata);
+void ui_clickable_list_set_count(struct Ui_Clickable_List *list, size_t count);
+
 void ui_clickable_list_clear(struct Ui_Clickable_List *list);
 void ui_clickable_list_append(struct Ui_Clickable_List *list, const char *text);
 bool ui_clickable_list_select(struct Ui_Clickable_List *list, int index);
 void ui_clickable_list_render(struct Screen *screen, struct Ui_Clickable_List *list);
 
 
+////////////////////////////////////////////////////////////////////////////////
+#define UI_KEYBOARD_MAX_KEYS      48
+#define UI_KEYBOARD_KEY_BACKSPACE '\b'
+#define UI_KEYBOARD_KEY_CLEAR     '\x18'
+struct Ui_Keyboard {
+	struct Ui_Outline attr;
+	struct Ui_Keyboard_Key {
+		struct Ui_Outline outline;
+		char value;
+		SDL_Texture *texture; // rendered once, keys are drawn every frame
+	} keys[UI_KEYBOARD_MAX_KEYS];
+	size_t key_count;
+};
+void ui_keyboard_init(struct Screen *screen, struct Ui_Keyboard *keyboard, int x, int y, int w);
+
+/**
+ * Applies the pressed key to text, returns UI_EVENT_MODIFIED if the text
+ * changed.
+ */
+enum Ui_Event ui_keyboard_render(struct Screen *screen, struct Ui_Keyboard *keyboard, char *text, size_t text_size);
+
+
 ////////////////////////////////////////////////////////////////////////////////
 enum Ui_Media_Button {
 	UI_MEDIA_BUTTON_PLAY,
@@ -194,6 +260,8 @@ struct Ui_Media_Player {
 	int track_pos_sec;
 	int track_len_sec;
 	bool is_playing;
+	SDL_Texture *art_texture; // cover art, NULL if there is none
+	SDL_FRect art_rect;       // region of art_texture to draw
 	void (*on_button_clicked)(enum Ui_Media_Button btn);
 	struct {
 		struct {
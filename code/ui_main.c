@@ -6,7 +6,9 @@
 #include "app_dice.h"
 #include "ui_elements.h"
 #include "ui_audio_settings.h"
+#include "replay.h"
 #include "screensaver.h"
+#include "ui_perfhud.h"
 
 #include "libcutils/logger.h"
 #include "libcutils/util_makros.h"
@@ -15,12 +17,15 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define UI_STATUS_BAR_HEIGHT 70
 #define UI_STATUS_BAR_TEXT_Y_START     20
 #define UI_STATUS_BAR_DATETIME_X_START 840
 #define UI_WINDOW_BORDER               20
 #define UI_STATUS_BAR_X_START_RIGHT    300
+#define UI_STATUS_BAR_PERF_HUD_X       450
+#define UI_STATUS_BAR_PERF_HUD_Y       16
 
 struct App {
 	const char *name;
@@ -126,7 +131,7 @@ static void ui_main_draw_header(struct Screen *screen)
 	screen_draw_text(screen, 20, UI_STATUS_BAR_TEXT_Y_START, g_config.screen_font_size_l, "ShardOS");
 	screen_draw_text(screen, 20, UI_STATUS_BAR_TEXT_Y_START+g_config.screen_font_size_l, g_config.screen_font_size_s, "v0.1");
 
-	time_t now = time(NULL);
+	time_t now = replay_time();
 	struct tm *tm = localtime(&now);
 	char buf[32];
 
@@ -140,6 +145,7 @@ static void ui_main_draw_header(struct Screen *screen)
 
 	screen_draw_text(screen, UI_STATUS_BAR_DATETIME_X_START, UI_STATUS_BAR_TEXT_Y_START+g_config.screen_font_size_m, g_config.screen_font_size_m, buf);
 
+	ui_perfhud_render(screen, UI_STATUS_BAR_PERF_HUD_X, UI_STATUS_BAR_PERF_HUD_Y);
 }
 
 static void on_app_clicked(struct Ui_Box *box)
@@ -152,6 +158,41 @@ static void on_app_clicked(struct Ui_Box *box)
 	active_app->app_open(box->userdata);
 }
 
+bool ui_main_open_app(struct Screen *screen, const char *name)
+{
+	for (size_t i=0; i < ARRAY_SIZE(g_apps); ++i) {
+		if (strcmp(g_apps[i].name, name) != 0) continue;
+
+		ui_main_close(screen);
+		g_active_app_idx = (int)i;
+		g_apps[i].app_open(screen);
+		return true;
+	}
+	return false;
+}
+
+bool ui_main_open_dialog(const char *name)
+{
+	for (size_t i=0; i < ARRAY_SIZE(g_icons); ++i) {
+		if (strcmp(g_icons[i].name, name) != 0) continue;
+
+		if (g_dialog.is_open) on_header_icon_close();
+		on_header_icon_open((int)i);
+		return true;
+	}
+	return false;
+}
+
+void ui_main_close(struct Screen *screen)
+{
+	if (g_dialog.is_open) on_header_icon_close();
+
+	if (g_active_app_idx != -1) {
+		g_apps[g_active_app_idx].app_close(screen);
+		g_active_app_idx = -1;
+	}
+}
+
 #define APP_GRID_X_START  50
 #define APP_GRID_Y_START  150
 #define APP_BOX_WIDTH     100
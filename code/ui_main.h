@@ -11,4 +11,11 @@ enum App_Status {
 void ui_main_init(struct Screen *screen);
 void ui_main_render(struct Screen *screen);
 
+/** Switch the view by name, like a click on the app or header icon would. */
+bool ui_main_open_app(struct Screen *screen, const char *name);
+bool ui_main_open_dialog(const char *name);
+
+/** Back to the app grid, closes an open dialog and the active app. */
+void ui_main_close(struct Screen *screen);
+
 #endif // UI_MAIN_H
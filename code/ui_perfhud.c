@@ -0,0 +1,95 @@
+#include "ui_perfhud.h"
+
+#include "audio.h"
+#include "config.h"
+
+#include <string.h>
+
+#include "libcutils/util_makros.h"
+
+#define PERFHUD_HISTORY_SECS     10
+#define PERFHUD_HISTORY_SIZE     (PERFHUD_HISTORY_SECS*SCREEN_FPS)
+// 1 ms wide buckets, the last one takes everything above
+#define PERFHUD_BUCKET_COUNT     (1000/SCREEN_FPS + 2)
+#define PERFHUD_GRAPH_WIDTH      (PERFHUD_BUCKET_COUNT*3)
+#define PERFHUD_GRAPH_HEIGHT     40
+#define PERFHUD_TEXT_WIDTH       260
+
+static struct {
+	uint64_t history_ns[PERFHUD_HISTORY_SIZE];
+	size_t count;
+	int buckets[PERFHUD_BUCKET_COUNT];
+} g_perfhud;
+
+static size_t bucket_of(uint64_t ns)
+{
+	return MIN((size_t)(ns / 1000000), (size_t)PERFHUD_BUCKET_COUNT-1);
+}
+
+static void perfhud_add_frame(uint64_t cpu_ns)
+{
+	const size_t slot = g_perfhud.count % PERFHUD_HISTORY_SIZE;
+
+	if (g_perfhud.count >= PERFHUD_HISTORY_SIZE) {
+		g_perfhud.buckets[bucket_of(g_perfhud.history_ns[slot])]--;
+	}
+	g_perfhud.history_ns[slot] = cpu_ns;
+	g_perfhud.buckets[bucket_of(cpu_ns)]++;
+	g_perfhud.count++;
+}
+
+/** Upper bound of the bucket the percentile falls into, in ms. */
+static int perfhud_percentile_ms(int percent)
+{
+	const int frames = (int) MIN(g_perfhud.count, (size_t)PERFHUD_HISTORY_SIZE);
+	const int wanted = (frames*percent + 99) / 100;
+
+	int seen = 0;
+	for (int i = 0; i < PERFHUD_BUCKET_COUNT; ++i) {
+		seen += g_perfhud.buckets[i];
+		if (seen >= wanted) return i+1;
+	}
+	return PERFHUD_BUCKET_COUNT;
+}
+
+static void perfhud_draw_histogram(struct Screen *screen, int x, int y)
+{
+	int max_count = 1;
+	for (int i = 0; i < PERFHUD_BUCKET_COUNT; ++i) {
+		max_count = MAX(max_count, g_perfhud.buckets[i]);
+	}
+
+	const int bottom = y + PERFHUD_GRAPH_HEIGHT;
+	screen_draw_line(screen, x, bottom, x+PERFHUD_GRAPH_WIDTH, bottom);
+
+	for (int i = 0; i < PERFHUD_BUCKET_COUNT; ++i) {
+		if (g_perfhud.buckets[i] == 0) continue;
+
+		const int height = MAX(1, g_perfhud.buckets[i]*PERFHUD_GRAPH_HEIGHT / max_count);
+		screen_draw_line(screen, x+i*3, bottom, x+i*3, bottom-height);
+	}
+}
+
+void ui_perfhud_render(struct Screen *screen, int x, int y)
+{
+	const struct Screen_Frame_Stats *frame = &screen->last_frame;
+
+	perfhud_add_frame(frame->cpu_ns);
+	if (!screen->show_perf_hud) return;
+
+	const int font_size   = g_config.screen_font_size_xs;
+	const int line_height = font_size + 2;
+
+	screen_draw_text(screen, x, y, font_size, "cpu %.1fms  p50 %d  p99 %dms",
+		(double)frame->cpu_ns / 1e6, perfhud_percentile_ms(50), perfhud_percentile_ms(99));
+
+	screen_draw_text(screen, x, y+line_height, font_size, "draw %d  tex %d  text %d",
+		frame->draw_calls, frame->texture_uploads, frame->text_rasterizations);
+
+	struct Audio_Buffer_Health health;
+	audio_get_buffer_health(&health);
+	screen_draw_text(screen, x, y+2*line_height, font_size, "buf %d/%dms  stalls %d",
+		health.buffered_ms, health.target_ms, health.underruns);
+
+	perfhud_draw_histogram(screen, x+PERFHUD_TEXT_WIDTH, y+3*line_height-PERFHUD_GRAPH_HEIGHT);
+}
@@ -0,0 +1,16 @@
+#ifndef UI_PERFHUD_H
+#define UI_PERFHUD_H
+
+#include "screen.h"
+
+/**
+ * Performance overlay in the header: cpu time of the last frame with its
+ * p50/p99 over the last seconds, draw calls, texture uploads and text
+ * rasterisations per frame, buffer fill and underruns of the radio stream.
+ *
+ * Has to be called every frame to keep the history, it only draws while
+ * screen->show_perf_hud is set. Its own drawing shows up in the counters.
+ */
+void ui_perfhud_render(struct Screen *screen, int x, int y);
+
+#endif // UI_PERFHUD_H
@@ -0,0 +1,103 @@
+#include "ui_search.h"
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libcutils/logger.h"
+
+#define UI_SEARCH_KEYBOARD_Y_OFFSET 50
+
+static void ui_search_update_results(struct Ui_Search *search)
+{
+	if (search->is_index_dirty) {
+		search_index_clear(&search->index);
+		search->build_index(&search->index);
+		search->is_index_dirty = false;
+	}
+
+	const uint32_t count = search_index_query(&search->index, search->query);
+	log_debug("search '%s': %u results\n", search->query, count);
+}
+
+void ui_search_init(
+	struct Screen *screen,
+	struct Ui_Search *search,
+	int x_toggle, int y_toggle,
+	int x, int y, int w,
+	void (*build_index)(struct Search_Index *index))
+{
+	search->is_active      = false;
+	search->is_index_dirty = true;
+	search->query[0]       = '\0';
+	search->build_index    = build_index;
+	search->x              = x;
+	search->y              = y;
+
+	search_index_init(&search->index);
+	ui_button_init(screen, &search->button_toggle, "Search", x_toggle, y_toggle);
+	ui_keyboard_init(screen, &search->keyboard, x, y+UI_SEARCH_KEYBOARD_Y_OFFSET, w);
+}
+
+enum Ui_Event ui_search_render(struct Screen *screen, struct Ui_Search *search)
+{
+	enum Ui_Event ret = UI_EVENT_NONE;
+
+	if (ui_button_render(screen, &search->button_toggle) == UI_EVENT_CLICKED) {
+		if (search->is_active) {
+			ui_search_close(search);
+		}
+		else {
+			search->is_active = true;
+			search->query[0]  = '\0';
+			ui_search_update_results(search);
+			strncpy(search->button_toggle.text, "Done", sizeof(search->button_toggle.text));
+		}
+		return UI_EVENT_MODIFIED;
+	}
+
+	if (!search->is_active) return UI_EVENT_NONE;
+
+	screen_draw_text(screen, search->x, search->y, g_config.screen_font_size_m, "> %s_", search->query);
+
+	if (ui_keyboard_render(screen, &search->keyboard, search->query, sizeof(search->query)) == UI_EVENT_MODIFIED) {
+		ui_search_update_results(search);
+		ret = UI_EVENT_MODIFIED;
+	}
+
+	return ret;
+}
+
+void ui_search_close(struct Ui_Search *search)
+{
+	search->is_active = false;
+	strncpy(search->button_toggle.text, "Search", sizeof(search->button_toggle.text));
+}
+
+void ui_search_invalidate(struct Ui_Search *search)
+{
+	search->is_index_dirty = true;
+}
+
+void ui_search_update_entry(struct Ui_Search *search, size_t entry_index, const char *text)
+{
+	// not built yet, the next build reads the new text anyway
+	if (search->is_index_dirty) return;
+
+	Result r = search_index_update(&search->index, (uint32_t) entry_index, text);
+	if (!r.success) {
+		log_error("rebuilding the search index: %s\n", r.msg);
+		search->is_index_dirty = true;
+	}
+}
+
+size_t ui_search_count(const struct Ui_Search *search, size_t total_count)
+{
+	return search->is_active ? search->index.result_count : total_count;
+}
+
+size_t ui_search_entry_index(const struct Ui_Search *search, size_t list_index)
+{
+	return search->is_active ? search->index.results[list_index] : list_index;
+}
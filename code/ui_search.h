@@ -0,0 +1,52 @@
+#ifndef UI_SEARCH_H
+#define UI_SEARCH_H
+
+#include "screen.h"
+#include "ui_elements.h"
+#include "search_index.h"
+
+/**
+ * Search field with an on-screen keyboard, filtering the entries of an app
+ * list incrementally on every keystroke.
+ *
+ * build_index() is called when the search is opened or the index was
+ * invalidated, the app adds one text per list entry in list order. While the
+ * search is active, the list shows index.results instead of all entries.
+ */
+struct Ui_Search {
+	bool is_active;
+	bool is_index_dirty;
+	char query[SEARCH_INDEX_MAX_QUERY_LEN];
+	void (*build_index)(struct Search_Index *index);
+	struct Search_Index index;
+	struct Ui_Button button_toggle;
+	struct Ui_Keyboard keyboard;
+	int x;
+	int y;
+};
+
+void ui_search_init(
+	struct Screen *screen,
+	struct Ui_Search *search,
+	int x_toggle, int y_toggle,
+	int x, int y, int w,
+	void (*build_index)(struct Search_Index *index));
+
+/**
+ * Returns UI_EVENT_MODIFIED if the results changed or the search was opened
+ * or closed.
+ */
+enum Ui_Event ui_search_render(struct Screen *screen, struct Ui_Search *search);
+void ui_search_close(struct Ui_Search *search);
+void ui_search_invalidate(struct Ui_Search *search);
+
+/**
+ * The text of one entry changed, it is updated in place instead of a
+ * rebuild of the whole index. Applies from the next keystroke on.
+ */
+void ui_search_update_entry(struct Ui_Search *search, size_t entry_index, const char *text);
+
+size_t ui_search_count(const struct Ui_Search *search, size_t total_count);
+size_t ui_search_entry_index(const struct Ui_Search *search, size_t list_index);
+
+#endif // UI_SEARCH_H
@@ -0,0 +1,230 @@
+#include "watchdog.h"
+
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <SDL3/SDL.h>
+
+#include "config.h"
+#include "trace.h"
+
+#include "libcutils/logger.h"
+#include "libcutils/util_makros.h"
+
+#define WATCHDOG_SIGNAL          SIGUSR2
+#define WATCHDOG_CHECK_MS        50
+#define WATCHDOG_CAPTURE_WAIT_MS 100
+#define WATCHDOG_MAX_FRAMES      48
+#define WATCHDOG_MAX_SPANS       16
+#define WATCHDOG_LOG_FILE        "stalls.log"
+#define WATCHDOG_MAX_LOG_SIZE    (256*1024)
+
+static struct {
+	pthread_t render_thread;
+	pthread_t thread;
+	_Atomic bool is_running;
+	_Atomic bool quit;
+	int stall_ms;
+	char log_path[PATH_MAX];
+
+	// written by the render thread
+	_Atomic uint64_t frame_start_ms;
+	_Atomic uint64_t frames;
+
+	// filled by the signal handler on the render thread
+	void *backtrace[WATCHDOG_MAX_FRAMES];
+	int backtrace_size;
+	const char *spans[WATCHDOG_MAX_SPANS];
+	size_t span_count;
+	_Atomic bool is_captured;
+} g_watchdog;
+
+static uint64_t watchdog_now_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000ull + (uint64_t) now.tv_nsec / 1000000ull;
+}
+
+void watchdog_frame_begin(void)
+{
+	atomic_store_explicit(&g_watchdog.frame_start_ms, watchdog_now_ms(), memory_order_relaxed);
+	atomic_fetch_add_explicit(&g_watchdog.frames, 1, memory_order_release);
+}
+
+/** Runs on the render thread, wherever it is stuck. */
+static void watchdog_signal_handler(int signal)
+{
+	const int saved_errno = errno;
+
+	g_watchdog.backtrace_size = backtrace(g_watchdog.backtrace, WATCHDOG_MAX_FRAMES);
+	g_watchdog.span_count     = trace_get_span_stack(g_watchdog.spans, WATCHDOG_MAX_SPANS);
+	atomic_store(&g_watchdog.is_captured, true);
+
+	errno = saved_errno;
+	(void) signal;
+}
+
+static bool watchdog_capture(void)
+{
+	atomic_store(&g_watchdog.is_captured, false);
+	if (pthread_kill(g_watchdog.render_thread, WATCHDOG_SIGNAL) != 0) return false;
+
+	for (int waited_ms = 0; waited_ms < WATCHDOG_CAPTURE_WAIT_MS; waited_ms += 5) {
+		if (atomic_load(&g_watchdog.is_captured)) return true;
+		SDL_Delay(5);
+	}
+	return false;
+}
+
+static int watchdog_open_log(void)
+{
+	struct stat st;
+	if (stat(g_watchdog.log_path, &st) == 0 && st.st_size > WATCHDOG_MAX_LOG_SIZE) {
+		char old_path[PATH_MAX+4];
+		snprintf(old_path, sizeof(old_path), "%s.1", g_watchdog.log_path);
+		rename(g_watchdog.log_path, old_path);
+	}
+	return open(g_watchdog.log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+}
+
+static void watchdog_format_spans(char *text, size_t text_size)
+{
+	size_t used = 0;
+	text[0] = '\0';
+
+	for (size_t i = 0; i < g_watchdog.span_count && used < text_size; ++i) {
+		const int written = snprintf(text+used, text_size-used, "%s%s", (i > 0) ? " > " : "", g_watchdog.spans[i]);
+		if (written < 0) break;
+		used += (size_t) written;
+	}
+	if (g_watchdog.span_count == 0) snprintf(text, text_size, "none");
+}
+
+static void watchdog_report_stall(uint64_t frame, uint64_t blocked_ms)
+{
+	const bool is_captured = watchdog_capture();
+
+	char spans[512];
+	if (is_captured) watchdog_format_spans(spans, sizeof(spans));
+	else snprintf(spans, sizeof(spans), "unknown, the render thread did not answer");
+
+	log_warning("watchdog: frame %llu blocked for %llu ms, spans: %s\n",
+		(unsigned long long) frame, (unsigned long long) blocked_ms, spans);
+
+	const int fd = watchdog_open_log();
+	if (fd < 0) {
+		log_warning("watchdog: unable to open %s: %s\n", g_watchdog.log_path, strerror(errno));
+		return;
+	}
+
+	char stamp[32];
+	const time_t now = time(NULL);
+	struct tm local;
+	localtime_r(&now, &local);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+	dprintf(fd, "%s frame %llu blocked for more than %llu ms\nspans: %s\n",
+		stamp, (unsigned long long) frame, (unsigned long long) blocked_ms, spans);
+
+	// addresses of static functions can be resolved with addr2line
+	if (is_captured) backtrace_symbols_fd(g_watchdog.backtrace, g_watchdog.backtrace_size, fd);
+	close(fd);
+}
+
+static void watchdog_report_recovery(uint64_t frame, uint64_t blocked_ms)
+{
+	log_warning("watchdog: frame %llu took %llu ms\n", (unsigned long long) frame, (unsigned long long) blocked_ms);
+
+	const int fd = watchdog_open_log();
+	if (fd < 0) return;
+
+	dprintf(fd, "frame %llu took %llu ms\n\n", (unsigned long long) frame, (unsigned long long) blocked_ms);
+	close(fd);
+}
+
+static void *watchdog_thread(void *arg)
+{
+	uint64_t stalled_frame = 0;   // 0 while the render thread is fine
+	uint64_t stall_start   = 0;
+
+	while (!atomic_load(&g_watchdog.quit)) {
+		SDL_Delay(WATCHDOG_CHECK_MS);
+
+		// read in this order the start belongs to this frame or a later one
+		const uint64_t frame = atomic_load_explicit(&g_watchdog.frames, memory_order_acquire);
+		const uint64_t start = atomic_load_explicit(&g_watchdog.frame_start_ms, memory_order_relaxed);
+		const uint64_t now   = watchdog_now_ms();
+
+		if (stalled_frame != 0) {
+			if (frame != stalled_frame) {
+				watchdog_report_recovery(stalled_frame, watchdog_now_ms() - stall_start);
+				stalled_frame = 0;
+			}
+			continue;
+		}
+
+		if (frame == 0 || now < start || now - start < (uint64_t) g_watchdog.stall_ms) continue;
+
+		stalled_frame = frame;
+		stall_start   = start;
+		watchdog_report_stall(frame, now - start);
+	}
+
+	(void) arg;
+	return NULL;
+}
+
+Result watchdog_start(int stall_ms)
+{
+	if (stall_ms <= 0 || atomic_load(&g_watchdog.is_running)) return result_make_success();
+
+	char dir[PATH_MAX];
+	Result r = config_get_cache_path("watchdog", dir, sizeof(dir));
+	if (!r.success) return r;
+	snprintf(g_watchdog.log_path, sizeof(g_watchdog.log_path), "%s/%s", dir, WATCHDOG_LOG_FILE);
+
+	// the first backtrace() loads libgcc, which must not happen in the handler
+	void *warmup[1];
+	backtrace(warmup, 1);
+
+	struct sigaction action = {0};
+	action.sa_handler = watchdog_signal_handler;
+	action.sa_flags   = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(WATCHDOG_SIGNAL, &action, NULL) != 0) {
+		return result_make(false, "unable to install the signal handler: %s", strerror(errno));
+	}
+
+	g_watchdog.render_thread = pthread_self();
+	g_watchdog.stall_ms      = stall_ms;
+	atomic_store(&g_watchdog.quit, false);
+
+	if (pthread_create(&g_watchdog.thread, NULL, watchdog_thread, NULL) != 0) {
+		return result_make(false, "unable to start the watchdog thread");
+	}
+	atomic_store(&g_watchdog.is_running, true);
+
+	log_info("watchdog: reporting frames longer than %d ms to %s\n", stall_ms, g_watchdog.log_path);
+	return result_make_success();
+}
+
+void watchdog_stop(void)
+{
+	if (!atomic_load(&g_watchdog.is_running)) return;
+
+	atomic_store(&g_watchdog.quit, true);
+	pthread_join(g_watchdog.thread, NULL);
+	atomic_store(&g_watchdog.is_running, false);
+}
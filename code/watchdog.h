@@ -0,0 +1,21 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "libcutils/result.h"
+
+/**
+ * Watches the render thread from a thread of its own. A frame that takes
+ * longer than stall_ms gets the open trace spans and a backtrace of the
+ * render thread, taken by a signal while it is still stuck, and appended
+ * to <cache_dir>/watchdog/stalls.log. The log is rotated once it grows
+ * past 256 KB, the previous one is kept as stalls.log.1.
+ *
+ * Has to be started from the render thread.
+ */
+Result watchdog_start(int stall_ms);
+void   watchdog_stop(void);
+
+/** Called by the render thread at the start of every frame. */
+void   watchdog_frame_begin(void);
+
+#endif // WATCHDOG_H